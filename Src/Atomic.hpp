@@ -453,4 +453,95 @@ namespace Atomic
 #endif
 	}
 #endif
+
+	//////////////////////////////////////////////////////////////////////////
+	// 之前的读取不会被重排到之后的读写操作之后
+	inline void ThreadFenceAcquire()
+	{
+#if defined(PLATFORM_GNUC_LIKE)
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+#elif defined(PLATFORM_IS_WINDOWS)
+#  if defined(PLATFORM_ARCH_ARM)
+		__dmb(_ARM64_BARRIER_ISH);
+#  else
+		_ReadWriteBarrier();
+#  endif
+#endif
+	}
+
+	// 之前的读写操作不会被重排到之后的写入之后
+	inline void ThreadFenceRelease()
+	{
+#if defined(PLATFORM_GNUC_LIKE)
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+#elif defined(PLATFORM_IS_WINDOWS)
+#  if defined(PLATFORM_ARCH_ARM)
+		__dmb(_ARM64_BARRIER_ISH);
+#  else
+		_ReadWriteBarrier();
+#  endif
+#endif
+	}
+
+	// 全序屏障, 之前的写入不会被重排到之后的读取之后
+	inline void ThreadFenceSeqCst()
+	{
+#if defined(PLATFORM_GNUC_LIKE)
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+#elif defined(PLATFORM_IS_WINDOWS)
+#  if defined(PLATFORM_ARCH_ARM)
+		__dmb(_ARM64_BARRIER_ISH);
+#  else
+		_mm_mfence();
+#  endif
+#endif
+	}
+
+	template <class T,
+	          ENABLE_IF(std::is_integral<T>::value)>
+	T LoadAcquire(const T *pSrc)
+	{
+#if defined(PLATFORM_GNUC_LIKE)
+		return __atomic_load_n(pSrc, __ATOMIC_ACQUIRE);
+#elif defined(PLATFORM_IS_WINDOWS)
+		T val = *static_cast<const volatile T*>(pSrc);
+		ThreadFenceAcquire();
+		return val;
+#endif
+	}
+
+	template <class T,
+	          ENABLE_IF(std::is_integral<T>::value)>
+	void StoreRelease(T *pDest, T val)
+	{
+#if defined(PLATFORM_GNUC_LIKE)
+		__atomic_store_n(pDest, val, __ATOMIC_RELEASE);
+#elif defined(PLATFORM_IS_WINDOWS)
+		ThreadFenceRelease();
+		*static_cast<volatile T*>(pDest) = val;
+#endif
+	}
+
+	// 只保证读写本身的原子性, 不提供顺序约束
+	template <class T,
+	          ENABLE_IF(std::is_integral<T>::value)>
+	T LoadRelaxed(const T *pSrc)
+	{
+#if defined(PLATFORM_GNUC_LIKE)
+		return __atomic_load_n(pSrc, __ATOMIC_RELAXED);
+#elif defined(PLATFORM_IS_WINDOWS)
+		return *static_cast<const volatile T*>(pSrc);
+#endif
+	}
+
+	template <class T,
+	          ENABLE_IF(std::is_integral<T>::value)>
+	void StoreRelaxed(T *pDest, T val)
+	{
+#if defined(PLATFORM_GNUC_LIKE)
+		__atomic_store_n(pDest, val, __ATOMIC_RELAXED);
+#elif defined(PLATFORM_IS_WINDOWS)
+		*static_cast<volatile T*>(pDest) = val;
+#endif
+	}
 }
@@ -2,6 +2,9 @@
 
 #include "Predefines.hpp"
 
+// 竞争时的主动避让, 由 SRWLock 实现
+void Backoff(uint32_t *pCount);
+
 //////////////////////////////////////////////////////////////////////////
 template <class T>
 class LockGuard
@@ -75,3 +78,233 @@ private:
 	T &Lock_;
 	bool IsUnlocked_ = false;
 };
+
+//////////////////////////////////////////////////////////////////////////
+template <class T>
+class UpgradeLockGuard
+{
+public:
+	explicit UpgradeLockGuard(T &lk)
+		: Lock_(lk)
+	{
+		Lock_.lock_upgrade();
+	}
+
+	~UpgradeLockGuard()
+	{
+		unlock();
+	}
+
+	// 升级为独占
+	void upgrade()
+	{
+		if (State_ != STATE_UPGRADE)
+			return;
+
+		State_ = STATE_EXCLUSIVE;
+
+		Lock_.unlock_upgrade_and_lock();
+	}
+
+	// 降级为共享
+	void downgrade()
+	{
+		if (State_ == STATE_UPGRADE)
+			Lock_.unlock_upgrade_and_lock_shared();
+		else if (State_ == STATE_EXCLUSIVE)
+			Lock_.unlock_and_lock_shared();
+		else
+			return;
+
+		State_ = STATE_SHARED;
+	}
+
+	// 解锁
+	void unlock()
+	{
+		switch (State_)
+		{
+		case STATE_UPGRADE:
+			Lock_.unlock_upgrade();
+			break;
+		case STATE_EXCLUSIVE:
+			Lock_.unlock();
+			break;
+		case STATE_SHARED:
+			Lock_.unlock_shared();
+			break;
+		default:
+			return;
+		}
+
+		State_ = STATE_UNLOCKED;
+	}
+
+	bool is_exclusive() const
+	{
+		return State_ == STATE_EXCLUSIVE;
+	}
+
+	T* mutex() const
+	{
+		return &Lock_;
+	}
+
+private:
+	enum LockState
+	{
+		STATE_UPGRADE,
+		STATE_EXCLUSIVE,
+		STATE_SHARED,
+		STATE_UNLOCKED
+	};
+
+	T &Lock_;
+	LockState State_ = STATE_UPGRADE;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 同时获得的锁个数上限
+static const size_t LOCK_MULTIPLE_MAX = 16;
+
+// 标记以共享方式加锁
+template <class T>
+struct SharedLockArg
+{
+	T *Lock;
+};
+
+template <class T>
+SharedLockArg<T> AsShared(T &lk)
+{
+	return { &lk };
+}
+
+// 类型擦除后的单个加锁项
+struct MultiLockEntry
+{
+	void *Lock;
+	void (*FuncLock)(void *pLock);
+	bool (*FuncTryLock)(void *pLock);
+	void (*FuncUnlock)(void *pLock);
+};
+
+template <class T>
+MultiLockEntry MakeMultiLockEntry(T &lk)
+{
+	return
+	{
+		&lk,
+		[](void *pLock) { static_cast<T*>(pLock)->lock(); },
+		[](void *pLock) { return static_cast<T*>(pLock)->try_lock(); },
+		[](void *pLock) { static_cast<T*>(pLock)->unlock(); },
+	};
+}
+
+template <class T>
+MultiLockEntry MakeMultiLockEntry(SharedLockArg<T> arg)
+{
+	return
+	{
+		arg.Lock,
+		[](void *pLock) { static_cast<T*>(pLock)->lock_shared(); },
+		[](void *pLock) { return static_cast<T*>(pLock)->try_lock_shared(); },
+		[](void *pLock) { static_cast<T*>(pLock)->unlock_shared(); },
+	};
+}
+
+// 无死锁地获得全部锁. 阻塞等待上一轮失败的锁, 获得后依次尝试其余的锁,
+// 任意一个失败则全部释放, 避让后从失败的锁重新开始. 不能包含重复的锁
+inline void LockMultiple(MultiLockEntry *pEntries, size_t count)
+{
+	if (!count)
+		return;
+
+	uint32_t backoffCount = 0;
+	size_t first = 0;
+
+	for (;;)
+	{
+		pEntries[first].FuncLock(pEntries[first].Lock);
+
+		size_t failed = first;
+		for (size_t i = 1; i < count; ++i)
+		{
+			size_t idx = (first + i) % count;
+			if (!pEntries[idx].FuncTryLock(pEntries[idx].Lock))
+			{
+				failed = idx;
+				break;
+			}
+		}
+
+		if (failed == first)
+			return;
+
+		for (size_t idx = first; idx != failed; idx = (idx + 1) % count)
+			pEntries[idx].FuncUnlock(pEntries[idx].Lock);
+
+		first = failed;
+		Backoff(&backoffCount);
+	}
+}
+
+inline void UnlockMultiple(MultiLockEntry *pEntries, size_t count)
+{
+	for (size_t i = count; i > 0; --i)
+		pEntries[i - 1].FuncUnlock(pEntries[i - 1].Lock);
+}
+
+// 混合独占与共享方式同时加锁, 共享的锁以 AsShared 包装
+template <class... Ts>
+void LockMultiple(Ts&&... locks)
+{
+	MultiLockEntry entries[] = { MakeMultiLockEntry(locks)... };
+	LockMultiple(entries, sizeof...(Ts));
+}
+
+template <class... Ts>
+void UnlockMultiple(Ts&&... locks)
+{
+	MultiLockEntry entries[] = { MakeMultiLockEntry(locks)... };
+	UnlockMultiple(entries, sizeof...(Ts));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 同时持有多个锁, 析构时全部释放
+class MultiLockGuard
+{
+public:
+	template <class... Ts>
+	explicit MultiLockGuard(Ts&&... locks)
+		: Entries_{ MakeMultiLockEntry(locks)... }
+		, Count_(sizeof...(Ts))
+	{
+		static_assert(sizeof...(Ts) <= LOCK_MULTIPLE_MAX, "Too many locks");
+		LockMultiple(Entries_, Count_);
+	}
+
+	MultiLockGuard(const MultiLockGuard &) = delete;
+	MultiLockGuard(MultiLockGuard &&) = delete;
+
+	~MultiLockGuard()
+	{
+		unlock();
+	}
+
+	// 解锁
+	void unlock()
+	{
+		if (IsUnlocked_)
+			return;
+
+		IsUnlocked_ = true;
+
+		UnlockMultiple(Entries_, Count_);
+	}
+
+private:
+	MultiLockEntry Entries_[LOCK_MULTIPLE_MAX];
+	size_t Count_;
+	bool IsUnlocked_ = false;
+};
@@ -0,0 +1,239 @@
+﻿#include "SRWAsyncLock.hpp"
+
+#if defined(SRWLOCK_HAS_COROUTINE)
+#include "Atomic.hpp"
+#include "DebugLog.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 锁状态
+static const uint32_t AL_LOCKED = 0x1;
+// 队列中存在等待者
+static const uint32_t AL_WAITING = 0x2;
+static const uint32_t AL_SHARED = 0x4;
+
+static uint32_t LoadValue(const uint32_t &value)
+{
+	return static_cast<volatile const uint32_t&>(value);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SRWAsyncNode::Resume()
+{
+	if (pExecutor)
+		pExecutor->Post(Handle);
+	else
+		Handle.resume();
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWAsyncLock::try_lock()
+{
+	return Atomic::CompareExchange<uint32_t>(&LockStatus_, 0, AL_LOCKED) == 0;
+}
+
+void SRWAsyncLock::unlock()
+{
+	if (PLATFORM_LIKELY(Atomic::CompareExchange<uint32_t>(&LockStatus_, AL_LOCKED, 0) == AL_LOCKED))
+		return;
+
+	UnlockSlow(true);
+}
+
+bool SRWAsyncLock::try_lock_shared()
+{
+	uint32_t lastStatus = LoadValue(LockStatus_);
+
+	// 存在等待者时不再增加共享者, 避免独占者饥饿
+	while (!(lastStatus & (AL_LOCKED | AL_WAITING)))
+	{
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, lastStatus + AL_SHARED);
+		if (currStatus == lastStatus)
+			return true;
+
+		lastStatus = currStatus;
+	}
+	return false;
+}
+
+void SRWAsyncLock::unlock_shared()
+{
+	uint32_t lastStatus = LoadValue(LockStatus_);
+
+	// 最后一个共享者需要向等待者移交
+	while (lastStatus >= AL_SHARED * 2 || !(lastStatus & AL_WAITING))
+	{
+		AssertDebug(lastStatus >= AL_SHARED);
+
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, lastStatus - AL_SHARED);
+		if (currStatus == lastStatus)
+			return;
+
+		lastStatus = currStatus;
+	}
+
+	UnlockSlow(false);
+}
+
+bool SRWAsyncLock::Enqueue(SRWAsyncNode *pNode)
+{
+	pNode->Next = nullptr;
+
+	QueueLock_.lock();
+
+	// 等待标记只在队列锁内修改, 设置成功后解锁者必然在队列中找到该节点
+	uint32_t lastStatus = LoadValue(LockStatus_);
+	for (;;)
+	{
+		bool isLocked;
+		uint32_t newStatus;
+		if (pNode->IsExclusive)
+		{
+			isLocked = lastStatus == 0;
+			newStatus = isLocked ? AL_LOCKED : lastStatus | AL_WAITING;
+		}
+		else
+		{
+			isLocked = !(lastStatus & (AL_LOCKED | AL_WAITING));
+			newStatus = isLocked ? lastStatus + AL_SHARED : lastStatus | AL_WAITING;
+		}
+
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, newStatus);
+		if (currStatus == lastStatus)
+		{
+			if (isLocked)
+			{
+				QueueLock_.unlock();
+				return false;
+			}
+			break;
+		}
+
+		lastStatus = currStatus;
+	}
+
+	if (Tail_)
+		Tail_->Next = pNode;
+	else
+		Head_ = pNode;
+	Tail_ = pNode;
+
+	// 解锁队列后节点随时可能被恢复, 不能再访问
+	QueueLock_.unlock();
+	return true;
+}
+
+void SRWAsyncLock::UnlockSlow(bool isExclusive)
+{
+	QueueLock_.lock();
+
+	AssertDebug(isExclusive ?
+		(LoadValue(LockStatus_) & AL_LOCKED) :
+		(LoadValue(LockStatus_) & ~AL_WAITING) == AL_SHARED);
+	(void)isExclusive;
+
+	// 移交给队首的独占等待者, 或者队首连续的全部共享等待者
+	SRWAsyncNode *grantHead = Head_;
+	SRWAsyncNode *grantTail = nullptr;
+	uint32_t newStatus = 0;
+	if (grantHead && grantHead->IsExclusive)
+	{
+		grantTail = grantHead;
+		newStatus = AL_LOCKED;
+	}
+	else
+	{
+		for (SRWAsyncNode *pNode = grantHead; pNode && !pNode->IsExclusive; pNode = pNode->Next)
+		{
+			grantTail = pNode;
+			newStatus += AL_SHARED;
+		}
+	}
+
+	if (grantTail)
+	{
+		Head_ = grantTail->Next;
+		if (!Head_)
+			Tail_ = nullptr;
+		grantTail->Next = nullptr;
+	}
+
+	if (Head_)
+		newStatus |= AL_WAITING;
+
+	// 此时等待标记已阻止其他线程修改状态
+	Atomic::Exchange<uint32_t>(&LockStatus_, newStatus);
+
+	QueueLock_.unlock();
+
+	while (grantHead)
+	{
+		SRWAsyncNode *pNext = grantHead->Next;
+		grantHead->Resume();
+		grantHead = pNext;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SRWAsyncCondVar::notify_one()
+{
+	Notify(false);
+}
+
+void SRWAsyncCondVar::notify_all()
+{
+	Notify(true);
+}
+
+void SRWAsyncCondVar::Enqueue(SRWAsyncNode *pNode)
+{
+	pNode->Next = nullptr;
+
+	// 入队后节点随时可能被恢复, 提前取出解锁所需的字段
+	SRWAsyncLock *pLock = pNode->pLock;
+	bool isExclusive = pNode->IsExclusive;
+
+	QueueLock_.lock();
+	if (Tail_)
+		Tail_->Next = pNode;
+	else
+		Head_ = pNode;
+	Tail_ = pNode;
+	QueueLock_.unlock();
+
+	// 入队后再解锁, 持锁通知者必然能看到该节点
+	if (isExclusive)
+		pLock->unlock();
+	else
+		pLock->unlock_shared();
+}
+
+void SRWAsyncCondVar::Notify(bool isAll)
+{
+	QueueLock_.lock();
+	SRWAsyncNode *pHead = Head_;
+	if (pHead)
+	{
+		if (isAll)
+		{
+			Head_ = Tail_ = nullptr;
+		}
+		else
+		{
+			Head_ = pHead->Next;
+			if (!Head_)
+				Tail_ = nullptr;
+			pHead->Next = nullptr;
+		}
+	}
+	QueueLock_.unlock();
+
+	// 被通知的协程转入锁的等待队列, 立即获得锁时直接恢复
+	while (pHead)
+	{
+		SRWAsyncNode *pNext = pHead->Next;
+		if (!pHead->pLock->Enqueue(pHead))
+			pHead->Resume();
+		pHead = pNext;
+	}
+}
+#endif
@@ -0,0 +1,173 @@
+﻿#pragma once
+
+#include "SRWLock.hpp"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#  if __has_include(<coroutine>)
+// 支持 C++20 协程
+#    define SRWLOCK_HAS_COROUTINE 1
+#  endif
+#endif
+
+#if defined(SRWLOCK_HAS_COROUTINE)
+#include <coroutine>
+
+//////////////////////////////////////////////////////////////////////////
+// 协程执行器. 获得锁的协程通过它恢复执行, 为空时在解锁线程上直接恢复
+class SRWAsyncExecutor
+{
+public:
+	virtual ~SRWAsyncExecutor() = default;
+	virtual void Post(std::coroutine_handle<> handle) = 0;
+};
+
+class SRWAsyncLock;
+
+// 异步等待节点, 位于等待协程的帧内
+struct SRWAsyncNode
+{
+	std::coroutine_handle<> Handle;
+	SRWAsyncExecutor *pExecutor = nullptr;
+	SRWAsyncLock *pLock = nullptr;
+	SRWAsyncNode *Next = nullptr;
+	bool IsExclusive = false;
+
+	void Resume();
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 协程读写锁. 等待者以挂起的协程代替睡眠的线程, 按先后顺序排队,
+// 解锁时直接将所有权移交给等待者并通过执行器恢复. 无竞争时同步完成, 不挂起
+class SRWAsyncLock
+{
+public:
+	class LockAwaiter : private SRWAsyncNode
+	{
+	public:
+		LockAwaiter(SRWAsyncLock &lk, SRWAsyncExecutor *pExecutor, bool isExclusive)
+		{
+			this->pLock = &lk;
+			this->pExecutor = pExecutor;
+			this->IsExclusive = isExclusive;
+		}
+
+		bool await_ready()
+		{
+			return IsExclusive ? pLock->try_lock() : pLock->try_lock_shared();
+		}
+
+		// 入队时恰好获得锁则不挂起
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			Handle = handle;
+			return pLock->Enqueue(this);
+		}
+
+		void await_resume()
+		{
+		}
+	};
+
+public:
+	SRWAsyncLock() = default;
+	SRWAsyncLock(const SRWAsyncLock &) = delete;
+	SRWAsyncLock(SRWAsyncLock &&) = delete;
+
+	bool try_lock();
+	void unlock();
+
+	bool try_lock_shared();
+	void unlock_shared();
+
+	// co_await 后持有锁
+	LockAwaiter lock_async(SRWAsyncExecutor *pExecutor = nullptr)
+	{
+		return LockAwaiter(*this, pExecutor, true);
+	}
+
+	LockAwaiter lock_shared_async(SRWAsyncExecutor *pExecutor = nullptr)
+	{
+		return LockAwaiter(*this, pExecutor, false);
+	}
+
+private:
+	friend class SRWAsyncCondVar;
+
+	// 加锁或排队, 返回是否已排队
+	bool Enqueue(SRWAsyncNode *pNode);
+	void UnlockSlow(bool isExclusive);
+
+private:
+	// 锁定位, 等待标记, 共享计数
+	uint32_t LockStatus_ = 0;
+	// 保护等待队列
+	SRWLock QueueLock_;
+	SRWAsyncNode *Head_ = nullptr;
+	SRWAsyncNode *Tail_ = nullptr;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 协程条件变量. 被通知的协程重新排队加锁, 获得锁后才恢复执行
+class SRWAsyncCondVar
+{
+public:
+	class WaitAwaiter : private SRWAsyncNode
+	{
+	public:
+		WaitAwaiter(SRWAsyncCondVar &cv, SRWAsyncLock &lk, SRWAsyncExecutor *pExecutor, bool isExclusive)
+			: CondVar_(cv)
+		{
+			this->pLock = &lk;
+			this->pExecutor = pExecutor;
+			this->IsExclusive = isExclusive;
+		}
+
+		bool await_ready()
+		{
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			Handle = handle;
+			CondVar_.Enqueue(this);
+		}
+
+		void await_resume()
+		{
+		}
+
+	private:
+		SRWAsyncCondVar &CondVar_;
+	};
+
+public:
+	SRWAsyncCondVar() = default;
+	SRWAsyncCondVar(const SRWAsyncCondVar &) = delete;
+	SRWAsyncCondVar(SRWAsyncCondVar &&) = delete;
+
+	// 唤醒. 如果没有加锁则可能无法唤醒
+	void notify_one();
+	void notify_all();
+
+	// 挂起前释放锁, co_await 后重新持有锁
+	WaitAwaiter wait_async(SRWAsyncLock &lk, SRWAsyncExecutor *pExecutor = nullptr)
+	{
+		return WaitAwaiter(*this, lk, pExecutor, true);
+	}
+
+	WaitAwaiter wait_shared_async(SRWAsyncLock &lk, SRWAsyncExecutor *pExecutor = nullptr)
+	{
+		return WaitAwaiter(*this, lk, pExecutor, false);
+	}
+
+private:
+	void Enqueue(SRWAsyncNode *pNode);
+	void Notify(bool isAll);
+
+private:
+	SRWLock QueueLock_;
+	SRWAsyncNode *Head_ = nullptr;
+	SRWAsyncNode *Tail_ = nullptr;
+};
+#endif
@@ -0,0 +1,147 @@
+﻿#include "SRWBiasedLock.hpp"
+#include "Atomic.hpp"
+#include "Utility.hpp"
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+// 可见读者表大小, 必须为 2 的幂
+static const size_t VISIBLE_READERS_SIZE = 4096;
+// 冷却时间为撤销耗时的倍数
+static const uint64_t BIAS_INHIBIT_MULTIPLIER = 9;
+
+// 全局可见读者表. 每项记录以快速路径持有共享锁的锁地址
+static size_t g_VisibleReaders[VISIBLE_READERS_SIZE];
+
+// 按锁地址和线程计算读者表位置.
+// 不同线程的槽位可能相同, 但同一锁的共享持有可以互相替代, 解锁时只需检查槽位中的锁地址
+static size_t* VisibleReaderSlot(const void *pLock)
+{
+	static thread_local char s_ThreadTag;
+
+	uint64_t hash = reinterpret_cast<size_t>(pLock) ^ (reinterpret_cast<size_t>(&s_ThreadTag) >> 4);
+	hash *= 0x9E3779B97F4A7C15ULL;
+	return &g_VisibleReaders[(hash >> 32) & (VISIBLE_READERS_SIZE - 1)];
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWBiasedLock::TryLockBiased()
+{
+	if (!static_cast<volatile const uint32_t&>(ReadBias_))
+		return false;
+
+	size_t *pSlot = VisibleReaderSlot(this);
+	if (Atomic::CompareExchange<size_t>(pSlot, 0, reinterpret_cast<size_t>(this)) != 0)
+		return false;
+
+	// 登记后重新检查, 独占者可能已经开始撤销偏向.
+	// 登记的写入与此处的读取需保持顺序, 与撤销者的全序屏障配对
+	if (Atomic::LoadAcquire(&ReadBias_))
+		return true;
+
+	// 撤销登记. 若登记已被同槽位的其他共享者解锁时取走, 其持有的共享锁转由当前线程持有
+	return Atomic::CompareExchange<size_t>(pSlot, reinterpret_cast<size_t>(this), 0) != reinterpret_cast<size_t>(this);
+}
+
+void SRWBiasedLock::TryEnableBias()
+{
+	// 持有共享锁期间没有独占者修改偏向状态
+	if (!ReadBias_ && GetTickNanosec() >= InhibitUntil_)
+		ReadBias_ = 1;
+}
+
+bool SRWBiasedLock::RevokeBias(bool isWait)
+{
+	Atomic::Exchange<uint32_t>(&ReadBias_, 0);
+	// 关闭偏向的写入必须先于读者表的读取可见, 否则可能与刚登记的共享者同时进入
+	Atomic::ThreadFenceSeqCst();
+
+	uint64_t stt = GetTickNanosec();
+	size_t self = reinterpret_cast<size_t>(this);
+	bool isDrained = true;
+
+	for (size_t i = 0; i < VISIBLE_READERS_SIZE; ++i)
+	{
+		uint32_t spinCount = 0;
+		while (static_cast<volatile const size_t&>(g_VisibleReaders[i]) == self)
+		{
+			if (!isWait)
+			{
+				isDrained = false;
+				break;
+			}
+
+			// 共享者可能持有较久, 短暂自旋后让出时间片
+			if (++spinCount < 64)
+				PLATFORM_YIELD;
+			else
+				std::this_thread::yield();
+		}
+
+		if (!isDrained)
+			break;
+	}
+
+	uint64_t now = GetTickNanosec();
+	InhibitUntil_ = now + (now - stt) * BIAS_INHIBIT_MULTIPLIER;
+	return isDrained;
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWBiasedLock::try_lock()
+{
+	if (!Lock_.try_lock())
+		return false;
+
+	if (ReadBias_ && !RevokeBias(false))
+	{
+		// 仍有已登记的共享者, 恢复偏向状态, 使后续独占者重新撤销并等待其离开
+		Atomic::Exchange<uint32_t>(&ReadBias_, 1);
+		Lock_.unlock();
+		return false;
+	}
+	return true;
+}
+
+void SRWBiasedLock::lock()
+{
+	Lock_.lock();
+
+	if (ReadBias_)
+		RevokeBias(true);
+}
+
+void SRWBiasedLock::unlock()
+{
+	Lock_.unlock();
+}
+
+bool SRWBiasedLock::try_lock_shared()
+{
+	if (TryLockBiased())
+		return true;
+
+	if (!Lock_.try_lock_shared())
+		return false;
+
+	TryEnableBias();
+	return true;
+}
+
+void SRWBiasedLock::lock_shared()
+{
+	if (TryLockBiased())
+		return;
+
+	Lock_.lock_shared();
+	TryEnableBias();
+}
+
+void SRWBiasedLock::unlock_shared()
+{
+	// 同槽位的共享者可能同时解锁, 只有取走登记的一方可以直接返回, 另一方释放锁上的共享计数
+	size_t *pSlot = VisibleReaderSlot(this);
+	if (Atomic::CompareExchange<size_t>(pSlot, reinterpret_cast<size_t>(this), 0) == reinterpret_cast<size_t>(this))
+		return;
+
+	Lock_.unlock_shared();
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+
+#include "SRWLock.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 读偏向锁. 偏向开启时共享者只在全局可见读者表中登记, 不修改锁状态.
+// 独占者撤销偏向并等待已登记的共享者离开, 冷却一段时间后由共享者重新开启偏向
+class SRWBiasedLock
+{
+public:
+	SRWBiasedLock() = default;
+	SRWBiasedLock(const SRWBiasedLock &) = delete;
+	SRWBiasedLock(SRWBiasedLock &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+	bool try_lock_shared();
+	void lock_shared();
+	void unlock_shared();
+
+	bool is_biased() const
+	{
+		return ReadBias_ != 0;
+	}
+
+private:
+	bool TryLockBiased();
+	void TryEnableBias();
+	bool RevokeBias(bool isWait);
+
+private:
+	SRWLock Lock_;
+	uint32_t ReadBias_ = 1;
+	uint64_t InhibitUntil_ = 0;
+};
@@ -0,0 +1,163 @@
+﻿#include "SRWCohortLock.hpp"
+#include "Atomic.hpp"
+#include <vector>
+
+#if defined(PLATFORM_IS_WINDOWS)
+#  include <windows.h>
+#elif defined(PLATFORM_IS_LINUX)
+#  include <sched.h>
+#  include <stdio.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+#if defined(PLATFORM_IS_LINUX)
+// 处理器到节点的映射, 从 /sys/devices/system/node 读取
+struct NodeTopology
+{
+	std::vector<uint32_t> CpuToNode;
+	uint32_t NodeCount = 1;
+
+	NodeTopology()
+	{
+		char path[64];
+		for (uint32_t node = 0;; ++node)
+		{
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+			FILE *fp = fopen(path, "r");
+			if (!fp)
+				break;
+
+			// 格式为逗号分隔的区间, 例如 0-3,8-11
+			uint32_t first, last;
+			int count;
+			while ((count = fscanf(fp, "%u-%u", &first, &last)) > 0)
+			{
+				if (count == 1)
+					last = first;
+				if (CpuToNode.size() <= last)
+					CpuToNode.resize(last + 1);
+				for (uint32_t cpu = first; cpu <= last; ++cpu)
+					CpuToNode[cpu] = node;
+
+				if (fgetc(fp) != ',')
+					break;
+			}
+			fclose(fp);
+
+			NodeCount = node + 1;
+		}
+	}
+
+	static const NodeTopology& Get()
+	{
+		static NodeTopology s_Topology;
+		return s_Topology;
+	}
+};
+#endif
+
+uint32_t SRWLock_GetCurrentNode()
+{
+#if defined(PLATFORM_IS_WINDOWS)
+	PROCESSOR_NUMBER procNum;
+	GetCurrentProcessorNumberEx(&procNum);
+	USHORT node;
+	if (GetNumaProcessorNodeEx(&procNum, &node))
+		return node;
+	return 0;
+#elif defined(PLATFORM_IS_LINUX)
+	const NodeTopology &topology = NodeTopology::Get();
+	int cpu = sched_getcpu();
+	if (cpu < 0 || static_cast<size_t>(cpu) >= topology.CpuToNode.size())
+		return 0;
+	return topology.CpuToNode[cpu];
+#else
+	return 0;
+#endif
+}
+
+uint32_t SRWLock_GetNodeCount()
+{
+#if defined(PLATFORM_IS_WINDOWS)
+	ULONG highest;
+	if (GetNumaHighestNodeNumber(&highest))
+		return highest + 1;
+	return 1;
+#elif defined(PLATFORM_IS_LINUX)
+	return NodeTopology::Get().NodeCount;
+#else
+	return 1;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWCohortLock::try_lock()
+{
+	return try_lock(SRWLock_GetCurrentNode());
+}
+
+void SRWCohortLock::lock()
+{
+	lock(SRWLock_GetCurrentNode());
+}
+
+bool SRWCohortLock::try_lock(uint32_t node)
+{
+	node %= SRWLOCK_COHORT_MAX_NODES;
+	CohortNode &cohort = Nodes_[node];
+
+	if (!cohort.Local.try_lock())
+		return false;
+
+	if (!cohort.IsGlobalOwned)
+	{
+		if (!SRWLock_TryLock(Global_.native_handle()))
+		{
+			cohort.Local.unlock();
+			return false;
+		}
+		cohort.IsGlobalOwned = true;
+		cohort.Batch = 0;
+	}
+
+	OwnerNode_ = node;
+	return true;
+}
+
+void SRWCohortLock::lock(uint32_t node)
+{
+	node %= SRWLOCK_COHORT_MAX_NODES;
+	CohortNode &cohort = Nodes_[node];
+
+	// 登记为等待者, 持有者据此决定是否在节点内传递
+	Atomic::IncrementFetch(&cohort.Waiters);
+	cohort.Local.lock();
+	Atomic::DecrementFetch(&cohort.Waiters);
+
+	// 全局锁未由前一个本地持有者传递过来时需要重新获取
+	if (!cohort.IsGlobalOwned)
+	{
+		SRWLock_Lock(Global_.native_handle());
+		cohort.IsGlobalOwned = true;
+		cohort.Batch = 0;
+	}
+
+	OwnerNode_ = node;
+}
+
+void SRWCohortLock::unlock()
+{
+	CohortNode &cohort = Nodes_[OwnerNode_];
+
+	// 同节点有等待者且未达到批次上限时, 保留全局锁传递给本节点的下一个持有者
+	if (static_cast<volatile const uint32_t&>(cohort.Waiters) &&
+		++cohort.Batch < BatchLimit_)
+	{
+		cohort.Local.unlock();
+		return;
+	}
+
+	cohort.IsGlobalOwned = false;
+	SRWLock_Unlock(Global_.native_handle());
+	cohort.Local.unlock();
+}
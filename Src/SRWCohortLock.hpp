@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include "SRWLock.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 最多区分的 NUMA 节点个数, 超出的节点按序号取模合并
+#if !defined(SRWLOCK_COHORT_MAX_NODES)
+#  define SRWLOCK_COHORT_MAX_NODES 8
+#endif
+
+// 当前线程所在的 NUMA 节点序号, 无法检测时为 0
+uint32_t SRWLock_GetCurrentNode();
+// 系统的 NUMA 节点个数, 至少为 1
+uint32_t SRWLock_GetNodeCount();
+
+//////////////////////////////////////////////////////////////////////////
+// NUMA 感知的队列锁. 每个节点一个本地锁, 节点之间竞争全局锁.
+// 解锁时若同节点还有等待者, 则保留全局锁只释放本地锁, 所有权在节点内传递,
+// 连续传递达到批次上限后释放全局锁, 让其他节点有机会获得
+class SRWCohortLock
+{
+	struct alignas(64) CohortNode
+	{
+		SRWLock Local;
+		// 正在等待本地锁的线程数
+		uint32_t Waiters = 0;
+		// 以下成员只由本地锁的持有者访问
+		// 本节点连续持有全局锁的次数
+		uint32_t Batch = 0;
+		// 全局锁已由本节点持有
+		bool IsGlobalOwned = false;
+	};
+
+public:
+	explicit SRWCohortLock(uint32_t batchLimit = 64)
+		: BatchLimit_(batchLimit)
+	{
+	}
+
+	SRWCohortLock(const SRWCohortLock &) = delete;
+	SRWCohortLock(SRWCohortLock &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+	// 指定所在节点加锁, 适合已绑定到节点的线程省去节点查询
+	bool try_lock(uint32_t node);
+	void lock(uint32_t node);
+
+	uint32_t batch_limit() const
+	{
+		return BatchLimit_;
+	}
+
+private:
+	CohortNode Nodes_[SRWLOCK_COHORT_MAX_NODES];
+	// 在同一节点的线程间传递, 解锁者可能不是加锁者, 只通过底层接口加解锁
+	alignas(64) SRWLock Global_;
+	// 当前持有者所在的节点
+	uint32_t OwnerNode_ = 0;
+	uint32_t BatchLimit_;
+};
@@ -95,6 +95,8 @@ PLATFORM_NOINLINE static void DoWakeCondVariable(size_t *pCondStatus, SRWStatus
 				!QueueStackNodeToSRWLock(pCurrNotify, pLastLock))
 			{
 				Atomic::FetchBitSet(&pCurrNotify->Flags, BIT_WAKING);
+				SRWLOCK_STAT_ADD(pCondStatus, STAT_WAKE_UP, 1);
+				SRWLOCK_PROBE2(wake, pCondStatus, pCurrNotify);
 				pCurrNotify->WakeUp();
 			}
 		}
@@ -225,11 +227,9 @@ PLATFORM_NOINLINE static bool WakeSingle(size_t *pCondStatus, SRWStackNode *pWai
 	return result;
 }
 
-PLATFORM_NOINLINE bool SRWCondVar_Wait(size_t *pCondStatus, size_t *pLockStatus, uint64_t timeOut, bool isShared)
+// 节点挂入条件变量的等待链表, 返回是否需要优化链表
+static bool QueueCondNode(size_t *pCondStatus, CVStackNode &stackNode, size_t *pLockStatus, bool isShared, SRWStatus &newStatus)
 {
-	SRWStatus newStatus;
-	alignas(16) CVStackNode stackNode{};
-
 	SRWStatus lastStatus = *pCondStatus;
 	stackNode.Next = nullptr;
 	stackNode.LastLock = pLockStatus;
@@ -256,45 +256,283 @@ PLATFORM_NOINLINE bool SRWCondVar_Wait(size_t *pCondStatus, size_t *pLockStatus,
 		SRWStatus oldStatus = lastStatus;
 		lastStatus = Atomic::CompareExchange<size_t>(pCondStatus, lastStatus.Value, newStatus.Value);
 		if (lastStatus == oldStatus)
-			break;
+			return lastStatus.MultiShared != newStatus.MultiShared;
+	}
+}
+
+// 等待已被通知者取走的节点完成唤醒
+static void WaitCondNode(CVStackNode &stackNode)
+{
+	do
+	{
+		stackNode.WaitMicrosec();
+	} while (!(stackNode.Flags & FLAG_WAKING));
+}
+
+static void RelockCondVar(size_t *pLockStatus, uint32_t *pSpinEstimate, bool isShared)
+{
+	if (pSpinEstimate)
+	{
+		if (isShared)
+			SRWLock_LockSharedAdaptive(pLockStatus, pSpinEstimate);
+		else
+			SRWLock_LockAdaptive(pLockStatus, pSpinEstimate);
+	}
+	else
+	{
+		if (isShared)
+			SRWLock_LockShared(pLockStatus);
+		else
+			SRWLock_Lock(pLockStatus);
 	}
+}
+
+// 自旋估计值为空时使用默认自旋次数. 条件变量的等待时长取决于通知者, 不作为估计值的采样
+static bool CondVarWaitImpl(size_t *pCondStatus, size_t *pLockStatus, uint32_t *pSpinEstimate, uint64_t timeOut, bool isShared)
+{
+	SRWStatus newStatus;
+	alignas(32) CVStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pCondStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	bool isOptimize = QueueCondNode(pCondStatus, stackNode, pLockStatus, isShared, newStatus);
+	SRWLOCK_PROBE3(enqueue, pCondStatus, !isShared, SRWLOCK_PROBE_NOW(enqueue));
 
 	if (isShared)
 		SRWLock_UnlockShared(pLockStatus);
 	else
 		SRWLock_Unlock(pLockStatus);
 
-	if (lastStatus.MultiShared != newStatus.MultiShared)
+	if (isOptimize)
 		OptimizeWaitList(pCondStatus, newStatus);
 
-	Spinning(stackNode);
+	if (pSpinEstimate)
+		Spinning(stackNode, AdaptiveSpinCount(pSpinEstimate));
+	else
+		Spinning(stackNode);
 
 	bool isTimeOut = false;
 	if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		SRWLOCK_STAT_ADD(pCondStatus, STAT_PARK, 1);
+		SRWLOCK_PROBE3(spin_exit, pCondStatus, false, SRWLOCK_PROBE_NOW(spin_exit));
+		SRWLOCK_PROBE2(park, pCondStatus, SRWLOCK_PROBE_NOW(park));
 		isTimeOut = stackNode.WaitMicrosec(timeOut);
+	}
 	else
+	{
+		SRWLOCK_STAT_ADD(pCondStatus, STAT_SPIN_WIN, 1);
+		SRWLOCK_PROBE3(spin_exit, pCondStatus, true, SRWLOCK_PROBE_NOW(spin_exit));
 		Atomic::FetchBitSet(&stackNode.Flags, BIT_WAKING);
+	}
 
 	if (isTimeOut || !(stackNode.Flags & FLAG_WAKING))
 	{
 		if (!WakeSingle(pCondStatus, &stackNode))
 		{
-			do
-			{
-				stackNode.WaitMicrosec();
-			} while (!(stackNode.Flags & FLAG_WAKING));
-
+			WaitCondNode(stackNode);
 			isTimeOut = false;
 		}
 	}
 
+	SRWLOCK_STAT_CONTENDED(waitStart);
+	SRWLOCK_PROBE_ACQUIRE(pCondStatus, traceStart);
+	RelockCondVar(pLockStatus, pSpinEstimate, isShared);
+
+	return isTimeOut;
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+// 取消时与超时相同地撤销节点, 已被通知时以通知为准
+static bool CondVarWaitCancellableImpl(size_t *pCondStatus, size_t *pLockStatus, const std::stop_token &token, bool isShared)
+{
+	SRWStatus newStatus;
+	alignas(32) CVStackNode stackNode{};
+
+	std::stop_callback<SRWStopCallback> stopCallback(token, SRWStopCallback{ &stackNode });
+
+	// 已请求取消时不释放锁
+	if (IsCancelRequested(stackNode))
+		return true;
+
+	SRWLOCK_STAT_WAIT(pCondStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+	bool isOptimize = QueueCondNode(pCondStatus, stackNode, pLockStatus, isShared, newStatus);
+	SRWLOCK_PROBE3(enqueue, pCondStatus, !isShared, SRWLOCK_PROBE_NOW(enqueue));
+
 	if (isShared)
-		SRWLock_LockShared(pLockStatus);
+		SRWLock_UnlockShared(pLockStatus);
 	else
-		SRWLock_Lock(pLockStatus);
+		SRWLock_Unlock(pLockStatus);
 
-	return isTimeOut;
+	if (isOptimize)
+		OptimizeWaitList(pCondStatus, newStatus);
+
+	Spinning(stackNode);
+
+	bool isCancelled = false;
+	if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		SRWLOCK_STAT_ADD(pCondStatus, STAT_PARK, 1);
+		SRWLOCK_PROBE3(spin_exit, pCondStatus, false, SRWLOCK_PROBE_NOW(spin_exit));
+		SRWLOCK_PROBE2(park, pCondStatus, SRWLOCK_PROBE_NOW(park));
+		isCancelled = SleepCancellable(stackNode) != SLEEP_AWAKE;
+	}
+	else
+	{
+		SRWLOCK_STAT_ADD(pCondStatus, STAT_SPIN_WIN, 1);
+		SRWLOCK_PROBE3(spin_exit, pCondStatus, true, SRWLOCK_PROBE_NOW(spin_exit));
+		Atomic::FetchBitSet(&stackNode.Flags, BIT_WAKING);
+	}
+
+	if (isCancelled || !(stackNode.Flags & FLAG_WAKING))
+	{
+		if (!WakeSingle(pCondStatus, &stackNode))
+		{
+			WaitCondNode(stackNode);
+			isCancelled = false;
+		}
+	}
+
+	SRWLOCK_STAT_CONTENDED(waitStart);
+	SRWLOCK_PROBE_ACQUIRE(pCondStatus, traceStart);
+	RelockCondVar(pLockStatus, nullptr, isShared);
+
+	return isCancelled;
 }
+#endif
+
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+// 每个条件变量挂入一个节点, 所有节点的等待事件一起等待. 其中一个被通知后撤销其余节点,
+// 无法撤销的节点也已被通知, 为避免吞掉单个通知, 将其转交给该条件变量的其他等待者.
+// 节点不转移到锁的等待链表, 否则多个节点同时被通知时只有一个能被解锁者唤醒
+static size_t CondVarWaitAnyImpl(size_t *const *ppCondStatus, size_t count, size_t *pLockStatus, uint64_t timeOut, bool isShared)
+{
+	AssertDebug(count <= SRWLOCK_WAIT_ANY_MAX);
+
+	alignas(32) CVStackNode stackNodes[SRWLOCK_WAIT_ANY_MAX];
+	WaitEvent *events[SRWLOCK_WAIT_ANY_MAX];
+	SRWStatus newStatus[SRWLOCK_WAIT_ANY_MAX];
+	bool isOptimize[SRWLOCK_WAIT_ANY_MAX];
+	// 节点已挂起且其唤醒尚未被消耗
+	bool isParked[SRWLOCK_WAIT_ANY_MAX];
+	bool isRenotify[SRWLOCK_WAIT_ANY_MAX];
+
+	uint64_t deadline = -1;
+	if (timeOut != -1)
+		deadline = GetDeadlineMicrosec(timeOut);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		isOptimize[i] = QueueCondNode(ppCondStatus[i], stackNodes[i], nullptr, isShared, newStatus[i]);
+		events[i] = &stackNodes[i];
+		isRenotify[i] = false;
+	}
+
+	if (isShared)
+		SRWLock_UnlockShared(pLockStatus);
+	else
+		SRWLock_Unlock(pLockStatus);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (isOptimize[i])
+			OptimizeWaitList(ppCondStatus[i], newStatus[i]);
+	}
+
+	// 清除自旋标记, 失败说明入队期间已被通知
+	size_t index = -1;
+	for (size_t i = 0; i < count; ++i)
+	{
+		isParked[i] = Atomic::FetchBitClear(&stackNodes[i].Flags, BIT_SPINNING);
+		if (!isParked[i])
+		{
+			Atomic::FetchBitSet(&stackNodes[i].Flags, BIT_WAKING);
+			if (index == -1)
+				index = i;
+		}
+	}
+
+	while (index == -1)
+	{
+		uint64_t waitTime = -1;
+		if (deadline != -1)
+		{
+			uint64_t now = GetTickMicrosec();
+			if (now >= deadline)
+				break;
+			waitTime = deadline - now;
+		}
+
+		size_t woken = WaitEvent::WaitAny(events, count, waitTime);
+		if (woken == -1)
+			break;
+
+		if (stackNodes[woken].Flags & FLAG_WAKING)
+		{
+			index = woken;
+			isParked[woken] = false;
+		}
+	}
+
+	// 撤销其余节点
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (i == index)
+			continue;
+
+		CVStackNode &stackNode = stackNodes[i];
+		if (isParked[i])
+		{
+			if (!(stackNode.Flags & FLAG_WAKING) &&
+				WakeSingle(ppCondStatus[i], &stackNode))
+				continue;
+
+			// 已被通知者取走, 需等待其唤醒完成, 之后节点才能随栈帧释放
+			WaitCondNode(stackNode);
+		}
+
+		if (index == -1)
+			index = i;
+		else
+			isRenotify[i] = true;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (isRenotify[i])
+			SRWCondVar_NotifyOne(ppCondStatus[i]);
+	}
+
+	RelockCondVar(pLockStatus, nullptr, isShared);
+
+	return index;
+}
+#endif
+
+PLATFORM_NOINLINE bool SRWCondVar_Wait(size_t *pCondStatus, size_t *pLockStatus, uint64_t timeOut, bool isShared)
+{
+	return CondVarWaitImpl(pCondStatus, pLockStatus, nullptr, timeOut, isShared);
+}
+
+PLATFORM_NOINLINE bool SRWCondVar_WaitAdaptive(size_t *pCondStatus, size_t *pLockStatus, uint32_t *pSpinEstimate, uint64_t timeOut, bool isShared)
+{
+	return CondVarWaitImpl(pCondStatus, pLockStatus, pSpinEstimate, timeOut, isShared);
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+PLATFORM_NOINLINE bool SRWCondVar_WaitCancellable(size_t *pCondStatus, size_t *pLockStatus, const std::stop_token &token, bool isShared)
+{
+	return CondVarWaitCancellableImpl(pCondStatus, pLockStatus, token, isShared);
+}
+#endif
+
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+PLATFORM_NOINLINE size_t SRWCondVar_WaitAny(size_t *const *ppCondStatus, size_t count, size_t *pLockStatus, uint64_t timeOut, bool isShared)
+{
+	return CondVarWaitAnyImpl(ppCondStatus, count, pLockStatus, timeOut, isShared);
+}
+#endif
 
 PLATFORM_NOINLINE void SRWCondVar_NotifyOne(size_t *pCondStatus)
 {
@@ -354,7 +592,11 @@ PLATFORM_NOINLINE void SRWCondVar_NotifyAll(size_t *pCondStatus)
 					Atomic::FetchBitSet(&pWaitNode->Flags, BIT_WAKING);
 
 					if (!Atomic::FetchBitClear(&pWaitNode->Flags, BIT_SPINNING))
+					{
+						SRWLOCK_STAT_ADD(pCondStatus, STAT_WAKE_UP, 1);
+						SRWLOCK_PROBE2(wake, pCondStatus, pWaitNode);
 						pWaitNode->WakeUp();
+					}
 
 					pWaitNode = pBack;
 				}
@@ -377,12 +619,86 @@ void SRWCondVar::notify_all()
 	SRWCondVar_NotifyAll(&CondStatus_);
 }
 
+// 等待期间锁已释放, 看门狗不应视为持有
+struct WatchReleaseScope
+{
+	size_t *LockStatus;
+	bool IsShared;
+
+	WatchReleaseScope(size_t *pLockStatus, bool isShared)
+		: LockStatus(pLockStatus)
+		, IsShared(isShared)
+	{
+		SRWLOCK_WATCH_RELEASE(LockStatus);
+	}
+
+	~WatchReleaseScope()
+	{
+		SRWLOCK_WATCH_ACQUIRE(LockStatus, IsShared);
+	}
+};
+
 bool SRWCondVar::wait_for(LockGuard<SRWLock> &lock, uint64_t timeOut)
 {
+	WatchReleaseScope watchScope(lock.mutex()->native_handle(), false);
 	return SRWCondVar_Wait(&CondStatus_, lock.mutex()->native_handle(), timeOut, false);
 }
 
 bool SRWCondVar::wait_for(SharedLockGuard<SRWLock> &lock, uint64_t timeOut)
 {
+	WatchReleaseScope watchScope(lock.mutex()->native_handle(), true);
 	return SRWCondVar_Wait(&CondStatus_, lock.mutex()->native_handle(), timeOut, true);
 }
+
+bool SRWCondVar::wait_for(LockGuard<SRWAdaptiveLock> &lock, uint64_t timeOut)
+{
+	SRWAdaptiveLock *pLock = lock.mutex();
+	WatchReleaseScope watchScope(pLock->native_handle(), false);
+	return SRWCondVar_WaitAdaptive(&CondStatus_, pLock->native_handle(), pLock->spin_handle(), timeOut, false);
+}
+
+bool SRWCondVar::wait_for(SharedLockGuard<SRWAdaptiveLock> &lock, uint64_t timeOut)
+{
+	SRWAdaptiveLock *pLock = lock.mutex();
+	WatchReleaseScope watchScope(pLock->native_handle(), true);
+	return SRWCondVar_WaitAdaptive(&CondStatus_, pLock->native_handle(), pLock->spin_handle(), timeOut, true);
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+bool SRWCondVar::wait(LockGuard<SRWLock> &lock, const std::stop_token &token)
+{
+	WatchReleaseScope watchScope(lock.mutex()->native_handle(), false);
+	return SRWCondVar_WaitCancellable(&CondStatus_, lock.mutex()->native_handle(), token, false);
+}
+
+bool SRWCondVar::wait(SharedLockGuard<SRWLock> &lock, const std::stop_token &token)
+{
+	WatchReleaseScope watchScope(lock.mutex()->native_handle(), true);
+	return SRWCondVar_WaitCancellable(&CondStatus_, lock.mutex()->native_handle(), token, true);
+}
+#endif
+
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+template <class TGuard>
+static size_t CondVarWaitAny(SRWCondVar *const *ppConds, size_t count, TGuard &lock, uint64_t timeOut, bool isShared)
+{
+	AssertDebug(count <= SRWLOCK_WAIT_ANY_MAX);
+
+	size_t *condHandles[SRWLOCK_WAIT_ANY_MAX];
+	for (size_t i = 0; i < count; ++i)
+		condHandles[i] = ppConds[i]->native_handle();
+
+	WatchReleaseScope watchScope(lock.mutex()->native_handle(), isShared);
+	return SRWCondVar_WaitAny(condHandles, count, lock.mutex()->native_handle(), timeOut, isShared);
+}
+
+size_t SRWCondVar::wait_any_for(SRWCondVar *const *ppConds, size_t count, LockGuard<SRWLock> &lock, uint64_t timeOut)
+{
+	return CondVarWaitAny(ppConds, count, lock, timeOut, false);
+}
+
+size_t SRWCondVar::wait_any_for(SRWCondVar *const *ppConds, size_t count, SharedLockGuard<SRWLock> &lock, uint64_t timeOut)
+{
+	return CondVarWaitAny(ppConds, count, lock, timeOut, true);
+}
+#endif
@@ -5,6 +5,16 @@
 
 //////////////////////////////////////////////////////////////////////////
 bool SRWCondVar_Wait(size_t *pCondStatus, size_t *pLockStatus, uint64_t timeOut, bool isShared);
+// 使用锁的自旋估计值决定自旋次数
+bool SRWCondVar_WaitAdaptive(size_t *pCondStatus, size_t *pLockStatus, uint32_t *pSpinEstimate, uint64_t timeOut, bool isShared);
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+// 等待直到被通知或取消, 返回是否已取消. 返回时总是持有锁
+bool SRWCondVar_WaitCancellable(size_t *pCondStatus, size_t *pLockStatus, const std::stop_token &token, bool isShared);
+#endif
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+// 同时等待多个条件变量, 返回被通知的序号, 超时返回 -1. 所有条件变量由同一个锁保护
+size_t SRWCondVar_WaitAny(size_t *const *ppCondStatus, size_t count, size_t *pLockStatus, uint64_t timeOut, bool isShared);
+#endif
 void SRWCondVar_NotifyOne(size_t *pCondStatus);
 void SRWCondVar_NotifyAll(size_t *pCondStatus);
 
@@ -13,6 +23,12 @@ class SRWCondVar
 {
 public:
 	SRWCondVar() = default;
+#if defined(SRWLOCK_ENABLE_STATS)
+	~SRWCondVar()
+	{
+		SRWStats_Remove(&CondStatus_);
+	}
+#endif
 	SRWCondVar(const SRWCondVar &) = delete;
 	SRWCondVar(SRWCondVar &&) = delete;
 
@@ -23,6 +39,8 @@ public:
 	// 等待唤醒. 微秒超时
 	bool wait_for(LockGuard<SRWLock> &lock, uint64_t timeOut);
 	bool wait_for(SharedLockGuard<SRWLock> &lock, uint64_t timeOut);
+	bool wait_for(LockGuard<SRWAdaptiveLock> &lock, uint64_t timeOut);
+	bool wait_for(SharedLockGuard<SRWAdaptiveLock> &lock, uint64_t timeOut);
 
 	void wait(LockGuard<SRWLock> &lock)
 	{
@@ -34,6 +52,61 @@ public:
 		wait_for(lock, -1);
 	}
 
+	void wait(LockGuard<SRWAdaptiveLock> &lock)
+	{
+		wait_for(lock, -1);
+	}
+
+	void wait(SharedLockGuard<SRWAdaptiveLock> &lock)
+	{
+		wait_for(lock, -1);
+	}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+	// 等待唤醒或取消, 返回是否已取消
+	bool wait(LockGuard<SRWLock> &lock, const std::stop_token &token);
+	bool wait(SharedLockGuard<SRWLock> &lock, const std::stop_token &token);
+
+	// 返回谓词的最终结果, 与 std::condition_variable_any 一致
+	template <class Pred>
+	bool wait(LockGuard<SRWLock> &lock, const std::stop_token &token, Pred pred)
+	{
+		while (!pred())
+		{
+			if (wait(lock, token))
+				return pred();
+		}
+		return true;
+	}
+
+	template <class Pred>
+	bool wait(SharedLockGuard<SRWLock> &lock, const std::stop_token &token, Pred pred)
+	{
+		while (!pred())
+		{
+			if (wait(lock, token))
+				return pred();
+		}
+		return true;
+	}
+#endif
+
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+	// 同时等待多个条件变量, 返回被通知的序号, 超时返回 -1. 微秒超时
+	static size_t wait_any_for(SRWCondVar *const *ppConds, size_t count, LockGuard<SRWLock> &lock, uint64_t timeOut);
+	static size_t wait_any_for(SRWCondVar *const *ppConds, size_t count, SharedLockGuard<SRWLock> &lock, uint64_t timeOut);
+
+	static size_t wait_any(SRWCondVar *const *ppConds, size_t count, LockGuard<SRWLock> &lock)
+	{
+		return wait_any_for(ppConds, count, lock, -1);
+	}
+
+	static size_t wait_any(SRWCondVar *const *ppConds, size_t count, SharedLockGuard<SRWLock> &lock)
+	{
+		return wait_any_for(ppConds, count, lock, -1);
+	}
+#endif
+
 	template <class Pred>
 	void wait(LockGuard<SRWLock> &lock, Pred pred)
 	{
@@ -48,6 +121,39 @@ public:
 			wait_for(lock, -1);
 	}
 
+	template <class Pred>
+	void wait(LockGuard<SRWAdaptiveLock> &lock, Pred pred)
+	{
+		while (!pred())
+			wait_for(lock, -1);
+	}
+
+	template <class Pred>
+	void wait(SharedLockGuard<SRWAdaptiveLock> &lock, Pred pred)
+	{
+		while (!pred())
+			wait_for(lock, -1);
+	}
+
+	size_t* native_handle()
+	{
+		return &CondStatus_;
+	}
+
+#if defined(SRWLOCK_ENABLE_STATS)
+	SRWLockStats stats() const
+	{
+		SRWLockStats result;
+		SRWStats_Get(&CondStatus_, &result);
+		return result;
+	}
+
+	void reset_stats()
+	{
+		SRWStats_Reset(&CondStatus_);
+	}
+#endif
+
 private:
 	size_t CondStatus_ = 0;
 };
@@ -0,0 +1,67 @@
+﻿#include "SRWHoldTime.hpp"
+#include <cmath>
+
+//////////////////////////////////////////////////////////////////////////
+uint64_t SRWHistogram::count() const
+{
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+		total += Atomic::LoadRelaxed(&Counts_[i]);
+	return total;
+}
+
+// 与记录并发时结果为近似值
+uint64_t SRWHistogram::percentile(double percent) const
+{
+	uint64_t counts[BUCKET_COUNT];
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		counts[i] = Atomic::LoadRelaxed(&Counts_[i]);
+		total += counts[i];
+	}
+
+	if (total == 0)
+		return 0;
+
+	percent = (std::min)((std::max)(percent, 0.0), 100.0);
+	uint64_t target = static_cast<uint64_t>(std::ceil(percent / 100 * static_cast<double>(total)));
+	if (target == 0)
+		target = 1;
+
+	uint64_t accum = 0;
+	for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		accum += counts[i];
+		if (accum >= target)
+			return BucketUpperBound(i);
+	}
+	return BucketUpperBound(BUCKET_COUNT - 1);
+}
+
+uint64_t SRWHistogram::max() const
+{
+	for (uint32_t i = BUCKET_COUNT; i > 0; --i)
+	{
+		if (Atomic::LoadRelaxed(&Counts_[i - 1]))
+			return BucketUpperBound(i - 1);
+	}
+	return 0;
+}
+
+void SRWHistogram::reset()
+{
+	for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+		Atomic::StoreRelaxed<uint64_t>(&Counts_[i], 0);
+}
+
+uint64_t SRWHistogram::BucketUpperBound(uint32_t idx)
+{
+	if (idx < SUB_BUCKET_COUNT)
+		return idx;
+
+	uint32_t shift = idx / SUB_BUCKET_COUNT - 1;
+	uint64_t subBucket = idx % SUB_BUCKET_COUNT;
+	uint64_t lowerBound = (SUB_BUCKET_COUNT + subBucket) << shift;
+	return lowerBound + ((uint64_t(1) << shift) - 1);
+}
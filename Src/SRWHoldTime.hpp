@@ -0,0 +1,203 @@
+﻿#pragma once
+
+#include "LockUtils.hpp"
+#include "Atomic.hpp"
+#include "Utility.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 对数线性直方图. 每个 2 的幂区间等分为 16 个子桶, 相对误差不超过 1/16.
+// 记录只有一次原子加, 可由多个线程并发记录
+class SRWHistogram
+{
+public:
+	static const uint32_t SUB_BUCKET_BITS = 4;
+	static const uint32_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	static const uint32_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+	SRWHistogram() = default;
+	SRWHistogram(const SRWHistogram &) = delete;
+	SRWHistogram(SRWHistogram &&) = delete;
+
+	void record(uint64_t value)
+	{
+		Atomic::FetchAdd<uint64_t>(&Counts_[BucketIndex(value)], 1);
+	}
+
+	uint64_t count() const;
+	// 百分位数 (0 - 100), 返回所在子桶的上界. 没有记录时返回 0
+	uint64_t percentile(double percent) const;
+	uint64_t max() const;
+	void reset();
+
+	// 小于 16 的值各占一个桶, 其余按最高位分区间, 再取其后 4 位作为子桶
+	static uint32_t BucketIndex(uint64_t value)
+	{
+		if (value < SUB_BUCKET_COUNT)
+			return static_cast<uint32_t>(value);
+
+		uint32_t highBit = HighestBit(value);
+		uint32_t shift = highBit - SUB_BUCKET_BITS;
+		return (shift + 1) * SUB_BUCKET_COUNT + static_cast<uint32_t>((value >> shift) & (SUB_BUCKET_COUNT - 1));
+	}
+
+	static uint64_t BucketUpperBound(uint32_t idx);
+
+private:
+	static uint32_t HighestBit(uint64_t value)
+	{
+#if defined(PLATFORM_MSVC_LIKE) && defined(PLATFORM_IS_64BIT)
+		unsigned long idx;
+		_BitScanReverse64(&idx, value);
+		return idx;
+#elif defined(PLATFORM_MSVC_LIKE)
+		unsigned long idx;
+		if (_BitScanReverse(&idx, static_cast<uint32_t>(value >> 32)))
+			return idx + 32;
+		_BitScanReverse(&idx, static_cast<uint32_t>(value));
+		return idx;
+#else
+		return 63 - __builtin_clzll(value);
+#endif
+	}
+
+private:
+	uint64_t Counts_[BUCKET_COUNT] = {};
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 单个锁的持有时长, 独占与共享分开记录. 以 GetTickCycles 为单位记录, 查询时换算为纳秒
+class SRWHoldTime
+{
+public:
+	SRWHoldTime() = default;
+	SRWHoldTime(const SRWHoldTime &) = delete;
+	SRWHoldTime(SRWHoldTime &&) = delete;
+
+	void record(uint64_t cycles, bool isShared)
+	{
+		(isShared ? Shared_ : Exclusive_).record(cycles);
+	}
+
+	uint64_t count(bool isShared) const
+	{
+		return histogram(isShared).count();
+	}
+
+	uint64_t percentile_nanosec(double percent, bool isShared) const
+	{
+		return ToNanosec(histogram(isShared).percentile(percent));
+	}
+
+	uint64_t max_nanosec(bool isShared) const
+	{
+		return ToNanosec(histogram(isShared).max());
+	}
+
+	void reset()
+	{
+		Exclusive_.reset();
+		Shared_.reset();
+	}
+
+	const SRWHistogram& histogram(bool isShared) const
+	{
+		return isShared ? Shared_ : Exclusive_;
+	}
+
+private:
+	static uint64_t ToNanosec(uint64_t cycles)
+	{
+		return static_cast<uint64_t>(static_cast<double>(cycles) * GetNanosecPerCycle());
+	}
+
+private:
+	SRWHistogram Exclusive_;
+	SRWHistogram Shared_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 记录持有时长的锁守卫. 解锁之后再记录, 不延长临界区
+template <class T>
+class ProfiledLockGuard
+{
+public:
+	ProfiledLockGuard(T &lk, SRWHoldTime &holdTime)
+		: Lock_(lk)
+		, HoldTime_(holdTime)
+	{
+		Lock_.lock();
+		StartTime_ = GetTickCycles();
+	}
+
+	~ProfiledLockGuard()
+	{
+		unlock();
+	}
+
+	// 解锁
+	void unlock()
+	{
+		if (IsUnlocked_)
+			return;
+
+		IsUnlocked_ = true;
+
+		uint64_t endTime = GetTickCycles();
+		Lock_.unlock();
+		HoldTime_.record(endTime - StartTime_, false);
+	}
+
+	T* mutex() const
+	{
+		return &Lock_;
+	}
+
+private:
+	T &Lock_;
+	SRWHoldTime &HoldTime_;
+	uint64_t StartTime_;
+	bool IsUnlocked_ = false;
+};
+
+//////////////////////////////////////////////////////////////////////////
+template <class T>
+class ProfiledSharedLockGuard
+{
+public:
+	ProfiledSharedLockGuard(T &lk, SRWHoldTime &holdTime)
+		: Lock_(lk)
+		, HoldTime_(holdTime)
+	{
+		Lock_.lock_shared();
+		StartTime_ = GetTickCycles();
+	}
+
+	~ProfiledSharedLockGuard()
+	{
+		unlock();
+	}
+
+	// 解锁
+	void unlock()
+	{
+		if (IsUnlocked_)
+			return;
+
+		IsUnlocked_ = true;
+
+		uint64_t endTime = GetTickCycles();
+		Lock_.unlock_shared();
+		HoldTime_.record(endTime - StartTime_, true);
+	}
+
+	T* mutex() const
+	{
+		return &Lock_;
+	}
+
+private:
+	T &Lock_;
+	SRWHoldTime &HoldTime_;
+	uint64_t StartTime_;
+	bool IsUnlocked_ = false;
+};
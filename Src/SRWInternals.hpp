@@ -1,5 +1,9 @@
 ﻿#pragma once
 
+#include "SRWLock.hpp"
+#include "SRWLockStats.hpp"
+#include "SRWTrace.hpp"
+#include "SRWWatchdog.hpp"
 #include "Atomic.hpp"
 #include "WaitEvent.hpp"
 #include "Utility.hpp"
@@ -17,8 +21,10 @@ enum SRWBits
 	BIT_WAKING = 2,
 	// 多重共享者
 	BIT_MULTI_SHARED = 3,
+	// 可升级持有者. 同时计入共享计数, 最多只有一个
+	BIT_UPGRADE = 4,
 	// 共享计数位
-	BIT_SHARED = 4,
+	BIT_SHARED = 5,
 };
 
 // 状态位标记
@@ -28,12 +34,21 @@ enum SRWFlags
 	FLAG_SPINNING = 1 << BIT_SPINNING,
 	FLAG_WAKING = 1 << BIT_WAKING,
 	FLAG_MULTI_SHARED = 1 << BIT_MULTI_SHARED,
+	FLAG_UPGRADE = 1 << BIT_UPGRADE,
 	FLAG_SHARED = 1 << BIT_SHARED,
-	FLAG_ALL = FLAG_MULTI_SHARED | FLAG_WAKING | FLAG_SPINNING | FLAG_LOCKED
+	FLAG_ALL = FLAG_UPGRADE | FLAG_MULTI_SHARED | FLAG_WAKING | FLAG_SPINNING | FLAG_LOCKED
 };
 
-// 栈节点. 锁争用时, 等待者使用链表串联各个线程栈上的节点
-struct SRWStackNode : WaitEvent
+// 栈节点专用标记
+enum SRWNodeFlags
+{
+	// 解锁者已将锁的所有权直接移交给该节点
+	FLAG_HANDOFF = 1 << 3,
+};
+
+// 栈节点. 锁争用时, 等待者使用链表串联各个线程栈上的节点.
+// 节点地址的低位用于存放状态标记, 需要按 32 字节对齐. 类型本身对齐, 节点数组中的每个元素同样满足
+struct alignas(32) SRWStackNode : WaitEvent
 {
 	// 上一节点
 	SRWStackNode *Back;
@@ -41,10 +56,35 @@ struct SRWStackNode : WaitEvent
 	SRWStackNode *Notify;
 	// 下一节点
 	SRWStackNode *Next;
+	// 等待升级的节点, 仅在多重共享状态的通知节点上有效
+	SRWStackNode *Upgrader;
 	// 共享计数
 	uint32_t SharedCount;
-	// 线程标记, 值为 FLAG_LOCKED, FLAG_SPINNING 或 FLAG_WAKING
+	// 线程标记, 值为 FLAG_LOCKED, FLAG_SPINNING, FLAG_WAKING 或 FLAG_HANDOFF
 	uint32_t Flags;
+	// 可取消等待的状态
+	uint32_t CancelState;
+};
+
+// 可取消等待的状态. 取消者只在等待者睡眠期间唤醒, 且与唤醒者至多一方发出唤醒
+enum SRWCancelStates
+{
+	CANCEL_NONE,
+	// 等待者即将或正在睡眠
+	CANCEL_SLEEPING,
+	// 已请求取消
+	CANCEL_REQUESTED,
+};
+
+// 可取消睡眠的结果
+enum SRWSleepResult
+{
+	// 正常醒来
+	SLEEP_AWAKE,
+	// 睡眠期间被取消, 此后的状态与睡眠超时相同
+	SLEEP_CANCELLED,
+	// 睡眠前已被取消, 没有消费任何唤醒
+	SLEEP_SKIPPED,
 };
 
 // 锁状态
@@ -58,7 +98,8 @@ struct SRWStatus
 			size_t Spinning : 1;
 			size_t Waking : 1;
 			size_t MultiShared : 1;
-			size_t SharedCount : sizeof(size_t) * 8 - 4;
+			size_t Upgrade : 1;
+			size_t SharedCount : sizeof(size_t) * 8 - 5;
 		};
 		size_t Value;
 	};
@@ -125,6 +166,70 @@ struct SRWStatus
 //////////////////////////////////////////////////////////////////////////
 void Backoff(uint32_t *pCount);
 void Spinning(SRWStackNode &stackNode);
+// 按指定次数自旋, 返回实际自旋次数
+uint32_t Spinning(SRWStackNode &stackNode, uint32_t spinCount);
+// 根据锁的自旋估计值计算自旋次数
+uint32_t AdaptiveSpinCount(const uint32_t *pSpinEstimate);
+
+//////////////////////////////////////////////////////////////////////////
+// 请求取消等待, 等待者睡眠中时将其唤醒.
+// 等待事件不累计唤醒次数, 因此只在唤醒者尚未介入时唤醒, 并代为设置自旋标记使之后的唤醒者不再唤醒
+static inline void CancelStackNode(SRWStackNode *pStackNode)
+{
+	if (Atomic::Exchange<uint32_t>(&pStackNode->CancelState, CANCEL_REQUESTED) != CANCEL_SLEEPING)
+		return;
+
+	uint32_t lastFlags = pStackNode->Flags;
+	while (!(lastFlags & (FLAG_WAKING | FLAG_SPINNING)))
+	{
+		uint32_t currFlags = Atomic::CompareExchange<uint32_t>(&pStackNode->Flags, lastFlags, lastFlags | FLAG_SPINNING);
+		if (currFlags == lastFlags)
+		{
+			pStackNode->WakeUp();
+			return;
+		}
+		lastFlags = currFlags;
+	}
+}
+
+static inline bool IsCancelRequested(const SRWStackNode &stackNode)
+{
+	return static_cast<volatile const uint32_t&>(stackNode.CancelState) == CANCEL_REQUESTED;
+}
+
+// 可取消的无限睡眠. 调用前需已清除自旋标记
+static inline SRWSleepResult SleepCancellable(SRWStackNode &stackNode)
+{
+	if (Atomic::CompareExchange<uint32_t>(&stackNode.CancelState, CANCEL_NONE, CANCEL_SLEEPING) != CANCEL_NONE)
+		return SLEEP_SKIPPED;
+
+	stackNode.WaitMicrosec();
+
+	if (Atomic::CompareExchange<uint32_t>(&stackNode.CancelState, CANCEL_SLEEPING, CANCEL_NONE) == CANCEL_SLEEPING)
+		return SLEEP_AWAKE;
+
+	// 已请求取消. 自旋标记已被清除说明唤醒者已经介入, 与自旋期间被唤醒相同.
+	// 否则清除取消者设置的自旋标记, 此后的唤醒者会发出唤醒, 由调用者按超时处理
+	if (!Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		Atomic::FetchBitSet(&stackNode.Flags, BIT_WAKING);
+		return SLEEP_AWAKE;
+	}
+	return SLEEP_CANCELLED;
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+// 停止请求回调. 在请求停止的线程上执行, 析构时等待执行中的回调完成
+struct SRWStopCallback
+{
+	SRWStackNode *pStackNode;
+
+	void operator()() const
+	{
+		CancelStackNode(pStackNode);
+	}
+};
+#endif
 
 //////////////////////////////////////////////////////////////////////////
 // 查找通知节点
@@ -239,6 +344,8 @@ PLATFORM_NOINLINE static void WakeUpLock(size_t *pLockStatus, SRWStatus lastStat
 		if (!Atomic::FetchBitClear(&pNotify->Flags, BIT_SPINNING))
 		{
 			// 如果之前不在自旋则唤醒
+			SRWLOCK_STAT_ADD(pLockStatus, STAT_WAKE_UP, 1);
+			SRWLOCK_PROBE2(wake, pLockStatus, pNotify);
 			pNotify->WakeUp();
 		}
 
@@ -277,8 +384,8 @@ static bool QueueStackNode(size_t *pLockStatus, SRWStackNode *pStackNode, SRWSta
 		pStackNode->Notify = nullptr;
 		// 作为当前线程的上一个节点挂接
 		pStackNode->Back = lastStatus.WaitNode();
-		// 继承多重共享标记, 并设置唤醒, 自旋和锁定和标记
-		newStatus = reinterpret_cast<size_t>(pStackNode) | (lastStatus.Value & FLAG_MULTI_SHARED) | FLAG_WAKING | FLAG_SPINNING | FLAG_LOCKED;
+		// 继承多重共享和升级标记, 并设置唤醒, 自旋和锁定和标记
+		newStatus = reinterpret_cast<size_t>(pStackNode) | (lastStatus.Value & (FLAG_UPGRADE | FLAG_MULTI_SHARED)) | FLAG_WAKING | FLAG_SPINNING | FLAG_LOCKED;
 
 		// 不包含唤醒标记的情况需要尝试优化链表
 		if (!lastStatus.Waking)
@@ -288,7 +395,8 @@ static bool QueueStackNode(size_t *pLockStatus, SRWStackNode *pStackNode, SRWSta
 	{
 		// 把当前线程作为下一个通知节点
 		pStackNode->Notify = pStackNode;
-		newStatus = reinterpret_cast<size_t>(pStackNode) | FLAG_SPINNING | FLAG_LOCKED;
+		pStackNode->Upgrader = nullptr;
+		newStatus = reinterpret_cast<size_t>(pStackNode) | (lastStatus.Value & FLAG_UPGRADE) | FLAG_SPINNING | FLAG_LOCKED;
 
 		if (IsExclusive)
 		{
@@ -319,3 +427,123 @@ static bool QueueStackNode(size_t *pLockStatus, SRWStackNode *pStackNode, SRWSta
 	}
 	return false;
 }
+
+// 出队结果
+enum SRWDequeueResult
+{
+	// 已从等待链表移除
+	DEQUEUE_REMOVED,
+	// 节点已被唤醒者摘除, 唤醒即将到达
+	DEQUEUE_WAKING,
+};
+
+// 从等待链表中移除当前线程的节点. 通过唤醒标记独占链表后摘除节点.
+// 多重共享状态下读者会无锁遍历链表, 节点无法安全移除, 调用者需避免在此状态下入队
+static inline SRWDequeueResult DequeueStackNode(size_t *pLockStatus, SRWStackNode *pStackNode)
+{
+	uint32_t backoffCount = 0;
+	SRWStatus lastStatus = *pLockStatus;
+
+	// 获取唤醒标记
+	for (;;)
+	{
+		// 等待链表已被整体摘除. 节点所在链表不会进入多重共享状态, 出现时必为新链表
+		if (!lastStatus.Spinning || lastStatus.MultiShared)
+			return DEQUEUE_WAKING;
+
+		if (!lastStatus.Waking)
+		{
+			SRWStatus currStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, lastStatus.Value | FLAG_WAKING);
+			if (currStatus == lastStatus)
+			{
+				lastStatus.Waking = 1;
+				break;
+			}
+
+			lastStatus = currStatus;
+			continue;
+		}
+
+		// 其他线程正在唤醒或优化链表
+		if (static_cast<volatile const uint32_t&>(pStackNode->Flags) & FLAG_WAKING)
+			return DEQUEUE_WAKING;
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+
+	for (;;)
+	{
+		SRWStackNode *pTop = lastStatus.WaitNode();
+		SRWStackNode *pNotify = UpdateNotifyNode(pTop);
+
+		// 从栈顶查找节点, 并重建正向链接
+		SRWStackNode *pLast = nullptr;
+		SRWStackNode *pCurr = pTop;
+		while (pCurr != pStackNode)
+		{
+			if (pCurr == pNotify)
+			{
+				pCurr = nullptr;
+				break;
+			}
+
+			pLast = pCurr;
+			pCurr = pCurr->Back;
+			pCurr->Next = pLast;
+		}
+
+		if (!pCurr)
+		{
+			// 节点不在链表中, 释放唤醒标记
+			OptimizeLockList(pLockStatus, lastStatus);
+			return DEQUEUE_WAKING;
+		}
+
+		if (pLast)
+		{
+			if (pStackNode == pNotify)
+			{
+				// 下一节点成为通知节点
+				pLast->Notify = pLast;
+				pLast->SharedCount = pStackNode->SharedCount;
+				pTop->Notify = pLast;
+			}
+			else
+			{
+				// 中间节点直接摘除
+				pLast->Back = pStackNode->Back;
+				pStackNode->Back->Next = pLast;
+			}
+
+			OptimizeLockList(pLockStatus, *pLockStatus);
+			return DEQUEUE_REMOVED;
+		}
+
+		// 栈顶节点需要更新锁状态
+		SRWStatus newStatus;
+		if (pStackNode == pNotify)
+		{
+			// 唯一的节点, 清空等待链表. 共享计数无法恢复, 保留锁定位和升级位即可
+			newStatus = lastStatus.Value & (FLAG_UPGRADE | FLAG_LOCKED);
+		}
+		else
+		{
+			SRWStackNode *pBack = pStackNode->Back;
+			pBack->Notify = pNotify;
+			pBack->Next = nullptr;
+			newStatus = reinterpret_cast<size_t>(pBack) | (lastStatus.Value & FLAG_ALL);
+		}
+
+		SRWStatus currStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, newStatus.Value);
+		if (currStatus == lastStatus)
+		{
+			if (newStatus.Waking)
+				OptimizeLockList(pLockStatus, newStatus);
+			return DEQUEUE_REMOVED;
+		}
+
+		// 有新节点入栈, 重新查找
+		lastStatus = currStatus;
+	}
+}
@@ -2,34 +2,72 @@
 #include "SRWInternals.hpp"
 #include <thread>
 
-#if defined(PLATFORM_ARCH_X86) && defined(PLATFORM_GNUC_LIKE)
-#  include <cpuid.h>
-#endif
-
 //////////////////////////////////////////////////////////////////////////
 static uint32_t g_CyclesPerYield = 10;
 static uint32_t g_ProcessorThreads = 1;
 
-void SRWLock_Init()
+#if defined(SRWLOCK_HAS_USDT)
+extern "C"
 {
-	g_ProcessorThreads = std::thread::hardware_concurrency();
+	SRWLOCK_PROBE_SEMAPHORE(enqueue);
+	SRWLOCK_PROBE_SEMAPHORE(spin_exit);
+	SRWLOCK_PROBE_SEMAPHORE(park);
+	SRWLOCK_PROBE_SEMAPHORE(wake);
+	SRWLOCK_PROBE_SEMAPHORE(acquire);
+}
+#endif
+
+// 测量退让指令的周期数. 不同微架构的 pause 耗时相差十倍以上, 无法根据型号推断.
+// x86 使用时间戳计数器, 其他平台以纳秒计时并按 3GHz 换算
+static uint32_t CalibrateCyclesPerYield()
+{
+	const uint32_t yieldCount = 256;
+	const uint32_t roundCount = 8;
+	uint64_t minCost = -1;
 
+	// 取多轮中的最小值, 排除中断和调度的干扰
+	for (uint32_t round = 0; round < roundCount; ++round)
+	{
 #if defined(PLATFORM_ARCH_X86)
-#  if defined(PLATFORM_GNUC_LIKE)
-	uint32_t cpuInfo[4];
-	__get_cpuid(0, &cpuInfo[0], &cpuInfo[1], &cpuInfo[2], &cpuInfo[3]);
-#  else
-	int cpuInfo[4];
-	__cpuid(cpuInfo, 0);
-#  endif
-	if (cpuInfo[0] == 0x16)
-	{
-		// Skylake 修改了 pause 指令的耗时
-		g_CyclesPerYield = 140;
-		return;
-	}
+		uint64_t stt = GetTickCycles();
+#else
+		uint64_t stt = GetTickNanosec();
+#endif
+
+#pragma nounroll
+		for (uint32_t i = 0; i < yieldCount; ++i)
+			PLATFORM_YIELD;
+
+#if defined(PLATFORM_ARCH_X86)
+		uint64_t cost = GetTickCycles() - stt;
+#else
+		uint64_t cost = (GetTickNanosec() - stt) * 3;
 #endif
-	g_CyclesPerYield = 10;
+		minCost = (std::min)(minCost, cost);
+	}
+
+	uint64_t cycles = minCost / yieldCount;
+	if (cycles < 1)
+		return 1;
+	if (cycles > 1000)
+		return 1000;
+	return static_cast<uint32_t>(cycles);
+}
+
+void SRWLock_Init()
+{
+	g_ProcessorThreads = std::thread::hardware_concurrency();
+	g_CyclesPerYield = CalibrateCyclesPerYield();
+}
+
+uint32_t SRWLock_GetCyclesPerYield()
+{
+	return g_CyclesPerYield;
+}
+
+void SRWLock_SetCyclesPerYield(uint32_t cycles)
+{
+	g_CyclesPerYield = cycles ? cycles : CalibrateCyclesPerYield();
 }
 
 static struct Init
@@ -44,11 +82,7 @@ static struct Init
 static uint32_t RandomValue()
 {
 #if defined(PLATFORM_ARCH_X86)
-#  if defined(PLATFORM_MSVC_LIKE)
-	return static_cast<uint32_t>(__rdtsc());
-#  else
-	return static_cast<uint32_t>(__builtin_ia32_rdtsc());
-#  endif
+	return static_cast<uint32_t>(GetTickCycles());
 #else
 	return rand();
 #endif
@@ -82,18 +116,56 @@ PLATFORM_NOINLINE void Backoff(uint32_t *pCount)
 }
 
 void Spinning(SRWStackNode &stackNode)
+{
+	Spinning(stackNode, 10500 / g_CyclesPerYield);
+}
+
+uint32_t Spinning(SRWStackNode &stackNode, uint32_t spinCount)
 {
 	// 单核心直接返回
 	if (g_ProcessorThreads == 1)
-		return;
+		return 0;
 
+	uint32_t count = 0;
 #pragma nounroll
-	for (uint32_t spinCount = 10500 / g_CyclesPerYield; spinCount; --spinCount)
+	for (; count < spinCount; ++count)
 	{
 		if (!(static_cast<volatile const uint32_t&>(stackNode.Flags) & FLAG_SPINNING))
 			break;
 		PLATFORM_YIELD;
 	}
+	return count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 自适应自旋次数的上限倍数, 以及估计值的平滑位移
+static const uint32_t ADAPTIVE_SPIN_MAX_SCALE = 4;
+static const uint32_t ADAPTIVE_SPIN_MIN = 16;
+static const uint32_t ADAPTIVE_EWMA_SHIFT = 3;
+
+uint32_t AdaptiveSpinCount(const uint32_t *pSpinEstimate)
+{
+	uint32_t defaultCount = 10500 / g_CyclesPerYield;
+	uint32_t estimate = *static_cast<volatile const uint32_t*>(pSpinEstimate);
+
+	// 尚未采样时使用默认次数
+	if (estimate == -1)
+		return defaultCount;
+
+	// 保留最小自旋次数, 持有时间变短时才能重新采样
+	return (std::min)(estimate * 2 + ADAPTIVE_SPIN_MIN, defaultCount * ADAPTIVE_SPIN_MAX_SCALE);
+}
+
+// 更新自旋估计值. 多线程并发更新时允许丢失采样
+static void UpdateSpinEstimate(uint32_t *pSpinEstimate, uint32_t sample)
+{
+	volatile uint32_t &estimate = *static_cast<volatile uint32_t*>(pSpinEstimate);
+
+	uint32_t lastEstimate = estimate;
+	if (lastEstimate == -1)
+		estimate = sample;
+	else
+		estimate = static_cast<uint32_t>(lastEstimate + ((static_cast<int32_t>(sample - lastEstimate)) >> ADAPTIVE_EWMA_SHIFT));
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -109,23 +181,243 @@ PLATFORM_NOINLINE static bool TryWaiting(size_t *pLockStatus, SRWStackNode &stac
 	// 尝试更新锁状态
 	if (QueueStackNode<IsExclusive>(pLockStatus, &stackNode, lastStatus))
 	{
+		SRWLOCK_PROBE3(enqueue, pLockStatus, IsExclusive, SRWLOCK_PROBE_NOW(enqueue));
+
 		// 自旋一定次数再睡眠
 		Spinning(stackNode);
 
 		// 成功清除自旋状态时进入睡眠状态
 		if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
 		{
+			SRWLOCK_STAT_ADD(pLockStatus, STAT_PARK, 1);
+			SRWLOCK_PROBE3(spin_exit, pLockStatus, false, SRWLOCK_PROBE_NOW(spin_exit));
+			SRWLOCK_PROBE2(park, pLockStatus, SRWLOCK_PROBE_NOW(park));
 			do
 			{
 				stackNode.WaitMicrosec();
 			} while (!(stackNode.Flags & FLAG_WAKING));
 		}
+		else
+		{
+			SRWLOCK_STAT_ADD(pLockStatus, STAT_SPIN_WIN, 1);
+			SRWLOCK_PROBE3(spin_exit, pLockStatus, true, SRWLOCK_PROBE_NOW(spin_exit));
+		}
 
 		return true;
 	}
 	return false;
 }
 
+// 自适应等待. 自旋期间被唤醒时以实际自旋次数为采样,
+// 睡眠后被唤醒时将等待时长换算为自旋次数, 超出上限时说明自旋无益, 采样为 0
+template <bool IsExclusive>
+PLATFORM_NOINLINE static bool TryWaitingAdaptive(size_t *pLockStatus, SRWStackNode &stackNode, SRWStatus lastStatus, uint32_t *pSpinEstimate)
+{
+	if (IsExclusive)
+		stackNode.Flags = FLAG_SPINNING | FLAG_LOCKED;
+	else
+		stackNode.Flags = FLAG_SPINNING;
+
+	uint32_t spinLimit = AdaptiveSpinCount(pSpinEstimate);
+	uint64_t startTime = GetTickNanosec();
+
+	if (!QueueStackNode<IsExclusive>(pLockStatus, &stackNode, lastStatus))
+		return false;
+
+	SRWLOCK_PROBE3(enqueue, pLockStatus, IsExclusive, SRWLOCK_PROBE_NOW(enqueue));
+
+	uint32_t spinCount = Spinning(stackNode, spinLimit);
+
+	if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_PARK, 1);
+		SRWLOCK_PROBE3(spin_exit, pLockStatus, false, SRWLOCK_PROBE_NOW(spin_exit));
+		SRWLOCK_PROBE2(park, pLockStatus, SRWLOCK_PROBE_NOW(park));
+		uint64_t spinTime = GetTickNanosec() - startTime;
+
+		do
+		{
+			stackNode.WaitMicrosec();
+		} while (!(stackNode.Flags & FLAG_WAKING));
+
+		// 单核心不自旋, 无法换算
+		if (spinCount && spinTime)
+		{
+			uint64_t waitCount = (GetTickNanosec() - startTime) * spinCount / spinTime;
+			uint32_t maxCount = 10500 / g_CyclesPerYield * ADAPTIVE_SPIN_MAX_SCALE;
+			UpdateSpinEstimate(pSpinEstimate, waitCount > maxCount ? 0 : static_cast<uint32_t>(waitCount));
+		}
+	}
+	else
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_SPIN_WIN, 1);
+		SRWLOCK_PROBE3(spin_exit, pLockStatus, true, SRWLOCK_PROBE_NOW(spin_exit));
+		if (spinCount)
+			UpdateSpinEstimate(pSpinEstimate, spinCount);
+	}
+
+	return true;
+}
+
+// 限时等待结果
+enum SRWWaitResult
+{
+	// 入队失败
+	WAIT_FAILED,
+	// 已被唤醒
+	WAIT_WOKEN,
+	// 超时并已出队
+	WAIT_TIMEOUT,
+	// 已取消并已出队
+	WAIT_CANCELLED,
+};
+
+// 无法入队时的轮询间隔
+static const uint64_t POLL_MIN_MICROSEC = 50;
+static const uint64_t POLL_MAX_MICROSEC = 1000;
+
+// 多重共享状态下读者会无锁遍历等待链表, 限时等待者无法安全出队
+static bool IsDequeueUnsafe(SRWStatus lastStatus)
+{
+	if (lastStatus.Spinning)
+		return lastStatus.MultiShared;
+	return lastStatus.SharedCount > 1;
+}
+
+// 轮询等待一段时间, 返回是否已超时
+static bool PollUntil(SRWStackNode &stackNode, uint64_t deadline, uint64_t *pPollTime)
+{
+	uint64_t now = GetTickMicrosec();
+	if (now >= deadline)
+		return true;
+
+	uint64_t pollTime = *pPollTime;
+	*pPollTime = (std::min)(pollTime * 2, POLL_MAX_MICROSEC);
+
+	// 节点未入队, 不会被唤醒
+	stackNode.WaitMicrosec((std::min)(deadline - now, pollTime));
+	return false;
+}
+
+template <bool IsExclusive>
+PLATFORM_NOINLINE static SRWWaitResult TryWaitingUntil(size_t *pLockStatus, SRWStackNode &stackNode, SRWStatus lastStatus, uint64_t deadline)
+{
+	if (IsExclusive)
+		stackNode.Flags = FLAG_SPINNING | FLAG_LOCKED;
+	else
+		stackNode.Flags = FLAG_SPINNING;
+
+	if (!QueueStackNode<IsExclusive>(pLockStatus, &stackNode, lastStatus))
+		return WAIT_FAILED;
+
+	SRWLOCK_PROBE3(enqueue, pLockStatus, IsExclusive, SRWLOCK_PROBE_NOW(enqueue));
+
+	Spinning(stackNode);
+
+	// 自旋期间已被唤醒
+	if (!Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_SPIN_WIN, 1);
+		SRWLOCK_PROBE3(spin_exit, pLockStatus, true, SRWLOCK_PROBE_NOW(spin_exit));
+		return WAIT_WOKEN;
+	}
+	SRWLOCK_STAT_ADD(pLockStatus, STAT_PARK, 1);
+	SRWLOCK_PROBE3(spin_exit, pLockStatus, false, SRWLOCK_PROBE_NOW(spin_exit));
+	SRWLOCK_PROBE2(park, pLockStatus, SRWLOCK_PROBE_NOW(park));
+
+	// 睡眠直到超时或被唤醒
+	for (;;)
+	{
+		uint64_t now = GetTickMicrosec();
+		if (now >= deadline)
+			break;
+
+		if (!stackNode.WaitMicrosec(deadline - now) && (stackNode.Flags & FLAG_WAKING))
+			return WAIT_WOKEN;
+	}
+
+	// 超时后重新标记为自旋, 此后的唤醒者无需进入内核
+	Atomic::FetchBitSet(&stackNode.Flags, BIT_SPINNING);
+
+	if (DequeueStackNode(pLockStatus, &stackNode) == DEQUEUE_REMOVED)
+		return WAIT_TIMEOUT;
+
+	// 节点已被摘除, 等待唤醒者完成唤醒
+	Spinning(stackNode);
+	if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		do
+		{
+			stackNode.WaitMicrosec();
+		} while (!(stackNode.Flags & FLAG_WAKING));
+	}
+	return WAIT_WOKEN;
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+// 无法入队时轮询等待, 节点未入队, 取消者不会唤醒
+static void PollCancellable(SRWStackNode &stackNode, uint64_t *pPollTime)
+{
+	uint64_t pollTime = *pPollTime;
+	*pPollTime = (std::min)(pollTime * 2, POLL_MAX_MICROSEC);
+	stackNode.WaitMicrosec(pollTime);
+}
+
+template <bool IsExclusive>
+PLATFORM_NOINLINE static SRWWaitResult TryWaitingCancellable(size_t *pLockStatus, SRWStackNode &stackNode, SRWStatus lastStatus)
+{
+	if (IsExclusive)
+		stackNode.Flags = FLAG_SPINNING | FLAG_LOCKED;
+	else
+		stackNode.Flags = FLAG_SPINNING;
+
+	if (!QueueStackNode<IsExclusive>(pLockStatus, &stackNode, lastStatus))
+		return WAIT_FAILED;
+
+	SRWLOCK_PROBE3(enqueue, pLockStatus, IsExclusive, SRWLOCK_PROBE_NOW(enqueue));
+
+	Spinning(stackNode);
+
+	// 自旋期间已被唤醒
+	if (!Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_SPIN_WIN, 1);
+		SRWLOCK_PROBE3(spin_exit, pLockStatus, true, SRWLOCK_PROBE_NOW(spin_exit));
+		return WAIT_WOKEN;
+	}
+	SRWLOCK_STAT_ADD(pLockStatus, STAT_PARK, 1);
+	SRWLOCK_PROBE3(spin_exit, pLockStatus, false, SRWLOCK_PROBE_NOW(spin_exit));
+	SRWLOCK_PROBE2(park, pLockStatus, SRWLOCK_PROBE_NOW(park));
+
+	// 睡眠直到被唤醒或取消
+	for (;;)
+	{
+		if (SleepCancellable(stackNode) != SLEEP_AWAKE)
+			break;
+
+		if (stackNode.Flags & FLAG_WAKING)
+			return WAIT_WOKEN;
+	}
+
+	// 与超时相同, 重新标记为自旋后出队
+	Atomic::FetchBitSet(&stackNode.Flags, BIT_SPINNING);
+
+	if (DequeueStackNode(pLockStatus, &stackNode) == DEQUEUE_REMOVED)
+		return WAIT_CANCELLED;
+
+	// 节点已被摘除, 等待唤醒者完成唤醒
+	Spinning(stackNode);
+	if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		do
+		{
+			stackNode.WaitMicrosec();
+		} while (!(stackNode.Flags & FLAG_WAKING));
+	}
+	return WAIT_WOKEN;
+}
+#endif
+
 static bool TryLockShared(size_t *pLockStatus, SRWStatus lastStatus)
 {
 	SRWStatus newStatus = lastStatus.Value | FLAG_LOCKED;
@@ -137,6 +429,50 @@ static bool TryLockShared(size_t *pLockStatus, SRWStatus lastStatus)
 	return lastStatus == Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, newStatus.Value);
 }
 
+static bool TryLockUpgrade(size_t *pLockStatus, SRWStatus lastStatus)
+{
+	SRWStatus newStatus = lastStatus.Value | FLAG_UPGRADE | FLAG_LOCKED;
+	if (!lastStatus.Spinning)
+		newStatus = newStatus.Value + FLAG_SHARED;
+
+	return lastStatus == Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, newStatus.Value);
+}
+
+// 唤醒单个不在等待链表中的节点
+static void WakeUpStackNode(size_t *pLockStatus, SRWStackNode *pStackNode)
+{
+	Atomic::FetchBitSet(&pStackNode->Flags, BIT_WAKING);
+	if (!Atomic::FetchBitClear(&pStackNode->Flags, BIT_SPINNING))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_WAKE_UP, 1);
+		SRWLOCK_PROBE2(wake, pLockStatus, pStackNode);
+		pStackNode->WakeUp();
+	}
+}
+
+// 在通知节点上登记升级者并释放自身的共享计数, 等待最后一个共享者移交独占
+static void WaitUpgrade(size_t *pLockStatus, SRWStackNode *pNotify, SRWStackNode &stackNode)
+{
+	pNotify->Upgrader = &stackNode;
+
+	if (Atomic::DecrementFetch(&pNotify->SharedCount) == 0)
+	{
+		// 其他共享者均已释放
+		pNotify->Upgrader = nullptr;
+		Atomic::FetchAnd<size_t>(pLockStatus, ~(FLAG_MULTI_SHARED | FLAG_UPGRADE));
+		return;
+	}
+
+	Spinning(stackNode);
+	if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+	{
+		do
+		{
+			stackNode.WaitMicrosec();
+		} while (!(stackNode.Flags & FLAG_WAKING));
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 bool SRWLock_TryLock(size_t *pLockStatus)
 {
@@ -148,10 +484,15 @@ void SRWLock_Lock(size_t *pLockStatus)
 {
 	// 成功获得锁时立即返回
 	if (PLATFORM_LIKELY(SRWLock_TryLock(pLockStatus)))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
 		return;
+	}
 
 	uint32_t backoffCount = 0;
-	alignas(16) SRWStackNode stackNode{};
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
 
 	SRWStatus lastStatus = *pLockStatus;
 
@@ -170,7 +511,11 @@ void SRWLock_Lock(size_t *pLockStatus)
 		{
 			// 尝试加锁, 成功后立即返回
 			if (SRWLock_TryLock(pLockStatus))
+			{
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
 				return;
+			}
 		}
 
 		// 存在竞争时主动避让
@@ -209,24 +554,60 @@ void SRWLock_Unlock(size_t *pLockStatus)
 	}
 }
 
-bool SRWLock_TryLockShared(size_t *pLockStatus)
+bool SRWLock_LockUntil(size_t *pLockStatus, uint64_t deadline)
 {
-	// 未锁定时可以立即锁定
-	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_LOCKED);
-	if (PLATFORM_LIKELY(lastStatus == 0))
+	// 成功获得锁时立即返回
+	if (PLATFORM_LIKELY(SRWLock_TryLock(pLockStatus)))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
 		return true;
+	}
 
 	uint32_t backoffCount = 0;
+	uint64_t pollTime = POLL_MIN_MICROSEC;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	SRWStatus lastStatus = *pLockStatus;
 
 	for (;;)
 	{
-		// 已锁定, 且正在自旋或者非共享锁定时, 加锁失败
-		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount))
-			return false;
+		if (lastStatus.Locked)
+		{
+			if (IsDequeueUnsafe(lastStatus))
+			{
+				if (PollUntil(stackNode, deadline, &pollTime))
+					return false;
 
-		// 尝试加锁
-		if (TryLockShared(pLockStatus, lastStatus))
-			return true;
+				lastStatus = *pLockStatus;
+				continue;
+			}
+
+			// 超时后不再等待. 锁定者解锁时负责唤醒其他等待者
+			if (GetTickMicrosec() >= deadline)
+				return false;
+
+			SRWWaitResult result = TryWaitingUntil<true>(pLockStatus, stackNode, lastStatus, deadline);
+			if (result == WAIT_TIMEOUT)
+				return false;
+
+			if (result == WAIT_WOKEN)
+			{
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			// 尝试加锁, 成功后立即返回
+			if (SRWLock_TryLock(pLockStatus))
+			{
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return true;
+			}
+		}
 
 		// 存在竞争时主动避让
 		Backoff(&backoffCount);
@@ -234,22 +615,64 @@ bool SRWLock_TryLockShared(size_t *pLockStatus)
 	}
 }
 
-void SRWLock_LockShared(size_t *pLockStatus)
+bool SRWLock_LockFor(size_t *pLockStatus, uint64_t microsecs)
 {
-	// 未锁定时可以立即锁定
-	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_LOCKED);
-	if (PLATFORM_LIKELY(lastStatus == 0))
-		return;
+	if (PLATFORM_LIKELY(SRWLock_TryLock(pLockStatus)))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return true;
+	}
+
+	if (microsecs == -1)
+	{
+		SRWLock_Lock(pLockStatus);
+		return true;
+	}
+
+	return SRWLock_LockUntil(pLockStatus, GetDeadlineMicrosec(microsecs));
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+bool SRWLock_LockCancellable(size_t *pLockStatus, const std::stop_token &token)
+{
+	// 成功获得锁时立即返回
+	if (PLATFORM_LIKELY(SRWLock_TryLock(pLockStatus)))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return true;
+	}
 
 	uint32_t backoffCount = 0;
-	alignas(16) SRWStackNode stackNode{};
+	uint64_t pollTime = POLL_MIN_MICROSEC;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	// 回调在节点之后构造, 先于节点析构
+	std::stop_callback<SRWStopCallback> stopCallback(token, SRWStopCallback{ &stackNode });
+
+	SRWStatus lastStatus = *pLockStatus;
 
 	for (;;)
 	{
-		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount))
+		if (lastStatus.Locked)
 		{
-			// 已锁定, 且正在自旋或者非共享锁定时, 进入等待模式
-			if (TryWaiting<false>(pLockStatus, stackNode, lastStatus))
+			// 取消后不再等待. 锁定者解锁时负责唤醒其他等待者
+			if (IsCancelRequested(stackNode))
+				return false;
+
+			if (IsDequeueUnsafe(lastStatus))
+			{
+				PollCancellable(stackNode, &pollTime);
+				lastStatus = *pLockStatus;
+				continue;
+			}
+
+			SRWWaitResult result = TryWaitingCancellable<true>(pLockStatus, stackNode, lastStatus);
+			if (result == WAIT_CANCELLED)
+				return false;
+
+			if (result == WAIT_WOKEN)
 			{
 				lastStatus = *pLockStatus;
 				continue;
@@ -258,8 +681,19 @@ void SRWLock_LockShared(size_t *pLockStatus)
 		else
 		{
 			// 尝试加锁, 成功后立即返回
-			if (TryLockShared(pLockStatus, lastStatus))
-				return;
+			if (SRWLock_TryLock(pLockStatus))
+			{
+				// 被唤醒后才取消时, 解锁以把唤醒传递给下一个等待者
+				if (IsCancelRequested(stackNode))
+				{
+					SRWLock_Unlock(pLockStatus);
+					return false;
+				}
+
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return true;
+			}
 		}
 
 		// 存在竞争时主动避让
@@ -267,151 +701,1092 @@ void SRWLock_LockShared(size_t *pLockStatus)
 		lastStatus = *pLockStatus;
 	}
 }
+#endif
 
-void SRWLock_UnlockShared(size_t *pLockStatus)
+bool SRWLock_TryLockShared(size_t *pLockStatus)
 {
-	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, FLAG_SHARED | FLAG_LOCKED, 0);
-	if (PLATFORM_LIKELY(lastStatus == (FLAG_SHARED | FLAG_LOCKED)))
-		return;
-
-	AssertDebug(lastStatus.Locked);
-
+	// 未锁定时可以立即锁定
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == 0))
+		return true;
+
+	uint32_t backoffCount = 0;
+
+	for (;;)
+	{
+		// 已锁定, 且正在自旋或者非共享锁定时, 加锁失败
+		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount))
+			return false;
+
+		// 尝试加锁
+		if (TryLockShared(pLockStatus, lastStatus))
+			return true;
+
+		// 存在竞争时主动避让
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+void SRWLock_LockShared(size_t *pLockStatus)
+{
+	// 未锁定时可以立即锁定
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == 0))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return;
+	}
+
+	uint32_t backoffCount = 0;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	for (;;)
+	{
+		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount))
+		{
+			// 已锁定, 且正在自旋或者非共享锁定时, 进入等待模式
+			if (TryWaiting<false>(pLockStatus, stackNode, lastStatus))
+			{
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			// 尝试加锁, 成功后立即返回
+			if (TryLockShared(pLockStatus, lastStatus))
+			{
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return;
+			}
+		}
+
+		// 存在竞争时主动避让
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+bool SRWLock_LockSharedUntil(size_t *pLockStatus, uint64_t deadline)
+{
+	// 未锁定时可以立即锁定
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == 0))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return true;
+	}
+
+	uint32_t backoffCount = 0;
+	uint64_t pollTime = POLL_MIN_MICROSEC;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	for (;;)
+	{
+		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount))
+		{
+			if (IsDequeueUnsafe(lastStatus))
+			{
+				if (PollUntil(stackNode, deadline, &pollTime))
+					return false;
+
+				lastStatus = *pLockStatus;
+				continue;
+			}
+
+			// 超时后不再等待
+			if (GetTickMicrosec() >= deadline)
+				return false;
+
+			SRWWaitResult result = TryWaitingUntil<false>(pLockStatus, stackNode, lastStatus, deadline);
+			if (result == WAIT_TIMEOUT)
+				return false;
+
+			if (result == WAIT_WOKEN)
+			{
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			// 尝试加锁, 成功后立即返回
+			if (TryLockShared(pLockStatus, lastStatus))
+			{
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return true;
+			}
+		}
+
+		// 存在竞争时主动避让
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+bool SRWLock_LockSharedCancellable(size_t *pLockStatus, const std::stop_token &token)
+{
+	// 未锁定时可以立即锁定
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == 0))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return true;
+	}
+
+	uint32_t backoffCount = 0;
+	uint64_t pollTime = POLL_MIN_MICROSEC;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	std::stop_callback<SRWStopCallback> stopCallback(token, SRWStopCallback{ &stackNode });
+
+	for (;;)
+	{
+		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount))
+		{
+			// 取消后不再等待. 锁定者解锁时负责唤醒其他等待者
+			if (IsCancelRequested(stackNode))
+				return false;
+
+			if (IsDequeueUnsafe(lastStatus))
+			{
+				PollCancellable(stackNode, &pollTime);
+				lastStatus = *pLockStatus;
+				continue;
+			}
+
+			SRWWaitResult result = TryWaitingCancellable<false>(pLockStatus, stackNode, lastStatus);
+			if (result == WAIT_CANCELLED)
+				return false;
+
+			if (result == WAIT_WOKEN)
+			{
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			// 尝试加锁, 成功后立即返回
+			if (TryLockShared(pLockStatus, lastStatus))
+			{
+				// 被唤醒后才取消时, 解锁以把唤醒传递给下一个等待者
+				if (IsCancelRequested(stackNode))
+				{
+					SRWLock_UnlockShared(pLockStatus);
+					return false;
+				}
+
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return true;
+			}
+		}
+
+		// 存在竞争时主动避让
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+#endif
+
+bool SRWLock_LockSharedFor(size_t *pLockStatus, uint64_t microsecs)
+{
+	if (PLATFORM_LIKELY(SRWLock_TryLockShared(pLockStatus)))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return true;
+	}
+
+	if (microsecs == -1)
+	{
+		SRWLock_LockShared(pLockStatus);
+		return true;
+	}
+
+	return SRWLock_LockSharedUntil(pLockStatus, GetDeadlineMicrosec(microsecs));
+}
+
+void SRWLock_UnlockShared(size_t *pLockStatus)
+{
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, FLAG_SHARED | FLAG_LOCKED, 0);
+	if (PLATFORM_LIKELY(lastStatus == (FLAG_SHARED | FLAG_LOCKED)))
+		return;
+
+	AssertDebug(lastStatus.Locked);
+
+	while (!lastStatus.Spinning)
+	{
+		SRWStatus newStatus;
+
+		// 共享计数减一
+		if (lastStatus.SharedCount > 1)
+			newStatus = lastStatus.Value - FLAG_SHARED;
+		else
+			newStatus = 0;
+
+		newStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, newStatus.Value);
+		if (newStatus == lastStatus)
+			return;
+
+		lastStatus = newStatus;
+	}
+
+	if (lastStatus.MultiShared)
+	{
+		SRWStackNode *pCurr = lastStatus.WaitNode();
+		SRWStackNode *pNotify;
+		for (;;)
+		{
+			pNotify = pCurr->Notify;
+			if (pNotify)
+				break;
+			pCurr = pCurr->Back;
+		}
+
+		AssertDebug(pNotify->SharedCount);
+		AssertDebug(pNotify->Flags & FLAG_LOCKED);
+
+		if (Atomic::DecrementFetch(&pNotify->SharedCount) > 0)
+			return;
+
+		// 升级者正在等待最后一个共享者, 保留锁定位直接移交独占
+		if (SRWStackNode *pUpgrader = pNotify->Upgrader)
+		{
+			pNotify->Upgrader = nullptr;
+			Atomic::FetchAnd<size_t>(pLockStatus, ~(FLAG_MULTI_SHARED | FLAG_UPGRADE));
+			WakeUpStackNode(pLockStatus, pUpgrader);
+			return;
+		}
+	}
+
+	for (;;)
+	{
+		SRWStatus newStatus = lastStatus.WithoutMultiSharedLocked();
+
+		bool isWake = false;
+		if (lastStatus.Spinning && !lastStatus.Waking)
+		{
+			newStatus.Waking = 1;
+			isWake = true;
+		}
+
+		SRWStatus currStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, newStatus.Value);
+		if (currStatus == lastStatus)
+		{
+			if (isWake)
+				WakeUpLock(pLockStatus, newStatus);
+			return;
+		}
+
+		lastStatus = currStatus;
+	}
+}
+
+// 饥饿模式解锁. 保留锁定位, 将所有权直接移交给最早的等待者
+static void UnlockHandoff(size_t *pLockStatus, SRWStatus lastStatus)
+{
+	uint32_t backoffCount = 0;
+
+	// 获取唤醒标记. 其他线程只会在锁定状态下短暂持有
+	for (;;)
+	{
+		AssertDebug(lastStatus.Locked);
+		AssertDebug(lastStatus.Spinning);
+
+		if (!lastStatus.Waking)
+		{
+			SRWStatus currStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, lastStatus.Value | FLAG_WAKING);
+			if (currStatus == lastStatus)
+			{
+				lastStatus.Waking = 1;
+				break;
+			}
+
+			lastStatus = currStatus;
+			continue;
+		}
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+
+	SRWStackNode *pNotify;
+	for (;;)
+	{
+		SRWStackNode *pWaitNode = lastStatus.WaitNode();
+		pNotify = UpdateNotifyNode(pWaitNode);
+		AssertDebug(pNotify->Flags & FLAG_LOCKED);
+
+		if (SRWStackNode *pNext = pNotify->Next)
+		{
+			// 摘除通知节点, 下一节点成为通知节点
+			pWaitNode->Notify = pNext;
+			pNotify->Next = nullptr;
+
+			Atomic::FetchAnd<size_t>(pLockStatus, ~FLAG_WAKING);
+			break;
+		}
+
+		// 唯一的节点, 清空等待链表
+		SRWStatus currStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, FLAG_LOCKED);
+		if (currStatus == lastStatus)
+			break;
+
+		lastStatus = currStatus;
+	}
+
+	Atomic::FetchOr<uint32_t>(&pNotify->Flags, FLAG_HANDOFF);
+	WakeUpStackNode(pLockStatus, pNotify);
+}
+
+void SRWLock_LockHandoff(size_t *pLockStatus, uint32_t *pStarving, uint64_t threshold)
+{
+	if (PLATFORM_LIKELY(SRWLock_TryLock(pLockStatus)))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return;
+	}
+
+	uint32_t backoffCount = 0;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	uint64_t startTime = GetTickMicrosec();
+	SRWStatus lastStatus = *pLockStatus;
+
+	for (;;)
+	{
+		if (lastStatus.Locked)
+		{
+			if (TryWaiting<true>(pLockStatus, stackNode, lastStatus))
+			{
+				uint64_t waitTime = GetTickMicrosec() - startTime;
+
+				if (stackNode.Flags & FLAG_HANDOFF)
+				{
+					// 已获得移交的所有权. 等待链表已空或等待时间未超过阈值时退出饥饿模式
+					if (!SRWStatus(*pLockStatus).Spinning || waitTime < threshold)
+						static_cast<volatile uint32_t&>(*pStarving) = 0;
+					SRWLOCK_STAT_CONTENDED(waitStart);
+					SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+					return;
+				}
+
+				// 被唤醒后抢锁失败且等待过久, 进入饥饿模式
+				if (waitTime >= threshold)
+					static_cast<volatile uint32_t&>(*pStarving) = 1;
+
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			if (SRWLock_TryLock(pLockStatus))
+			{
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return;
+			}
+		}
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+void SRWLock_UnlockHandoff(size_t *pLockStatus, uint32_t *pStarving)
+{
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, FLAG_LOCKED, 0);
+	if (PLATFORM_LIKELY(lastStatus == FLAG_LOCKED))
+		return;
+
+	if (lastStatus.Spinning && static_cast<volatile const uint32_t&>(*pStarving))
+	{
+		UnlockHandoff(pLockStatus, lastStatus);
+		return;
+	}
+
+	SRWLock_Unlock(pLockStatus);
+}
+
+void SRWLock_LockAdaptive(size_t *pLockStatus, uint32_t *pSpinEstimate)
+{
+	if (PLATFORM_LIKELY(SRWLock_TryLock(pLockStatus)))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return;
+	}
+
+	uint32_t backoffCount = 0;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	SRWStatus lastStatus = *pLockStatus;
+
+	for (;;)
+	{
+		if (lastStatus.Locked)
+		{
+			if (TryWaitingAdaptive<true>(pLockStatus, stackNode, lastStatus, pSpinEstimate))
+			{
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			if (SRWLock_TryLock(pLockStatus))
+			{
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return;
+			}
+		}
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+void SRWLock_LockSharedAdaptive(size_t *pLockStatus, uint32_t *pSpinEstimate)
+{
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == 0))
+	{
+		SRWLOCK_STAT_ADD(pLockStatus, STAT_FAST_ACQUIRE, 1);
+		return;
+	}
+
+	uint32_t backoffCount = 0;
+	alignas(32) SRWStackNode stackNode{};
+	SRWLOCK_STAT_WAIT(pLockStatus, waitStart);
+	SRWLOCK_PROBE_START(traceStart);
+
+	for (;;)
+	{
+		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount))
+		{
+			if (TryWaitingAdaptive<false>(pLockStatus, stackNode, lastStatus, pSpinEstimate))
+			{
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			if (TryLockShared(pLockStatus, lastStatus))
+			{
+				SRWLOCK_STAT_CONTENDED(waitStart);
+				SRWLOCK_PROBE_ACQUIRE(pLockStatus, traceStart);
+				return;
+			}
+		}
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+bool SRWLock_TryLockUpgrade(size_t *pLockStatus)
+{
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_UPGRADE | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == 0))
+		return true;
+
+	uint32_t backoffCount = 0;
+
+	for (;;)
+	{
+		// 已存在升级者, 或无法共享加锁时失败
+		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount || lastStatus.Upgrade))
+			return false;
+
+		if (TryLockUpgrade(pLockStatus, lastStatus))
+			return true;
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+void SRWLock_LockUpgrade(size_t *pLockStatus)
+{
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, 0, FLAG_SHARED | FLAG_UPGRADE | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == 0))
+		return;
+
+	uint32_t backoffCount = 0;
+	alignas(32) SRWStackNode stackNode{};
+
+	for (;;)
+	{
+		if (lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount || lastStatus.Upgrade))
+		{
+			// 升级者之间互斥, 以独占身份排队等待全部持有者释放
+			if (TryWaiting<true>(pLockStatus, stackNode, lastStatus))
+			{
+				lastStatus = *pLockStatus;
+				continue;
+			}
+		}
+		else
+		{
+			if (TryLockUpgrade(pLockStatus, lastStatus))
+				return;
+		}
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+void SRWLock_UnlockUpgrade(size_t *pLockStatus)
+{
+	SRWLock_UpgradeToShared(pLockStatus);
+	SRWLock_UnlockShared(pLockStatus);
+}
+
+void SRWLock_Upgrade(size_t *pLockStatus)
+{
+	// 唯一的共享者时直接转为独占
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, FLAG_SHARED | FLAG_UPGRADE | FLAG_LOCKED, FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == (FLAG_SHARED | FLAG_UPGRADE | FLAG_LOCKED)))
+		return;
+
+	uint32_t backoffCount = 0;
+	alignas(32) SRWStackNode stackNode{};
+
+	for (;;)
+	{
+		AssertDebug(lastStatus.Locked);
+		AssertDebug(lastStatus.Upgrade);
+
+		if (!lastStatus.Spinning)
+		{
+			if (lastStatus.SharedCount <= 1)
+			{
+				// 没有其他共享者
+				if (lastStatus == Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, FLAG_LOCKED))
+					return;
+			}
+			else
+			{
+				// 以独占等待者身份入队, 通知节点的共享计数包含自身
+				stackNode.Flags = FLAG_SPINNING | FLAG_LOCKED;
+				if (QueueStackNode<true>(pLockStatus, &stackNode, lastStatus))
+				{
+					WaitUpgrade(pLockStatus, &stackNode, stackNode);
+
+					// 已持有独占, 不会再有唤醒者访问该节点, 将其移出等待链表
+					stackNode.Flags = FLAG_SPINNING | FLAG_LOCKED;
+					SRWDequeueResult result = DequeueStackNode(pLockStatus, &stackNode);
+					AssertDebug(result == DEQUEUE_REMOVED);
+					(void)result;
+					return;
+				}
+			}
+		}
+		else if (!lastStatus.MultiShared)
+		{
+			// 等待链表存在但非多重共享, 锁定位只属于当前线程
+			Atomic::FetchAnd<size_t>(pLockStatus, ~FLAG_UPGRADE);
+			return;
+		}
+		else
+		{
+			// 持有共享计数期间多重共享状态不会解除, 可以安全遍历
+			SRWStackNode *pCurr = lastStatus.WaitNode();
+			SRWStackNode *pNotify;
+			for (;;)
+			{
+				pNotify = pCurr->Notify;
+				if (pNotify)
+					break;
+				pCurr = pCurr->Back;
+			}
+
+			stackNode.Flags = FLAG_SPINNING;
+			WaitUpgrade(pLockStatus, pNotify, stackNode);
+			return;
+		}
+
+		Backoff(&backoffCount);
+		lastStatus = *pLockStatus;
+	}
+}
+
+void SRWLock_UpgradeToShared(size_t *pLockStatus)
+{
+	AssertDebug(SRWStatus(*pLockStatus).Upgrade);
+	Atomic::FetchAnd<size_t>(pLockStatus, ~FLAG_UPGRADE);
+}
+
+void SRWLock_Downgrade(size_t *pLockStatus)
+{
+	SRWStatus lastStatus = Atomic::CompareExchange<size_t>(pLockStatus, FLAG_LOCKED, FLAG_SHARED | FLAG_LOCKED);
+	if (PLATFORM_LIKELY(lastStatus == FLAG_LOCKED))
+		return;
+
+	// 存在等待链表时锁定位同样可以表示唯一的共享者, 无需修改状态
 	while (!lastStatus.Spinning)
 	{
-		SRWStatus newStatus;
-
-		// 共享计数减一
-		if (lastStatus.SharedCount > 1)
-			newStatus = lastStatus.Value - FLAG_SHARED;
-		else
-			newStatus = 0;
+		AssertDebug(lastStatus == FLAG_LOCKED);
 
-		newStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, newStatus.Value);
-		if (newStatus == lastStatus)
+		SRWStatus currStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, FLAG_SHARED | FLAG_LOCKED);
+		if (currStatus == lastStatus)
 			return;
 
-		lastStatus = newStatus;
+		lastStatus = currStatus;
 	}
+}
 
-	if (lastStatus.MultiShared)
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+template <bool IsExclusive>
+static bool IsLockBusy(SRWStatus lastStatus)
+{
+	if (IsExclusive)
+		return lastStatus.Locked;
+	return lastStatus.Locked && (lastStatus.Spinning || !lastStatus.SharedCount);
+}
+
+template <bool IsExclusive>
+static bool TryLockAnyOne(size_t *pLockStatus, SRWStatus lastStatus)
+{
+	if (IsExclusive)
+		return SRWLock_TryLock(pLockStatus);
+	return TryLockShared(pLockStatus, lastStatus);
+}
+
+// 每轮在所有可安全出队的锁上挂入节点, 所有节点的等待事件一起等待.
+// 任一节点被唤醒后撤销其余节点, 再尝试对被唤醒的锁加锁.
+// 被唤醒但放弃的锁需要加锁后再解锁来转交唤醒, 否则其余等待者无人唤醒
+template <bool IsExclusive>
+PLATFORM_NOINLINE static size_t LockAnyUntil(size_t *const *ppLockStatus, size_t count, uint64_t deadline)
+{
+	AssertDebug(count <= SRWLOCK_WAIT_ANY_MAX);
+
+	uint32_t backoffCount = 0;
+	uint64_t pollTime = POLL_MIN_MICROSEC;
+	alignas(32) SRWStackNode stackNodes[SRWLOCK_WAIT_ANY_MAX];
+	WaitEvent *events[SRWLOCK_WAIT_ANY_MAX];
+	size_t lockIndices[SRWLOCK_WAIT_ANY_MAX];
+	bool isWokenNodes[SRWLOCK_WAIT_ANY_MAX];
+
+	for (;;)
 	{
-		SRWStackNode *pCurr = lastStatus.WaitNode();
-		SRWStackNode *pNotify;
-		for (;;)
+		uint64_t waitTime = -1;
+		if (deadline != -1)
 		{
-			pNotify = pCurr->Notify;
-			if (pNotify)
-				break;
-			pCurr = pCurr->Back;
+			uint64_t now = GetTickMicrosec();
+			waitTime = now < deadline ? deadline - now : 0;
 		}
 
-		AssertDebug(pNotify->SharedCount);
-		AssertDebug(pNotify->Flags & FLAG_LOCKED);
+		size_t index = -1;
+		size_t queueCount = 0;
+		bool isPoll = false;
 
-		if (Atomic::DecrementFetch(&pNotify->SharedCount) > 0)
-			return;
-	}
+		for (size_t i = 0; i < count && index == -1; ++i)
+		{
+			size_t *pLockStatus = ppLockStatus[i];
 
-	for (;;)
-	{
-		SRWStatus newStatus = lastStatus.WithoutMultiSharedLocked();
+			for (;;)
+			{
+				SRWStatus lastStatus = *pLockStatus;
+				if (!IsLockBusy<IsExclusive>(lastStatus))
+				{
+					if (TryLockAnyOne<IsExclusive>(pLockStatus, lastStatus))
+					{
+						index = i;
+						break;
+					}
+				}
+				else if (!waitTime || IsDequeueUnsafe(lastStatus))
+				{
+					// 超时后只尝试加锁. 节点无法安全出队时以轮询代替
+					isPoll = true;
+					break;
+				}
+				else
+				{
+					SRWStackNode &stackNode = stackNodes[queueCount];
+					if (IsExclusive)
+						stackNode.Flags = FLAG_SPINNING | FLAG_LOCKED;
+					else
+						stackNode.Flags = FLAG_SPINNING;
+
+					if (QueueStackNode<IsExclusive>(pLockStatus, &stackNode, lastStatus))
+					{
+						events[queueCount] = &stackNode;
+						lockIndices[queueCount] = i;
+						isWokenNodes[queueCount] = false;
+						++queueCount;
+						break;
+					}
+				}
+
+				// 存在竞争时主动避让
+				Backoff(&backoffCount);
+			}
+		}
 
-		bool isWake = false;
-		if (lastStatus.Spinning && !lastStatus.Waking)
+		if (index == -1)
 		{
-			newStatus.Waking = 1;
-			isWake = true;
+			if (!waitTime)
+				return -1;
+
+			if (isPoll)
+			{
+				waitTime = (std::min)(waitTime, pollTime);
+				pollTime = (std::min)(pollTime * 2, POLL_MAX_MICROSEC);
+			}
+
+			if (queueCount)
+			{
+				// 清除自旋标记, 失败说明入队期间已被唤醒
+				bool isWoken = false;
+				for (size_t q = 0; q < queueCount; ++q)
+				{
+					if (!Atomic::FetchBitClear(&stackNodes[q].Flags, BIT_SPINNING))
+						isWokenNodes[q] = isWoken = true;
+				}
+
+				if (!isWoken)
+				{
+					size_t woken = WaitEvent::WaitAny(events, queueCount, waitTime);
+					if (woken != -1)
+						isWokenNodes[woken] = true;
+				}
+			}
+			else
+			{
+				// 节点未入队, 不会被唤醒
+				stackNodes[0].WaitMicrosec(waitTime);
+			}
 		}
 
-		SRWStatus currStatus = Atomic::CompareExchange<size_t>(pLockStatus, lastStatus.Value, newStatus.Value);
-		if (currStatus == lastStatus)
+		// 撤销未被唤醒的节点, 已被唤醒者摘除的节点需要等待唤醒完成
+		for (size_t q = 0; q < queueCount; ++q)
 		{
-			if (isWake)
-				WakeUpLock(pLockStatus, newStatus);
-			return;
+			if (isWokenNodes[q])
+				continue;
+
+			SRWStackNode &stackNode = stackNodes[q];
+			Atomic::FetchBitSet(&stackNode.Flags, BIT_SPINNING);
+			if (DequeueStackNode(ppLockStatus[lockIndices[q]], &stackNode) == DEQUEUE_REMOVED)
+				continue;
+
+			Spinning(stackNode);
+			if (Atomic::FetchBitClear(&stackNode.Flags, BIT_SPINNING))
+			{
+				do
+				{
+					stackNode.WaitMicrosec();
+				} while (!(stackNode.Flags & FLAG_WAKING));
+			}
+			isWokenNodes[q] = true;
 		}
 
-		lastStatus = currStatus;
+		// 对被唤醒的锁加锁. 加锁失败时由当前持有者负责之后的唤醒
+		for (size_t q = 0; q < queueCount; ++q)
+		{
+			if (!isWokenNodes[q])
+				continue;
+
+			size_t *pLockStatus = ppLockStatus[lockIndices[q]];
+			SRWStatus lastStatus = *pLockStatus;
+			if (IsLockBusy<IsExclusive>(lastStatus) ||
+				!TryLockAnyOne<IsExclusive>(pLockStatus, lastStatus))
+				continue;
+
+			if (index == -1)
+				index = lockIndices[q];
+			else if (IsExclusive)
+				SRWLock_Unlock(pLockStatus);
+			else
+				SRWLock_UnlockShared(pLockStatus);
+		}
+
+		if (index != -1)
+			return index;
 	}
 }
 
+size_t SRWLock_LockAny(size_t *const *ppLockStatus, size_t count, uint64_t microsecs)
+{
+	uint64_t deadline = -1;
+	if (microsecs != -1)
+		deadline = GetDeadlineMicrosec(microsecs);
+	return LockAnyUntil<true>(ppLockStatus, count, deadline);
+}
+
+size_t SRWLock_LockSharedAny(size_t *const *ppLockStatus, size_t count, uint64_t microsecs)
+{
+	uint64_t deadline = -1;
+	if (microsecs != -1)
+		deadline = GetDeadlineMicrosec(microsecs);
+	return LockAnyUntil<false>(ppLockStatus, count, deadline);
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 bool SRWLock::try_lock()
 {
-	return SRWLock_TryLock(&LockStatus_);
+	if (!SRWLock_TryLock(&LockStatus_))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, false);
+	return true;
 }
 
 void SRWLock::lock()
 {
 	SRWLock_Lock(&LockStatus_);
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, false);
 }
 
 void SRWLock::unlock()
 {
+	SRWLOCK_WATCH_RELEASE(&LockStatus_);
 	SRWLock_Unlock(&LockStatus_);
 }
 
+bool SRWLock::try_lock_for(uint64_t microsecs)
+{
+	if (!SRWLock_LockFor(&LockStatus_, microsecs))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, false);
+	return true;
+}
+
+bool SRWLock::try_lock_until(uint64_t deadline)
+{
+	if (!SRWLock_LockUntil(&LockStatus_, deadline))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, false);
+	return true;
+}
+
 bool SRWLock::try_lock_shared()
 {
-	return SRWLock_TryLockShared(&LockStatus_);
+	if (!SRWLock_TryLockShared(&LockStatus_))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+	return true;
 }
 
 void SRWLock::lock_shared()
 {
 	SRWLock_LockShared(&LockStatus_);
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
 }
 
 void SRWLock::unlock_shared()
 {
+	SRWLOCK_WATCH_RELEASE(&LockStatus_);
 	SRWLock_UnlockShared(&LockStatus_);
 }
 
-//////////////////////////////////////////////////////////////////////////
-#if defined(PLATFORM_IS_WINDOWS)
-#  include <windows.h>
-#elif defined(PLATFORM_IS_UNIX) || defined(PLATFORM_IS_APPLE)
-#  include <sched.h>
-#  include <unistd.h>
-#  define PLATFORM_IS_UNIX_OR_APPLE
-
-#  if defined(PLATFORM_IS_APPLE)
-#    include <pthread.h>
-#  else
-#    include <sys/syscall.h>
-#  endif
+bool SRWLock::try_lock_shared_for(uint64_t microsecs)
+{
+	if (!SRWLock_LockSharedFor(&LockStatus_, microsecs))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+	return true;
+}
+
+bool SRWLock::try_lock_shared_until(uint64_t deadline)
+{
+	if (!SRWLock_LockSharedUntil(&LockStatus_, deadline))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+	return true;
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+bool SRWLock::lock(const std::stop_token &token)
+{
+	if (!SRWLock_LockCancellable(&LockStatus_, token))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, false);
+	return true;
+}
+
+bool SRWLock::lock_shared(const std::stop_token &token)
+{
+	if (!SRWLock_LockSharedCancellable(&LockStatus_, token))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+	return true;
+}
 #endif
 
-static uint32_t GetThreadIDImpl()
+bool SRWLock::try_lock_upgrade()
+{
+	if (!SRWLock_TryLockUpgrade(&LockStatus_))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+	return true;
+}
+
+void SRWLock::lock_upgrade()
+{
+	SRWLock_LockUpgrade(&LockStatus_);
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+}
+
+void SRWLock::unlock_upgrade()
+{
+	SRWLOCK_WATCH_RELEASE(&LockStatus_);
+	SRWLock_UnlockUpgrade(&LockStatus_);
+}
+
+void SRWLock::unlock_upgrade_and_lock()
+{
+	SRWLock_Upgrade(&LockStatus_);
+	SRWLOCK_WATCH_CONVERT(&LockStatus_, false);
+}
+
+void SRWLock::unlock_upgrade_and_lock_shared()
+{
+	SRWLock_UpgradeToShared(&LockStatus_);
+}
+
+void SRWLock::unlock_and_lock_shared()
+{
+	SRWLock_Downgrade(&LockStatus_);
+	SRWLOCK_WATCH_CONVERT(&LockStatus_, true);
+}
+
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+size_t SRWLock::lock_any(SRWLock *const *ppLocks, size_t count, uint64_t microsecs)
+{
+	AssertDebug(count <= SRWLOCK_WAIT_ANY_MAX);
+
+	size_t *lockHandles[SRWLOCK_WAIT_ANY_MAX];
+	for (size_t i = 0; i < count; ++i)
+		lockHandles[i] = ppLocks[i]->native_handle();
+
+	size_t idx = SRWLock_LockAny(lockHandles, count, microsecs);
+	if (idx != -1)
+		SRWLOCK_WATCH_ACQUIRE(lockHandles[idx], false);
+	return idx;
+}
+
+size_t SRWLock::lock_shared_any(SRWLock *const *ppLocks, size_t count, uint64_t microsecs)
 {
-#if defined(PLATFORM_IS_WINDOWS)
-	return static_cast<uint32_t>(GetCurrentThreadId());
-#elif defined(PLATFORM_IS_UNIX)
-	return static_cast<uint32_t>(syscall(SYS_gettid));
-#elif defined(PLATFORM_IS_APPLE)
-	uint64_t tid = 0;
-	pthread_threadid_np(nullptr, &tid);
-	return static_cast<uint32_t>(tid);
+	AssertDebug(count <= SRWLOCK_WAIT_ANY_MAX);
+
+	size_t *lockHandles[SRWLOCK_WAIT_ANY_MAX];
+	for (size_t i = 0; i < count; ++i)
+		lockHandles[i] = ppLocks[i]->native_handle();
+
+	size_t idx = SRWLock_LockSharedAny(lockHandles, count, microsecs);
+	if (idx != -1)
+		SRWLOCK_WATCH_ACQUIRE(lockHandles[idx], true);
+	return idx;
+}
 #endif
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWAdaptiveLock::try_lock()
+{
+	if (!SRWLock_TryLock(&LockStatus_))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, false);
+	return true;
+}
+
+void SRWAdaptiveLock::lock()
+{
+	SRWLock_LockAdaptive(&LockStatus_, &SpinEstimate_);
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, false);
+}
+
+void SRWAdaptiveLock::unlock()
+{
+	SRWLOCK_WATCH_RELEASE(&LockStatus_);
+	SRWLock_Unlock(&LockStatus_);
+}
+
+bool SRWAdaptiveLock::try_lock_shared()
+{
+	if (!SRWLock_TryLockShared(&LockStatus_))
+		return false;
+
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+	return true;
+}
+
+void SRWAdaptiveLock::lock_shared()
+{
+	SRWLock_LockSharedAdaptive(&LockStatus_, &SpinEstimate_);
+	SRWLOCK_WATCH_ACQUIRE(&LockStatus_, true);
+}
+
+void SRWAdaptiveLock::unlock_shared()
+{
+	SRWLOCK_WATCH_RELEASE(&LockStatus_);
+	SRWLock_UnlockShared(&LockStatus_);
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWHandoffLock::try_lock()
+{
+	return SRWLock_TryLock(&LockStatus_);
+}
+
+void SRWHandoffLock::lock()
+{
+	SRWLock_LockHandoff(&LockStatus_, &Starving_, Threshold_);
+}
+
+void SRWHandoffLock::unlock()
+{
+	SRWLock_UnlockHandoff(&LockStatus_, &Starving_);
 }
 
 //////////////////////////////////////////////////////////////////////////
+// 其他线程可能同时读取持有者 ID, 只有持有者本身会读到自己的 ID, 因此无需顺序约束
 void SRWRecLock::lock()
 {
-	uint32_t currTID = GetThreadIDImpl();
+	uint32_t currTID = GetCurrentThreadID();
 
-	if (ThreadID_ != currTID)
+	if (Atomic::LoadRelaxed(&ThreadID_) != currTID)
 		Lock_.lock();
 
 	if (++RecCount_ == 1)
-		ThreadID_ = currTID;
+		Atomic::StoreRelaxed(&ThreadID_, currTID);
 }
 
 bool SRWRecLock::try_lock()
 {
-	uint32_t currTID = GetThreadIDImpl();
+	uint32_t currTID = GetCurrentThreadID();
 
 	bool isAcquired;
-	if (ThreadID_ != currTID)
+	if (Atomic::LoadRelaxed(&ThreadID_) != currTID)
 		isAcquired = Lock_.try_lock();
 	else
 		isAcquired = true;
@@ -419,7 +1794,7 @@ bool SRWRecLock::try_lock()
 	if (isAcquired)
 	{
 		if (++RecCount_ == 1)
-			ThreadID_ = currTID;
+			Atomic::StoreRelaxed(&ThreadID_, currTID);
 	}
 
 	return isAcquired;
@@ -429,11 +1804,153 @@ void SRWRecLock::unlock()
 {
 	AssertDebug(
 		RecCount_ >= 1 &&
-		ThreadID_ == GetThreadIDImpl());
+		ThreadID_ == GetCurrentThreadID());
+
+	if (--RecCount_ == 0)
+	{
+		Atomic::StoreRelaxed<uint32_t>(&ThreadID_, -1);
+		Lock_.unlock();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 线程以共享方式进入的可重入读写锁
+struct RecSharedEntry
+{
+	const SRWRecSharedLock *Lock;
+	uint32_t Depth;
+	// 是否实际持有共享锁. 持有独占时进入的共享不持有
+	bool IsHeldShared;
+};
+
+static thread_local RecSharedEntry s_RecSharedEntries[SRWLOCK_REC_SHARED_MAX];
+static thread_local uint32_t s_RecSharedCount = 0;
+
+// 从最近进入的开始查找, 通常只有一两项
+static RecSharedEntry* FindRecSharedEntry(const SRWRecSharedLock *pLock)
+{
+	for (uint32_t i = s_RecSharedCount; i > 0; --i)
+	{
+		if (s_RecSharedEntries[i - 1].Lock == pLock)
+			return &s_RecSharedEntries[i - 1];
+	}
+	return nullptr;
+}
+
+static void AddRecSharedEntry(const SRWRecSharedLock *pLock, bool isHeldShared)
+{
+	Assert(s_RecSharedCount < SRWLOCK_REC_SHARED_MAX);
+	s_RecSharedEntries[s_RecSharedCount++] = { pLock, 1, isHeldShared };
+}
+
+static void RemoveRecSharedEntry(RecSharedEntry *pEntry)
+{
+	*pEntry = s_RecSharedEntries[--s_RecSharedCount];
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SRWRecSharedLock::lock()
+{
+	uint32_t currTID = GetCurrentThreadID();
+
+	if (Atomic::LoadRelaxed(&ThreadID_) != currTID)
+	{
+		// 持有共享时请求独占会死锁
+		AssertDebug(!FindRecSharedEntry(this));
+		Lock_.lock();
+	}
+
+	if (++RecCount_ == 1)
+		Atomic::StoreRelaxed(&ThreadID_, currTID);
+}
+
+bool SRWRecSharedLock::try_lock()
+{
+	uint32_t currTID = GetCurrentThreadID();
+
+	bool isAcquired;
+	if (Atomic::LoadRelaxed(&ThreadID_) != currTID)
+		isAcquired = Lock_.try_lock();
+	else
+		isAcquired = true;
+
+	if (isAcquired)
+	{
+		if (++RecCount_ == 1)
+			Atomic::StoreRelaxed(&ThreadID_, currTID);
+	}
+
+	return isAcquired;
+}
+
+void SRWRecSharedLock::unlock()
+{
+	AssertDebug(
+		RecCount_ >= 1 &&
+		ThreadID_ == GetCurrentThreadID());
 
 	if (--RecCount_ == 0)
 	{
-		ThreadID_ = -1;
+		// 持有独占时进入的共享需先退出
+		AssertDebug(!FindRecSharedEntry(this));
+		Atomic::StoreRelaxed<uint32_t>(&ThreadID_, -1);
 		Lock_.unlock();
 	}
 }
+
+void SRWRecSharedLock::lock_shared()
+{
+	RecSharedEntry *pEntry = FindRecSharedEntry(this);
+	if (pEntry)
+	{
+		++pEntry->Depth;
+		return;
+	}
+
+	// 持有独占时直接进入
+	if (Atomic::LoadRelaxed(&ThreadID_) == GetCurrentThreadID())
+	{
+		AddRecSharedEntry(this, false);
+		return;
+	}
+
+	Lock_.lock_shared();
+	AddRecSharedEntry(this, true);
+}
+
+bool SRWRecSharedLock::try_lock_shared()
+{
+	RecSharedEntry *pEntry = FindRecSharedEntry(this);
+	if (pEntry)
+	{
+		++pEntry->Depth;
+		return true;
+	}
+
+	if (Atomic::LoadRelaxed(&ThreadID_) == GetCurrentThreadID())
+	{
+		AddRecSharedEntry(this, false);
+		return true;
+	}
+
+	if (!Lock_.try_lock_shared())
+		return false;
+
+	AddRecSharedEntry(this, true);
+	return true;
+}
+
+void SRWRecSharedLock::unlock_shared()
+{
+	RecSharedEntry *pEntry = FindRecSharedEntry(this);
+	AssertDebug(pEntry);
+
+	if (--pEntry->Depth)
+		return;
+
+	bool isHeldShared = pEntry->IsHeldShared;
+	RemoveRecSharedEntry(pEntry);
+
+	if (isHeldShared)
+		Lock_.unlock_shared();
+}
@@ -1,9 +1,33 @@
 ﻿#pragma once
 
 #include "Predefines.hpp"
+#include "SRWLockStats.hpp"
+
+#if defined(__has_include)
+#  if __has_include(<version>)
+#    include <version>
+#  endif
+#endif
+
+#if defined(__cpp_lib_jthread)
+#  include <stop_token>
+// 支持以 std::stop_token 取消等待
+#  define SRWLOCK_HAS_STOP_TOKEN 1
+#endif
+
+#if !defined(PLATFORM_IS_WINDOWS)
+// 支持同时等待多个对象. Windows 的键控事件无法同时等待多个键
+#  define SRWLOCK_HAS_WAIT_ANY 1
+// 同时等待的对象个数上限
+static const size_t SRWLOCK_WAIT_ANY_MAX = 64;
+#endif
 
 //////////////////////////////////////////////////////////////////////////
 void SRWLock_Init();
+// 退让指令的周期数. 启动时测量得到, 用于计算自旋和退让次数
+uint32_t SRWLock_GetCyclesPerYield();
+// 覆盖测量值, 为 0 时重新测量
+void SRWLock_SetCyclesPerYield(uint32_t cycles);
 
 bool SRWLock_TryLock(size_t *pLockStatus);
 void SRWLock_Lock(size_t *pLockStatus);
@@ -12,31 +36,214 @@ bool SRWLock_TryLockShared(size_t *pLockStatus);
 void SRWLock_LockShared(size_t *pLockStatus);
 void SRWLock_UnlockShared(size_t *pLockStatus);
 
+// 限时加锁, 返回是否成功. 超时为微秒, 截止时间基于 GetTickMicrosec
+bool SRWLock_LockFor(size_t *pLockStatus, uint64_t microsecs);
+bool SRWLock_LockUntil(size_t *pLockStatus, uint64_t deadline);
+bool SRWLock_LockSharedFor(size_t *pLockStatus, uint64_t microsecs);
+bool SRWLock_LockSharedUntil(size_t *pLockStatus, uint64_t deadline);
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+// 可取消加锁, 返回是否成功. 停止请求到达时等待者出队并返回 false.
+// 多个共享者持有锁时以轮询代替排队
+bool SRWLock_LockCancellable(size_t *pLockStatus, const std::stop_token &token);
+bool SRWLock_LockSharedCancellable(size_t *pLockStatus, const std::stop_token &token);
+#endif
+
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+// 同时等待多个锁, 返回加锁成功的序号, 超时返回 -1. 微秒超时, 为 -1 时无限等待
+size_t SRWLock_LockAny(size_t *const *ppLockStatus, size_t count, uint64_t microsecs);
+size_t SRWLock_LockSharedAny(size_t *const *ppLockStatus, size_t count, uint64_t microsecs);
+#endif
+
+// 自适应自旋加锁. pSpinEstimate 为每个锁独立的自旋估计值, 初始为 -1
+void SRWLock_LockAdaptive(size_t *pLockStatus, uint32_t *pSpinEstimate);
+void SRWLock_LockSharedAdaptive(size_t *pLockStatus, uint32_t *pSpinEstimate);
+
+// 防饥饿加锁, 只支持独占. pStarving 为每个锁独立的饥饿标记, 初始为 0.
+// 被唤醒的等待者累计等待超过 threshold 微秒后进入饥饿模式, 解锁时直接移交所有权, 等待链表清空后恢复抢占
+void SRWLock_LockHandoff(size_t *pLockStatus, uint32_t *pStarving, uint64_t threshold);
+void SRWLock_UnlockHandoff(size_t *pLockStatus, uint32_t *pStarving);
+
+// 可升级加锁. 与共享者共存, 但同一时间只有一个升级者
+bool SRWLock_TryLockUpgrade(size_t *pLockStatus);
+void SRWLock_LockUpgrade(size_t *pLockStatus);
+void SRWLock_UnlockUpgrade(size_t *pLockStatus);
+// 升级为独占. 等待其他共享者释放, 期间不会有其他独占者获得锁
+void SRWLock_Upgrade(size_t *pLockStatus);
+// 可升级转为共享
+void SRWLock_UpgradeToShared(size_t *pLockStatus);
+// 独占降级为共享. 存在等待者时保持排队顺序, 等待者在释放后被唤醒
+void SRWLock_Downgrade(size_t *pLockStatus);
+
 //////////////////////////////////////////////////////////////////////////
 class SRWLock
 {
 public:
 	SRWLock() = default;
+#if defined(SRWLOCK_ENABLE_STATS)
+	~SRWLock()
+	{
+		SRWStats_Remove(&LockStatus_);
+	}
+#endif
 	SRWLock(const SRWLock &) = delete;
 	SRWLock(SRWLock &&) = delete;
 
 	bool try_lock();
 	void lock();
 	void unlock();
+	// 限时加锁, 微秒超时. 多个共享者持有锁时以轮询代替排队
+	bool try_lock_for(uint64_t microsecs);
+	bool try_lock_until(uint64_t deadline);
 
 	bool try_lock_shared();
 	void lock_shared();
 	void unlock_shared();
+	bool try_lock_shared_for(uint64_t microsecs);
+	bool try_lock_shared_until(uint64_t deadline);
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+	// 可取消加锁, 停止请求到达时返回 false
+	bool lock(const std::stop_token &token);
+	bool lock_shared(const std::stop_token &token);
+#endif
+
+	// 可升级加锁, 与共享者共存
+	bool try_lock_upgrade();
+	void lock_upgrade();
+	void unlock_upgrade();
+	// 升级与降级, 转换期间不会有其他独占者获得锁
+	void unlock_upgrade_and_lock();
+	void unlock_upgrade_and_lock_shared();
+	void unlock_and_lock_shared();
+
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+	// 同时等待多个锁, 返回加锁成功的序号, 超时返回 -1
+	static size_t lock_any(SRWLock *const *ppLocks, size_t count, uint64_t microsecs = -1);
+	static size_t lock_shared_any(SRWLock *const *ppLocks, size_t count, uint64_t microsecs = -1);
+#endif
 
 	size_t* native_handle()
 	{
 		return &LockStatus_;
 	}
 
+#if defined(SRWLOCK_ENABLE_STATS)
+	SRWLockStats stats() const
+	{
+		SRWLockStats result;
+		SRWStats_Get(&LockStatus_, &result);
+		return result;
+	}
+
+	void reset_stats()
+	{
+		SRWStats_Reset(&LockStatus_);
+	}
+#endif
+
 private:
 	size_t LockStatus_ = 0;
 };
 
+//////////////////////////////////////////////////////////////////////////
+// 自适应自旋锁. 记录最近等待时长的平滑估计值, 据此决定等待者睡眠前的自旋次数
+class SRWAdaptiveLock
+{
+public:
+	SRWAdaptiveLock() = default;
+#if defined(SRWLOCK_ENABLE_STATS)
+	~SRWAdaptiveLock()
+	{
+		SRWStats_Remove(&LockStatus_);
+	}
+#endif
+	SRWAdaptiveLock(const SRWAdaptiveLock &) = delete;
+	SRWAdaptiveLock(SRWAdaptiveLock &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+	bool try_lock_shared();
+	void lock_shared();
+	void unlock_shared();
+
+	// 当前自旋估计值, 尚未采样时为 -1
+	uint32_t spin_estimate() const
+	{
+		return SpinEstimate_;
+	}
+
+	size_t* native_handle()
+	{
+		return &LockStatus_;
+	}
+
+	uint32_t* spin_handle()
+	{
+		return &SpinEstimate_;
+	}
+
+#if defined(SRWLOCK_ENABLE_STATS)
+	SRWLockStats stats() const
+	{
+		SRWLockStats result;
+		SRWStats_Get(&LockStatus_, &result);
+		return result;
+	}
+
+	void reset_stats()
+	{
+		SRWStats_Reset(&LockStatus_);
+	}
+#endif
+
+private:
+	size_t LockStatus_ = 0;
+	uint32_t SpinEstimate_ = -1;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 防饥饿独占锁. 正常模式下允许抢占, 等待者饥饿时按先后顺序直接移交所有权
+class SRWHandoffLock
+{
+public:
+	// 饥饿阈值, 微秒
+	explicit SRWHandoffLock(uint64_t threshold = 1000)
+		: Threshold_(threshold)
+	{
+	}
+
+#if defined(SRWLOCK_ENABLE_STATS)
+	~SRWHandoffLock()
+	{
+		SRWStats_Remove(&LockStatus_);
+	}
+#endif
+	SRWHandoffLock(const SRWHandoffLock &) = delete;
+	SRWHandoffLock(SRWHandoffLock &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+	bool is_starving() const
+	{
+		return Starving_ != 0;
+	}
+
+	size_t* native_handle()
+	{
+		return &LockStatus_;
+	}
+
+private:
+	size_t LockStatus_ = 0;
+	uint32_t Starving_ = 0;
+	uint64_t Threshold_;
+};
+
 //////////////////////////////////////////////////////////////////////////
 class SRWRecLock
 {
@@ -50,3 +257,31 @@ private:
 	uint32_t ThreadID_ = -1;
 	uint32_t RecCount_ = 0;
 };
+
+//////////////////////////////////////////////////////////////////////////
+// 每个线程同时以共享方式持有的可重入读写锁个数上限
+static const uint32_t SRWLOCK_REC_SHARED_MAX = 16;
+
+// 可重入读写锁. 独占可重入, 共享可重入, 持有独占时可再以共享方式进入.
+// 共享嵌套深度记录在线程局部存储中, 嵌套加锁不访问锁状态, 不会被排队的写者阻塞.
+// 不支持持有共享时再请求独占
+class SRWRecSharedLock
+{
+public:
+	SRWRecSharedLock() = default;
+	SRWRecSharedLock(const SRWRecSharedLock &) = delete;
+	SRWRecSharedLock(SRWRecSharedLock &&) = delete;
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+	void lock_shared();
+	bool try_lock_shared();
+	void unlock_shared();
+
+private:
+	SRWLock Lock_;
+	uint32_t ThreadID_ = -1;
+	uint32_t RecCount_ = 0;
+};
@@ -0,0 +1,251 @@
+﻿#include "SRWLock32.hpp"
+#include "SRWLock.hpp"
+#include "WaitEvent.hpp"
+#include "Atomic.hpp"
+#include "DebugLog.hpp"
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+// 锁状态
+static const uint32_t L32_LOCKED = 0x1;
+// 等待表中存在该锁的等待者
+static const uint32_t L32_PARKED = 0x2;
+static const uint32_t L32_SHARED = 0x4;
+
+// 多核时等待前的自旋次数
+static const uint32_t L32_SPIN_COUNT = 128;
+
+// 等待表桶个数
+static const uint32_t L32_BUCKET_COUNT = 256;
+
+// 等待节点, 位于等待者栈上
+struct Lock32WaitNode
+{
+	WaitEvent Event;
+	const uint32_t *pKey = nullptr;
+	Lock32WaitNode *Next = nullptr;
+	bool IsExclusive = false;
+};
+
+// 等待表桶, 按锁地址散列, 多个锁共用一个桶
+struct alignas(64) Lock32Bucket
+{
+	SRWLock Mutex;
+	Lock32WaitNode *Head = nullptr;
+	Lock32WaitNode *Tail = nullptr;
+};
+
+static Lock32Bucket g_Lock32Buckets[L32_BUCKET_COUNT];
+
+static Lock32Bucket& GetBucket(const uint32_t *pKey)
+{
+	uint32_t hash = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pKey) >> 2) * 0x9E3779B9u;
+	return g_Lock32Buckets[hash >> 24];
+}
+
+static bool IsMultiCore()
+{
+	static const bool s_IsMultiCore = std::thread::hardware_concurrency() > 1;
+	return s_IsMultiCore;
+}
+
+static uint32_t LoadValue(const uint32_t &value)
+{
+	return static_cast<volatile const uint32_t&>(value);
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWLock32::try_lock()
+{
+	return Atomic::CompareExchange<uint32_t>(&LockStatus_, 0, L32_LOCKED) == 0;
+}
+
+void SRWLock32::lock()
+{
+	if (PLATFORM_LIKELY(try_lock()))
+		return;
+
+	LockSlow(true);
+}
+
+void SRWLock32::unlock()
+{
+	if (PLATFORM_LIKELY(Atomic::CompareExchange<uint32_t>(&LockStatus_, L32_LOCKED, 0) == L32_LOCKED))
+		return;
+
+	UnlockSlow(true);
+}
+
+bool SRWLock32::try_lock_shared()
+{
+	uint32_t lastStatus = LoadValue(LockStatus_);
+
+	// 存在等待者时不再增加共享者, 避免独占者饥饿
+	while (!(lastStatus & (L32_LOCKED | L32_PARKED)))
+	{
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, lastStatus + L32_SHARED);
+		if (currStatus == lastStatus)
+			return true;
+
+		lastStatus = currStatus;
+	}
+	return false;
+}
+
+void SRWLock32::lock_shared()
+{
+	if (PLATFORM_LIKELY(try_lock_shared()))
+		return;
+
+	LockSlow(false);
+}
+
+void SRWLock32::unlock_shared()
+{
+	uint32_t lastStatus = LoadValue(LockStatus_);
+
+	// 最后一个共享者需要向等待者移交
+	while (lastStatus >= L32_SHARED * 2 || !(lastStatus & L32_PARKED))
+	{
+		AssertDebug(lastStatus >= L32_SHARED);
+
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, lastStatus - L32_SHARED);
+		if (currStatus == lastStatus)
+			return;
+
+		lastStatus = currStatus;
+	}
+
+	UnlockSlow(false);
+}
+
+void SRWLock32::LockSlow(bool isExclusive)
+{
+	if (IsMultiCore())
+	{
+		for (uint32_t i = 0; i < L32_SPIN_COUNT; ++i)
+		{
+			PLATFORM_YIELD;
+			if (isExclusive ? try_lock() : try_lock_shared())
+				return;
+		}
+	}
+
+	Lock32Bucket &bucket = GetBucket(&LockStatus_);
+	Lock32WaitNode node;
+	node.pKey = &LockStatus_;
+	node.IsExclusive = isExclusive;
+
+	bucket.Mutex.lock();
+
+	// 等待标记只在桶锁内修改, 设置成功后解锁者必然在桶内找到该节点
+	uint32_t lastStatus = LoadValue(LockStatus_);
+	for (;;)
+	{
+		bool isLocked;
+		uint32_t newStatus;
+		if (isExclusive)
+		{
+			isLocked = lastStatus == 0;
+			newStatus = isLocked ? L32_LOCKED : lastStatus | L32_PARKED;
+		}
+		else
+		{
+			isLocked = !(lastStatus & (L32_LOCKED | L32_PARKED));
+			newStatus = isLocked ? lastStatus + L32_SHARED : lastStatus | L32_PARKED;
+		}
+
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, newStatus);
+		if (currStatus == lastStatus)
+		{
+			if (isLocked)
+			{
+				bucket.Mutex.unlock();
+				return;
+			}
+			break;
+		}
+
+		lastStatus = currStatus;
+	}
+
+	if (bucket.Tail)
+		bucket.Tail->Next = &node;
+	else
+		bucket.Head = &node;
+	bucket.Tail = &node;
+
+	bucket.Mutex.unlock();
+
+	// 被唤醒时解锁者已代为加锁
+	node.Event.WaitMicrosec();
+}
+
+void SRWLock32::UnlockSlow(bool isExclusive)
+{
+	Lock32WaitNode *grantHead = nullptr;
+	Lock32WaitNode **ppGrantTail = &grantHead;
+	uint32_t grantShared = 0;
+	bool isGrantExclusive = false;
+	bool hasMore = false;
+
+	Lock32Bucket &bucket = GetBucket(&LockStatus_);
+	bucket.Mutex.lock();
+
+	AssertDebug(isExclusive ?
+		(LoadValue(LockStatus_) & L32_LOCKED) :
+		(LoadValue(LockStatus_) & ~L32_PARKED) == L32_SHARED);
+	(void)isExclusive;
+
+	// 移交给最早的独占等待者, 或者排在下一个独占等待者之前的全部共享等待者
+	Lock32WaitNode *pPrev = nullptr;
+	for (Lock32WaitNode *pNode = bucket.Head; pNode;)
+	{
+		Lock32WaitNode *pNext = pNode->Next;
+		if (pNode->pKey != &LockStatus_)
+		{
+			pPrev = pNode;
+			pNode = pNext;
+			continue;
+		}
+
+		if (isGrantExclusive || (pNode->IsExclusive && grantShared))
+		{
+			hasMore = true;
+			break;
+		}
+
+		if (pPrev)
+			pPrev->Next = pNext;
+		else
+			bucket.Head = pNext;
+		if (bucket.Tail == pNode)
+			bucket.Tail = pPrev;
+
+		pNode->Next = nullptr;
+		*ppGrantTail = pNode;
+		ppGrantTail = &pNode->Next;
+
+		if (pNode->IsExclusive)
+			isGrantExclusive = true;
+		else
+			++grantShared;
+
+		pNode = pNext;
+	}
+
+	// 此时等待标记已阻止其他线程修改状态
+	uint32_t newStatus = isGrantExclusive ? L32_LOCKED : grantShared * L32_SHARED;
+	if (hasMore)
+		newStatus |= L32_PARKED;
+	Atomic::Exchange<uint32_t>(&LockStatus_, newStatus);
+
+	bucket.Mutex.unlock();
+
+	while (grantHead)
+	{
+		Lock32WaitNode *pNext = grantHead->Next;
+		grantHead->Event.WakeUp();
+		grantHead = pNext;
+	}
+}
@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include "Predefines.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 4 字节读写锁, 适合大量嵌入到小对象中.
+// 锁状态只保存锁定位, 等待标记和共享计数, 等待者按锁地址挂在全局等待表中,
+// 解锁时直接将所有权移交给等待者
+class SRWLock32
+{
+public:
+	SRWLock32() = default;
+	SRWLock32(const SRWLock32 &) = delete;
+	SRWLock32(SRWLock32 &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+	bool try_lock_shared();
+	void lock_shared();
+	void unlock_shared();
+
+private:
+	void LockSlow(bool isExclusive);
+	void UnlockSlow(bool isExclusive);
+
+private:
+	// 锁定位, 等待标记, 共享计数
+	uint32_t LockStatus_ = 0;
+};
@@ -0,0 +1,212 @@
+﻿#pragma once
+
+#include "SRWLock.hpp"
+#include <memory>
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////////
+// 分段锁的内存布局
+enum class SRWStripeLayout
+{
+	// 紧密排列, 相邻分段共享缓存行
+	Packed,
+	// 每个分段独占缓存行, 消除伪共享
+	CacheLine,
+	// 每个分段独占内存页, 可由系统按页放置到访问者所在的 NUMA 节点
+	NumaNode,
+};
+
+static constexpr size_t SRWStripeAlign(SRWStripeLayout layout, size_t lockAlign)
+{
+	return layout == SRWStripeLayout::Packed ? lockAlign :
+		layout == SRWStripeLayout::CacheLine ? 64 : 4096;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 分段锁表. 按键的哈希值映射到其中一个分段, 分段数向上取整到 2 的幂.
+// 同时锁定多个分段时按地址顺序加锁, 不会互相死锁
+template <class TLock = SRWLock, SRWStripeLayout Layout = SRWStripeLayout::CacheLine>
+class SRWLockArray
+{
+	struct alignas(SRWStripeAlign(Layout, alignof(TLock))) Stripe
+	{
+		TLock Lock;
+	};
+
+public:
+	explicit SRWLockArray(size_t stripeCount = 64)
+	{
+		size_t count = 1;
+		while (count < stripeCount)
+			count <<= 1;
+
+		Mask_ = count - 1;
+		Stripes_.reset(new Stripe[count]);
+	}
+
+	SRWLockArray(const SRWLockArray &) = delete;
+	SRWLockArray(SRWLockArray &&) = delete;
+
+	size_t size() const
+	{
+		return Mask_ + 1;
+	}
+
+	// 哈希值对应的分段序号. 先混合哈希值, 避免低位相同的键集中到同一分段
+	size_t index_of(size_t hash) const
+	{
+		uint64_t mixed = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+		return static_cast<size_t>(mixed >> 32) & Mask_;
+	}
+
+	TLock& stripe(size_t idx)
+	{
+		return Stripes_[idx].Lock;
+	}
+
+	TLock& stripe_of(size_t hash)
+	{
+		return stripe(index_of(hash));
+	}
+
+	bool try_lock(size_t hash)
+	{
+		return stripe_of(hash).try_lock();
+	}
+
+	void lock(size_t hash)
+	{
+		stripe_of(hash).lock();
+	}
+
+	void unlock(size_t hash)
+	{
+		stripe_of(hash).unlock();
+	}
+
+	bool try_lock_shared(size_t hash)
+	{
+		return stripe_of(hash).try_lock_shared();
+	}
+
+	void lock_shared(size_t hash)
+	{
+		stripe_of(hash).lock_shared();
+	}
+
+	void unlock_shared(size_t hash)
+	{
+		stripe_of(hash).unlock_shared();
+	}
+
+	// 锁定多个键所在的分段, 相同分段只锁定一次.
+	// pIndices 至少容纳 count 个元素, 返回时保存已锁定的分段序号, 返回值为分段个数
+	size_t lock_many(const size_t *pHashes, size_t count, size_t *pIndices)
+	{
+		size_t num = SortIndices(pHashes, count, pIndices);
+		for (size_t i = 0; i < num; ++i)
+			stripe(pIndices[i]).lock();
+		return num;
+	}
+
+	void unlock_many(const size_t *pIndices, size_t num)
+	{
+		for (size_t i = num; i > 0; --i)
+			stripe(pIndices[i - 1]).unlock();
+	}
+
+	size_t lock_many_shared(const size_t *pHashes, size_t count, size_t *pIndices)
+	{
+		size_t num = SortIndices(pHashes, count, pIndices);
+		for (size_t i = 0; i < num; ++i)
+			stripe(pIndices[i]).lock_shared();
+		return num;
+	}
+
+	void unlock_many_shared(const size_t *pIndices, size_t num)
+	{
+		for (size_t i = num; i > 0; --i)
+			stripe(pIndices[i - 1]).unlock_shared();
+	}
+
+	// 锁定全部分段, 用于扩容等整表操作
+	void lock_all()
+	{
+		for (size_t i = 0; i <= Mask_; ++i)
+			stripe(i).lock();
+	}
+
+	void unlock_all()
+	{
+		for (size_t i = Mask_ + 1; i > 0; --i)
+			stripe(i - 1).unlock();
+	}
+
+	// 共享锁定全部分段, 用于遍历和统计等只读的整表操作
+	void lock_all_shared()
+	{
+		for (size_t i = 0; i <= Mask_; ++i)
+			stripe(i).lock_shared();
+	}
+
+	void unlock_all_shared()
+	{
+		for (size_t i = Mask_ + 1; i > 0; --i)
+			stripe(i - 1).unlock_shared();
+	}
+
+private:
+	// 分段连续存放, 序号顺序即地址顺序
+	size_t SortIndices(const size_t *pHashes, size_t count, size_t *pIndices) const
+	{
+		for (size_t i = 0; i < count; ++i)
+			pIndices[i] = index_of(pHashes[i]);
+
+		std::sort(pIndices, pIndices + count);
+		return std::unique(pIndices, pIndices + count) - pIndices;
+	}
+
+private:
+	std::unique_ptr<Stripe[]> Stripes_;
+	size_t Mask_ = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 整表锁定的 RAII 封装
+template <class TArray>
+class LockAllGuard
+{
+public:
+	explicit LockAllGuard(TArray &arr)
+		: Array_(arr)
+	{
+		Array_.lock_all();
+	}
+
+	~LockAllGuard()
+	{
+		Array_.unlock_all();
+	}
+
+private:
+	TArray &Array_;
+};
+
+template <class TArray>
+class SharedLockAllGuard
+{
+public:
+	explicit SharedLockAllGuard(TArray &arr)
+		: Array_(arr)
+	{
+		Array_.lock_all_shared();
+	}
+
+	~SharedLockAllGuard()
+	{
+		Array_.unlock_all_shared();
+	}
+
+private:
+	TArray &Array_;
+};
@@ -0,0 +1,216 @@
+﻿#include "SRWLockRegistry.hpp"
+
+#if defined(SRWLOCK_ENABLE_STATS)
+#include <stdlib.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+//////////////////////////////////////////////////////////////////////////
+struct RegistryEntry
+{
+	std::string Name;
+	std::string Category;
+};
+
+struct LockRegistry
+{
+	std::mutex Mutex;
+	std::unordered_map<const void*, RegistryEntry> Entries;
+
+	static LockRegistry& Get()
+	{
+		// 不析构, 退出时输出报告可能晚于静态对象析构
+		static LockRegistry *s_Registry = new LockRegistry();
+		return *s_Registry;
+	}
+};
+
+// 所有已登记对象的报告, 按指定顺序降序排列
+static std::vector<SRWLockReport> CollectReports(SRWReportOrder order)
+{
+	std::vector<SRWLockReport> reports;
+	{
+		LockRegistry &registry = LockRegistry::Get();
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+
+		reports.reserve(registry.Entries.size());
+		for (const auto &item : registry.Entries)
+		{
+			SRWLockReport report = {};
+			report.Key = item.first;
+			snprintf(report.Name, sizeof(report.Name), "%s", item.second.Name.c_str());
+			snprintf(report.Category, sizeof(report.Category), "%s", item.second.Category.c_str());
+			reports.push_back(report);
+		}
+	}
+
+	// 统计数据在登记表的锁之外合并
+	for (SRWLockReport &report : reports)
+		SRWStats_Get(report.Key, &report.Stats);
+
+	std::stable_sort(reports.begin(), reports.end(), [order](const SRWLockReport &lhs, const SRWLockReport &rhs)
+	{
+		switch (order)
+		{
+		case REPORT_BY_CONTENDED_RATIO:
+			return lhs.ContendedRatio() > rhs.ContendedRatio();
+		case REPORT_BY_MAX_QUEUE:
+			return lhs.Stats.MaxQueueLength > rhs.Stats.MaxQueueLength;
+		default:
+			return lhs.Stats.WaitNanosec > rhs.Stats.WaitNanosec;
+		}
+	});
+
+	return reports;
+}
+
+static uint64_t AverageWaitMicrosec(const SRWLockStats &stats)
+{
+	return stats.ContendedAcquisitions ? stats.WaitNanosec / stats.ContendedAcquisitions / 1000 : 0;
+}
+
+// 输出 JSON 字符串, 转义引号, 反斜杠与控制字符
+static void PrintJsonString(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; *str; ++str)
+	{
+		unsigned char ch = *str;
+		if (ch == '"' || ch == '\\')
+			fprintf(fp, "\\%c", ch);
+		else if (ch < 0x20)
+			fprintf(fp, "\\u%04x", ch);
+		else
+			fputc(ch, fp);
+	}
+	fputc('"', fp);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SRWRegistry_Register(const void *pKey, const char *name, const char *category)
+{
+	LockRegistry &registry = LockRegistry::Get();
+	std::lock_guard<std::mutex> lk(registry.Mutex);
+
+	RegistryEntry &entry = registry.Entries[pKey];
+	entry.Name = name ? name : "";
+	entry.Category = category ? category : "";
+}
+
+void SRWRegistry_Unregister(const void *pKey)
+{
+	LockRegistry &registry = LockRegistry::Get();
+	std::lock_guard<std::mutex> lk(registry.Mutex);
+
+	registry.Entries.erase(pKey);
+}
+
+bool SRWRegistry_GetName(const void *pKey, char *pName, size_t size)
+{
+	LockRegistry &registry = LockRegistry::Get();
+	std::lock_guard<std::mutex> lk(registry.Mutex);
+
+	auto it = registry.Entries.find(pKey);
+	if (it == registry.Entries.end())
+		return false;
+
+	snprintf(pName, size, "%s", it->second.Name.c_str());
+	return true;
+}
+
+size_t SRWRegistry_Snapshot(SRWLockReport *pReports, size_t count, SRWReportOrder order)
+{
+	std::vector<SRWLockReport> reports = CollectReports(order);
+	std::copy_n(reports.begin(), std::min(count, reports.size()), pReports);
+	return reports.size();
+}
+
+void SRWRegistry_PrintTable(FILE *fp, SRWReportOrder order, size_t topN)
+{
+	std::vector<SRWLockReport> reports = CollectReports(order);
+	if (reports.size() > topN)
+		reports.resize(topN);
+
+	fprintf(fp, "%-32s %-16s %12s %12s %10s %12s %12s %9s %12s %12s\n",
+		"Name", "Category", "Acquired", "Contended", "Ratio%", "Wait(ms)", "AvgWait(us)", "MaxQueue", "Parks", "WakeUps");
+
+	for (const SRWLockReport &report : reports)
+	{
+		const SRWLockStats &stats = report.Stats;
+		fprintf(fp, "%-32s %-16s %12llu %12llu %10.2f %12.3f %12llu %9llu %12llu %12llu\n",
+			report.Name,
+			report.Category,
+			static_cast<unsigned long long>(stats.Acquisitions()),
+			static_cast<unsigned long long>(stats.ContendedAcquisitions),
+			report.ContendedRatio() * 100,
+			stats.WaitNanosec / 1000000.0,
+			static_cast<unsigned long long>(AverageWaitMicrosec(stats)),
+			static_cast<unsigned long long>(stats.MaxQueueLength),
+			static_cast<unsigned long long>(stats.Parks),
+			static_cast<unsigned long long>(stats.WakeUps));
+	}
+}
+
+void SRWRegistry_PrintJson(FILE *fp, SRWReportOrder order, size_t topN)
+{
+	std::vector<SRWLockReport> reports = CollectReports(order);
+	if (reports.size() > topN)
+		reports.resize(topN);
+
+	fputs("[", fp);
+	for (size_t i = 0; i < reports.size(); ++i)
+	{
+		const SRWLockReport &report = reports[i];
+		const SRWLockStats &stats = report.Stats;
+
+		fputs(i ? ",\n {\"name\": " : "\n {\"name\": ", fp);
+		PrintJsonString(fp, report.Name);
+		fputs(", \"category\": ", fp);
+		PrintJsonString(fp, report.Category);
+		fprintf(fp, ", \"fast\": %llu, \"contended\": %llu, \"contended_ratio\": %.4f, \"wait_ns\": %llu"
+			", \"max_queue\": %llu, \"spin_wins\": %llu, \"parks\": %llu, \"wake_ups\": %llu}",
+			static_cast<unsigned long long>(stats.FastAcquisitions),
+			static_cast<unsigned long long>(stats.ContendedAcquisitions),
+			report.ContendedRatio(),
+			static_cast<unsigned long long>(stats.WaitNanosec),
+			static_cast<unsigned long long>(stats.MaxQueueLength),
+			static_cast<unsigned long long>(stats.SpinWins),
+			static_cast<unsigned long long>(stats.Parks),
+			static_cast<unsigned long long>(stats.WakeUps));
+	}
+	fputs(reports.empty() ? "]\n" : "\n]\n", fp);
+}
+
+static SRWReportOrder s_ExitOrder;
+static size_t s_ExitTopN;
+static bool s_IsExitJson;
+
+static void ReportAtExit()
+{
+	if (s_IsExitJson)
+		SRWRegistry_PrintJson(stderr, s_ExitOrder, s_ExitTopN);
+	else
+		SRWRegistry_PrintTable(stderr, s_ExitOrder, s_ExitTopN);
+}
+
+// 多次调用时以最后一次的参数为准, 只输出一次
+void SRWRegistry_ReportAtExit(SRWReportOrder order, size_t topN, bool isJson)
+{
+	static std::once_flag s_Once;
+
+	LockRegistry &registry = LockRegistry::Get();
+	{
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+		s_ExitOrder = order;
+		s_ExitTopN = topN;
+		s_IsExitJson = isJson;
+	}
+
+	std::call_once(s_Once, []()
+	{
+		atexit(ReportAtExit);
+	});
+}
+#endif
@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include "SRWLockStats.hpp"
+#include <stdio.h>
+
+//////////////////////////////////////////////////////////////////////////
+// 锁的全局登记表. 为锁和条件变量命名并分类, 按竞争程度排序输出报告.
+// 依赖 SRWLOCK_ENABLE_STATS, 只在查询时访问, 不影响加锁路径
+#if defined(SRWLOCK_ENABLE_STATS)
+
+// 单个已登记对象的报告
+struct SRWLockReport
+{
+	const void *Key;
+	char Name[64];
+	char Category[32];
+	SRWLockStats Stats;
+
+	// 需要等待的获得次数占比
+	double ContendedRatio() const
+	{
+		uint64_t total = Stats.Acquisitions();
+		return total ? static_cast<double>(Stats.ContendedAcquisitions) / total : 0;
+	}
+};
+
+// 报告的排序依据, 均为降序
+enum SRWReportOrder
+{
+	REPORT_BY_WAIT_TIME,
+	REPORT_BY_CONTENDED_RATIO,
+	REPORT_BY_MAX_QUEUE,
+};
+
+// 以锁状态的地址登记, 重复登记时更新名称
+void SRWRegistry_Register(const void *pKey, const char *name, const char *category);
+void SRWRegistry_Unregister(const void *pKey);
+// 查询登记的名称, 未登记时返回 false
+bool SRWRegistry_GetName(const void *pKey, char *pName, size_t size);
+// 排序后写入最多 count 项, 返回已登记的个数
+size_t SRWRegistry_Snapshot(SRWLockReport *pReports, size_t count, SRWReportOrder order);
+// 输出前 topN 项
+void SRWRegistry_PrintTable(FILE *fp, SRWReportOrder order, size_t topN = -1);
+void SRWRegistry_PrintJson(FILE *fp, SRWReportOrder order, size_t topN = -1);
+// 进程退出时输出报告到 stderr
+void SRWRegistry_ReportAtExit(SRWReportOrder order, size_t topN = -1, bool isJson = false);
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// 在作用域内登记, 通常作为成员与锁放在一起. 未开启统计时为空操作
+class SRWLockRegistration
+{
+public:
+	template <class TLock>
+	SRWLockRegistration(TLock &lk, const char *name, const char *category = "")
+#if defined(SRWLOCK_ENABLE_STATS)
+		: Key_(lk.native_handle())
+	{
+		SRWRegistry_Register(Key_, name, category);
+	}
+#else
+	{
+		(void)lk;
+		(void)name;
+		(void)category;
+	}
+#endif
+
+	SRWLockRegistration(const SRWLockRegistration &) = delete;
+	SRWLockRegistration(SRWLockRegistration &&) = delete;
+
+#if defined(SRWLOCK_ENABLE_STATS)
+	~SRWLockRegistration()
+	{
+		SRWRegistry_Unregister(Key_);
+	}
+
+private:
+	const void *Key_;
+#endif
+};
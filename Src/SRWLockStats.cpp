@@ -0,0 +1,300 @@
+﻿#include "SRWLockStats.hpp"
+
+#if defined(SRWLOCK_ENABLE_STATS)
+#include "Atomic.hpp"
+#include "Utility.hpp"
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////////
+// 每个线程的分片容量
+static const size_t STAT_SHARD_CAPACITY = 512;
+// 线性探测的最大长度. 探测范围内没有空槽时换出其中一个槽到全局表
+static const size_t STAT_PROBE_LIMIT = 8;
+
+// 等待者计数的槽数. 按地址散列且不记录键, 散列冲突的锁同时竞争时队列长度偏大
+static const size_t STAT_QUEUE_SLOTS = 4096;
+static uint32_t s_QueueLength[STAT_QUEUE_SLOTS];
+
+static size_t HashStatKey(const void *pKey)
+{
+	return static_cast<size_t>((reinterpret_cast<uintptr_t>(pKey) >> 3) * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+static uint64_t CombineStat(size_t kind, uint64_t lhs, uint64_t rhs)
+{
+	if (kind == STAT_MAX_QUEUE)
+		return lhs > rhs ? lhs : rhs;
+	return lhs + rhs;
+}
+
+struct StatValues
+{
+	uint64_t Values[STAT_KIND_COUNT] = {};
+
+	void Merge(const StatValues &other)
+	{
+		for (size_t i = 0; i < STAT_KIND_COUNT; ++i)
+			Values[i] = CombineStat(i, Values[i], other.Values[i]);
+	}
+};
+
+struct StatSlot
+{
+	const void *Key;
+	StatValues Counters;
+
+	const void* LoadKey() const
+	{
+		return static_cast<const void *const volatile&>(Key);
+	}
+
+	// 清零后再释放键, 所属线程重新占用时计数已为零
+	void Clear()
+	{
+		for (uint64_t &value : Counters.Values)
+			Atomic::StoreRelaxed<uint64_t>(&value, 0);
+		Atomic::ThreadFenceRelease();
+		static_cast<const void *volatile&>(Key) = nullptr;
+	}
+};
+
+struct StatShard;
+
+// 线程的分片已析构, 之后的计数写入全局表
+static thread_local bool t_IsShardExited = false;
+
+// 所有线程的分片, 已退出线程与换出的计数, 以及清零时的基准值
+struct StatRegistry
+{
+	std::mutex Mutex;
+	std::vector<StatShard*> Shards;
+	std::unordered_map<const void*, StatValues> Retired;
+	std::unordered_map<const void*, StatValues> Baseline;
+
+	static StatRegistry& Get()
+	{
+		// 不析构, 线程局部分片可能晚于静态对象析构
+		static StatRegistry *s_Registry = new StatRegistry();
+		return *s_Registry;
+	}
+};
+
+// 线程局部分片. 只有所属线程写入, 其他线程合并时读取, 计数无需原子的读改写
+struct StatShard
+{
+	StatSlot Slots[STAT_SHARD_CAPACITY] = {};
+	// 下一次换出的探测位置
+	size_t EvictIndex = 0;
+
+	StatShard()
+	{
+		StatRegistry &registry = StatRegistry::Get();
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+		registry.Shards.push_back(this);
+	}
+
+	~StatShard()
+	{
+		StatRegistry &registry = StatRegistry::Get();
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+		registry.Shards.erase(std::find(registry.Shards.begin(), registry.Shards.end(), this));
+
+		for (StatSlot &slot : Slots)
+		{
+			if (slot.Key)
+				registry.Retired[slot.Key].Merge(slot.Counters);
+		}
+		t_IsShardExited = true;
+	}
+
+	// 按地址散列, 在有限范围内线性探测. 移除会留下空洞, 需查找完整个范围
+	StatSlot* Find(const void *pKey)
+	{
+		size_t idx = HashStatKey(pKey);
+		StatSlot *pEmpty = nullptr;
+		for (size_t i = 0; i < STAT_PROBE_LIMIT; ++i)
+		{
+			StatSlot &slot = GetSlot(idx, i);
+			const void *pCurr = slot.LoadKey();
+			if (pCurr == pKey)
+				return &slot;
+
+			if (!pCurr && !pEmpty)
+				pEmpty = &slot;
+		}
+
+		if (pEmpty)
+		{
+			// 计数先于键可见
+			Atomic::ThreadFenceRelease();
+			static_cast<const void *volatile&>(pEmpty->Key) = pKey;
+			return pEmpty;
+		}
+
+		// 换出时持有全局锁, 合并读取不会同时看到全局表和槽中的同一份计数
+		StatSlot &slot = GetSlot(idx, EvictIndex++ % STAT_PROBE_LIMIT);
+		StatRegistry &registry = StatRegistry::Get();
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+		registry.Retired[slot.Key].Merge(slot.Counters);
+		for (uint64_t &value : slot.Counters.Values)
+			Atomic::StoreRelaxed<uint64_t>(&value, 0);
+		static_cast<const void *volatile&>(slot.Key) = pKey;
+		return &slot;
+	}
+
+	StatSlot& GetSlot(size_t hash, size_t probe)
+	{
+		return Slots[(hash + probe) % STAT_SHARD_CAPACITY];
+	}
+};
+
+//////////////////////////////////////////////////////////////////////////
+void SRWStats_Add(const void *pKey, SRWStatKind kind, uint64_t value)
+{
+	if (PLATFORM_LIKELY(!t_IsShardExited))
+	{
+		static thread_local StatShard s_Shard;
+
+		uint64_t *pValue = &s_Shard.Find(pKey)->Counters.Values[kind];
+		Atomic::StoreRelaxed(pValue, CombineStat(kind, Atomic::LoadRelaxed(pValue), value));
+		return;
+	}
+
+	StatRegistry &registry = StatRegistry::Get();
+	std::lock_guard<std::mutex> lk(registry.Mutex);
+	uint64_t &counter = registry.Retired[pKey].Values[kind];
+	counter = CombineStat(kind, counter, value);
+}
+
+uint64_t SRWStats_BeginWait(const void *pKey)
+{
+	uint32_t length = Atomic::IncrementFetch(&s_QueueLength[HashStatKey(pKey) % STAT_QUEUE_SLOTS]);
+	SRWStats_Add(pKey, STAT_MAX_QUEUE, length);
+	return GetTickNanosec();
+}
+
+void SRWStats_EndWait(const void *pKey)
+{
+	Atomic::DecrementFetch(&s_QueueLength[HashStatKey(pKey) % STAT_QUEUE_SLOTS]);
+}
+
+uint32_t SRWStats_GetQueueLength(const void *pKey)
+{
+	return Atomic::LoadRelaxed(&s_QueueLength[HashStatKey(pKey) % STAT_QUEUE_SLOTS]);
+}
+
+void SRWStats_Acquired(const void *pKey, uint64_t startTime)
+{
+	SRWStats_Add(pKey, STAT_CONTENDED_ACQUIRE, 1);
+	SRWStats_Add(pKey, STAT_WAIT_NANOSEC, GetTickNanosec() - startTime);
+}
+
+void SRWStats_Get(const void *pKey, SRWLockStats *pStats)
+{
+	StatValues sum;
+	size_t idx = HashStatKey(pKey);
+	StatRegistry &registry = StatRegistry::Get();
+	{
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+
+		for (StatShard *pShard : registry.Shards)
+		{
+			for (size_t p = 0; p < STAT_PROBE_LIMIT; ++p)
+			{
+				StatSlot &slot = pShard->GetSlot(idx, p);
+				if (slot.LoadKey() != pKey)
+					continue;
+
+				Atomic::ThreadFenceAcquire();
+				for (size_t i = 0; i < STAT_KIND_COUNT; ++i)
+					sum.Values[i] = CombineStat(i, sum.Values[i], Atomic::LoadRelaxed(&slot.Counters.Values[i]));
+			}
+		}
+
+		auto it = registry.Retired.find(pKey);
+		if (it != registry.Retired.end())
+			sum.Merge(it->second);
+
+		it = registry.Baseline.find(pKey);
+		if (it != registry.Baseline.end())
+		{
+			for (size_t i = 0; i < STAT_KIND_COUNT; ++i)
+			{
+				if (i != STAT_MAX_QUEUE)
+					sum.Values[i] -= it->second.Values[i];
+			}
+		}
+	}
+
+	pStats->FastAcquisitions = sum.Values[STAT_FAST_ACQUIRE];
+	pStats->ContendedAcquisitions = sum.Values[STAT_CONTENDED_ACQUIRE];
+	pStats->SpinWins = sum.Values[STAT_SPIN_WIN];
+	pStats->Parks = sum.Values[STAT_PARK];
+	pStats->WakeUps = sum.Values[STAT_WAKE_UP];
+	pStats->WaitNanosec = sum.Values[STAT_WAIT_NANOSEC];
+	pStats->MaxQueueLength = sum.Values[STAT_MAX_QUEUE];
+}
+
+// 各线程的分片只能由所属线程累加, 清零时记录当前值作为基准.
+// 最大值无法扣除基准, 直接清零. 与所属线程的写入冲突时可能保留旧值
+void SRWStats_Reset(const void *pKey)
+{
+	SRWLockStats stats;
+	SRWStats_Get(pKey, &stats);
+
+	// 未使用过的地址不记录基准
+	if (stats.Acquisitions() == 0 && stats.SpinWins == 0 && stats.Parks == 0 &&
+		stats.WakeUps == 0 && stats.WaitNanosec == 0 && stats.MaxQueueLength == 0)
+		return;
+
+	size_t idx = HashStatKey(pKey);
+	StatRegistry &registry = StatRegistry::Get();
+	std::lock_guard<std::mutex> lk(registry.Mutex);
+
+	for (StatShard *pShard : registry.Shards)
+	{
+		for (size_t p = 0; p < STAT_PROBE_LIMIT; ++p)
+		{
+			StatSlot &slot = pShard->GetSlot(idx, p);
+			if (slot.LoadKey() == pKey)
+				Atomic::StoreRelaxed<uint64_t>(&slot.Counters.Values[STAT_MAX_QUEUE], 0);
+		}
+	}
+
+	auto it = registry.Retired.find(pKey);
+	if (it != registry.Retired.end())
+		it->second.Values[STAT_MAX_QUEUE] = 0;
+
+	StatValues &baseline = registry.Baseline[pKey];
+	baseline.Values[STAT_FAST_ACQUIRE] += stats.FastAcquisitions;
+	baseline.Values[STAT_CONTENDED_ACQUIRE] += stats.ContendedAcquisitions;
+	baseline.Values[STAT_SPIN_WIN] += stats.SpinWins;
+	baseline.Values[STAT_PARK] += stats.Parks;
+	baseline.Values[STAT_WAKE_UP] += stats.WakeUps;
+	baseline.Values[STAT_WAIT_NANOSEC] += stats.WaitNanosec;
+}
+
+// 锁已销毁, 其他线程不会再写入该地址的槽
+void SRWStats_Remove(const void *pKey)
+{
+	size_t idx = HashStatKey(pKey);
+	StatRegistry &registry = StatRegistry::Get();
+	std::lock_guard<std::mutex> lk(registry.Mutex);
+
+	for (StatShard *pShard : registry.Shards)
+	{
+		for (size_t p = 0; p < STAT_PROBE_LIMIT; ++p)
+		{
+			StatSlot &slot = pShard->GetSlot(idx, p);
+			if (slot.LoadKey() == pKey)
+				slot.Clear();
+		}
+	}
+
+	registry.Retired.erase(pKey);
+	registry.Baseline.erase(pKey);
+}
+#endif
@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#include "Predefines.hpp"
+
+// 看门狗需要统计的等待队列长度
+#if defined(SRWLOCK_ENABLE_WATCHDOG) && !defined(SRWLOCK_ENABLE_STATS)
+#  define SRWLOCK_ENABLE_STATS 1
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// 定义 SRWLOCK_ENABLE_STATS 编译带统计的版本. 统计数据按锁状态的地址归类,
+// 不改变锁的内存布局. 未定义时统计代码被完全移除
+#if defined(SRWLOCK_ENABLE_STATS)
+
+// 单个锁或条件变量的统计数据
+struct SRWLockStats
+{
+	// 无竞争直接获得的次数
+	uint64_t FastAcquisitions;
+	// 经过等待才获得的次数. 条件变量为等待次数
+	uint64_t ContendedAcquisitions;
+	// 自旋期间被唤醒的等待者个数
+	uint64_t SpinWins;
+	// 进入睡眠的等待者个数
+	uint64_t Parks;
+	// 解锁或通知时唤醒的等待者个数
+	uint64_t WakeUps;
+	// 等待的总时长
+	uint64_t WaitNanosec;
+	// 同时等待的最大线程数
+	uint64_t MaxQueueLength;
+
+	uint64_t Acquisitions() const
+	{
+		return FastAcquisitions + ContendedAcquisitions;
+	}
+};
+
+enum SRWStatKind
+{
+	STAT_FAST_ACQUIRE,
+	STAT_CONTENDED_ACQUIRE,
+	STAT_SPIN_WIN,
+	STAT_PARK,
+	STAT_WAKE_UP,
+	STAT_WAIT_NANOSEC,
+	// 取最大值而非累加
+	STAT_MAX_QUEUE,
+	STAT_KIND_COUNT
+};
+
+// 累加当前线程的分片计数
+void SRWStats_Add(const void *pKey, SRWStatKind kind, uint64_t value);
+// 合并所有线程的分片计数
+void SRWStats_Get(const void *pKey, SRWLockStats *pStats);
+// 清零
+void SRWStats_Reset(const void *pKey);
+// 移除该地址的全部统计. 锁类析构时调用, 释放线程分片中的槽, 之后同一地址上构造的锁从零开始计数
+void SRWStats_Remove(const void *pKey);
+
+// 进入等待队列, 返回开始等待的时间
+uint64_t SRWStats_BeginWait(const void *pKey);
+void SRWStats_EndWait(const void *pKey);
+// 当前的等待者个数
+uint32_t SRWStats_GetQueueLength(const void *pKey);
+// 等待后获得锁, 累加竞争次数与等待时长
+void SRWStats_Acquired(const void *pKey, uint64_t startTime);
+
+// 一次等待的范围. 离开作用域时退出等待队列, 超时或取消时不计入竞争次数
+class SRWStatWaitScope
+{
+public:
+	explicit SRWStatWaitScope(const void *pKey)
+		: Key_(pKey)
+		, StartTime_(SRWStats_BeginWait(pKey))
+	{
+	}
+
+	SRWStatWaitScope(const SRWStatWaitScope &) = delete;
+
+	~SRWStatWaitScope()
+	{
+		SRWStats_EndWait(Key_);
+	}
+
+	void Acquired()
+	{
+		SRWStats_Acquired(Key_, StartTime_);
+	}
+
+private:
+	const void *Key_;
+	uint64_t StartTime_;
+};
+
+// 以下宏供锁的实现使用
+#  define SRWLOCK_STAT_ADD(_key, _kind, _value)	SRWStats_Add(_key, _kind, _value)
+#  define SRWLOCK_STAT_WAIT(_key, _var)			SRWStatWaitScope _var(_key)
+#  define SRWLOCK_STAT_CONTENDED(_var)			_var.Acquired()
+#else
+#  define SRWLOCK_STAT_ADD(_key, _kind, _value)	((void)(_key))
+#  define SRWLOCK_STAT_WAIT(_key, _var)			((void)0)
+#  define SRWLOCK_STAT_CONTENDED(_var)			((void)0)
+#endif
@@ -0,0 +1,73 @@
+﻿#include "SRWPILock.hpp"
+#include "Atomic.hpp"
+#include "DebugLog.hpp"
+#include "Utility.hpp"
+
+#if defined(PLATFORM_IS_LINUX)
+#  include <unistd.h>
+#  include <errno.h>
+#  include <stdio.h>
+#  include <sys/syscall.h>
+#  include <linux/futex.h>
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWPILock::try_lock()
+{
+	return Atomic::CompareExchange<uint32_t>(&LockWord_, 0, GetCurrentThreadID()) == 0;
+}
+
+void SRWPILock::lock()
+{
+	uint32_t threadID = GetCurrentThreadID();
+	if (PLATFORM_LIKELY(Atomic::CompareExchange<uint32_t>(&LockWord_, 0, threadID) == 0))
+		return;
+
+	for (;;)
+	{
+		// 内核设置等待者标记并提升持有者优先级, 成功返回时锁字已是当前线程 ID
+		if (syscall(SYS_futex, &LockWord_, FUTEX_LOCK_PI_PRIVATE, 0, nullptr, nullptr, 0) == 0)
+			return;
+
+		// 持有者正在退出时内核要求重试.
+		// 其余错误 (锁字损坏, 重入, 内核不支持) 重试也无法恢复
+		int err = errno;
+		Assert(err == EAGAIN || err == EINTR);
+		if (Atomic::CompareExchange<uint32_t>(&LockWord_, 0, threadID) == 0)
+			return;
+	}
+}
+
+void SRWPILock::unlock()
+{
+	uint32_t threadID = GetCurrentThreadID();
+	AssertDebug((LockWord_ & FUTEX_TID_MASK) == threadID);
+
+	if (PLATFORM_LIKELY(Atomic::CompareExchange<uint32_t>(&LockWord_, threadID, 0) == threadID))
+		return;
+
+	// 存在等待者, 由内核移交给优先级最高的等待者并撤销优先级提升
+	long ret = syscall(SYS_futex, &LockWord_, FUTEX_UNLOCK_PI_PRIVATE, 0, nullptr, nullptr, 0);
+	// 失败时锁仍被占有, 等待者将永远无法被唤醒
+	Assert(ret == 0);
+	(void)ret;
+}
+
+#else
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWPILock::try_lock()
+{
+	return Lock_.try_lock();
+}
+
+void SRWPILock::lock()
+{
+	Lock_.lock();
+}
+
+void SRWPILock::unlock()
+{
+	Lock_.unlock();
+}
+
+#endif
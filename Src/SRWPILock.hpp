@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include "SRWLock.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 优先级继承独占锁. 锁字保存持有者的线程 ID, 争用时交由内核的 PI futex 排队,
+// 内核据此把持有者提升到最高等待者的优先级, 避免中等优先级线程造成的优先级反转.
+// 等待者不自旋, 以免高优先级等待者占用持有者所需的处理器. 非 Linux 平台退化为 SRWLock
+class SRWPILock
+{
+public:
+	SRWPILock() = default;
+	SRWPILock(const SRWPILock &) = delete;
+	SRWPILock(SRWPILock &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+private:
+#if defined(PLATFORM_IS_LINUX)
+	// 持有者线程 ID, 以及内核设置的等待者标记
+	uint32_t LockWord_ = 0;
+#else
+	SRWLock Lock_;
+#endif
+};
@@ -0,0 +1,258 @@
+﻿#include "SRWPhaseFairLock.hpp"
+#include "SRWLock.hpp"
+#include "WaitEvent.hpp"
+#include "Atomic.hpp"
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+// 读者计数增量
+static const uint32_t PF_READER_INC = 0x100;
+// 写者存在标记
+static const uint32_t PF_WRITER_PRESENT = 0x2;
+// 写阶段标记, 取写者票号最低位, 用于区分相邻的两个写阶段
+static const uint32_t PF_PHASE_ID = 0x1;
+static const uint32_t PF_WRITER_BITS = PF_WRITER_PRESENT | PF_PHASE_ID;
+// 读者进入计数中的挂起标记, 存在等待写阶段结束的读者
+static const uint32_t PF_READER_PARKED = 0x4;
+
+// 写者票号增量, 最低位留作挂起标记
+static const uint32_t PF_TICKET_INC = 0x2;
+// 写者离开票号和读者离开计数中的挂起标记
+static const uint32_t PF_PARKED = 0x1;
+
+// 多核时挂起前的自旋次数
+static const uint32_t PF_SPIN_COUNT = 128;
+
+// 等待表桶个数
+static const uint32_t PF_BUCKET_COUNT = 256;
+
+// 等待节点, 位于等待者栈上
+struct PhaseFairWaitNode
+{
+	WaitEvent Event;
+	const uint32_t *pKey = nullptr;
+	// 等待的目标值, 只唤醒目标值一致的节点时使用
+	uint32_t Value = 0;
+	PhaseFairWaitNode *Next = nullptr;
+};
+
+// 等待表桶, 按状态地址散列, 多个锁共用一个桶
+struct alignas(64) PhaseFairBucket
+{
+	SRWLock Mutex;
+	PhaseFairWaitNode *Head = nullptr;
+	PhaseFairWaitNode *Tail = nullptr;
+};
+
+static PhaseFairBucket g_PhaseFairBuckets[PF_BUCKET_COUNT];
+
+static PhaseFairBucket& GetBucket(const uint32_t *pKey)
+{
+	uint32_t hash = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pKey) >> 2) * 0x9E3779B9u;
+	return g_PhaseFairBuckets[hash >> 24];
+}
+
+static bool IsMultiCore()
+{
+	static const bool s_IsMultiCore = std::thread::hardware_concurrency() > 1;
+	return s_IsMultiCore;
+}
+
+static uint32_t LoadValue(const uint32_t &value)
+{
+	return static_cast<volatile const uint32_t&>(value);
+}
+
+// 在等待表中挂起. 挂起标记只在桶锁内设置, 设置成功后唤醒者必然在桶内找到该节点.
+// 条件已满足时返回 true, 被唤醒后返回 false, 由调用者重新检查
+template <class TReady>
+static bool ParkWaiter(uint32_t *pStatus, uint32_t parkedFlag, uint32_t value, TReady funcReady)
+{
+	PhaseFairBucket &bucket = GetBucket(pStatus);
+	PhaseFairWaitNode node;
+	node.pKey = pStatus;
+	node.Value = value;
+
+	bucket.Mutex.lock();
+
+	uint32_t lastStatus = LoadValue(*pStatus);
+	for (;;)
+	{
+		if (funcReady(lastStatus))
+		{
+			bucket.Mutex.unlock();
+			return true;
+		}
+
+		if (lastStatus & parkedFlag)
+			break;
+
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(pStatus, lastStatus, lastStatus | parkedFlag);
+		if (currStatus == lastStatus)
+			break;
+
+		lastStatus = currStatus;
+	}
+
+	if (bucket.Tail)
+		bucket.Tail->Next = &node;
+	else
+		bucket.Head = &node;
+	bucket.Tail = &node;
+
+	bucket.Mutex.unlock();
+
+	node.Event.WaitMicrosec();
+	return false;
+}
+
+// 唤醒挂起在该状态上的节点. isAll 为 false 时只唤醒目标值为 value 的节点.
+// 该状态上没有剩余节点时清除挂起标记
+static void UnparkWaiters(uint32_t *pStatus, uint32_t parkedFlag, bool isAll, uint32_t value)
+{
+	PhaseFairWaitNode *wakeHead = nullptr;
+	PhaseFairWaitNode **ppWakeTail = &wakeHead;
+	bool hasMore = false;
+
+	PhaseFairBucket &bucket = GetBucket(pStatus);
+	bucket.Mutex.lock();
+
+	PhaseFairWaitNode *pPrev = nullptr;
+	PhaseFairWaitNode *pNode = bucket.Head;
+	while (pNode)
+	{
+		PhaseFairWaitNode *pNext = pNode->Next;
+		if (pNode->pKey == pStatus)
+		{
+			if (isAll || pNode->Value == value)
+			{
+				// 从桶中摘除
+				if (pPrev)
+					pPrev->Next = pNext;
+				else
+					bucket.Head = pNext;
+				if (bucket.Tail == pNode)
+					bucket.Tail = pPrev;
+
+				pNode->Next = nullptr;
+				*ppWakeTail = pNode;
+				ppWakeTail = &pNode->Next;
+
+				pNode = pNext;
+				continue;
+			}
+			hasMore = true;
+		}
+
+		pPrev = pNode;
+		pNode = pNext;
+	}
+
+	if (!hasMore)
+		Atomic::FetchAnd<uint32_t>(pStatus, ~parkedFlag);
+
+	bucket.Mutex.unlock();
+
+	// 唤醒后节点随时可能失效, 需先取出后继
+	while (wakeHead)
+	{
+		PhaseFairWaitNode *pNext = wakeHead->Next;
+		wakeHead->Event.WakeUp();
+		wakeHead = pNext;
+	}
+}
+
+// 等待条件满足. 多核时先短暂自旋, 之后挂起到等待表
+template <class TReady>
+static void WaitUntil(uint32_t *pStatus, uint32_t parkedFlag, uint32_t value, TReady funcReady)
+{
+	if (IsMultiCore())
+	{
+		for (uint32_t i = 0; i < PF_SPIN_COUNT; ++i)
+		{
+			if (funcReady(LoadValue(*pStatus)))
+				return;
+			PLATFORM_YIELD;
+		}
+	}
+
+	while (!ParkWaiter(pStatus, parkedFlag, value, funcReady))
+	{
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWPhaseFairLock::try_lock()
+{
+	uint32_t ticket = LoadValue(WriterOut_) & ~PF_PARKED;
+	if (LoadValue(WriterIn_) != ticket ||
+		Atomic::CompareExchange<uint32_t>(&WriterIn_, ticket, ticket + PF_TICKET_INC) != ticket)
+		return false;
+
+	// 宣告写者存在, 仍有读者时撤销
+	uint32_t readerTicket = Atomic::FetchAdd<uint32_t>(&ReaderIn_, PF_WRITER_PRESENT | ((ticket / PF_TICKET_INC) & PF_PHASE_ID));
+	if ((LoadValue(ReaderOut_) & ~PF_PARKED) == readerTicket)
+		return true;
+
+	unlock();
+	return false;
+}
+
+void SRWPhaseFairLock::lock()
+{
+	// 写者之间按票号排队
+	uint32_t ticket = Atomic::FetchAdd<uint32_t>(&WriterIn_, PF_TICKET_INC);
+	WaitUntil(&WriterOut_, PF_PARKED, ticket, [ticket](uint32_t status)
+	{
+		return (status & ~PF_PARKED) == ticket;
+	});
+
+	// 阻止新的读者进入, 并等待已进入的读者离开
+	uint32_t readerTicket = Atomic::FetchAdd<uint32_t>(&ReaderIn_, PF_WRITER_PRESENT | ((ticket / PF_TICKET_INC) & PF_PHASE_ID));
+	WaitUntil(&ReaderOut_, PF_PARKED, readerTicket, [readerTicket](uint32_t status)
+	{
+		return (status & ~PF_PARKED) == readerTicket;
+	});
+}
+
+void SRWPhaseFairLock::unlock()
+{
+	// 结束写阶段, 放行等待中的读者后再移交给下一个写者
+	uint32_t lastReaderIn = Atomic::FetchAnd<uint32_t>(&ReaderIn_, ~(PF_WRITER_BITS | PF_READER_PARKED));
+	if (lastReaderIn & PF_READER_PARKED)
+		UnparkWaiters(&ReaderIn_, PF_READER_PARKED, true, 0);
+
+	uint32_t lastWriterOut = Atomic::FetchAdd<uint32_t>(&WriterOut_, PF_TICKET_INC);
+	if (lastWriterOut & PF_PARKED)
+		UnparkWaiters(&WriterOut_, PF_PARKED, false, (lastWriterOut & ~PF_PARKED) + PF_TICKET_INC);
+}
+
+bool SRWPhaseFairLock::try_lock_shared()
+{
+	uint32_t lastValue = LoadValue(ReaderIn_);
+	if (lastValue & PF_WRITER_BITS)
+		return false;
+
+	return Atomic::CompareExchange<uint32_t>(&ReaderIn_, lastValue, lastValue + PF_READER_INC) == lastValue;
+}
+
+void SRWPhaseFairLock::lock_shared()
+{
+	uint32_t writerBits = Atomic::FetchAdd<uint32_t>(&ReaderIn_, PF_READER_INC) & PF_WRITER_BITS;
+	if (!writerBits)
+		return;
+
+	// 只等待进入时的写阶段结束, 之后的写者必须等待本读者离开
+	WaitUntil(&ReaderIn_, PF_READER_PARKED, 0, [writerBits](uint32_t status)
+	{
+		return (status & PF_WRITER_BITS) != writerBits;
+	});
+}
+
+void SRWPhaseFairLock::unlock_shared()
+{
+	// 最后离开的读者唤醒等待中的写者
+	uint32_t lastReaderOut = Atomic::FetchAdd<uint32_t>(&ReaderOut_, PF_READER_INC);
+	if (lastReaderOut & PF_PARKED)
+		UnparkWaiters(&ReaderOut_, PF_PARKED, false, (lastReaderOut & ~PF_PARKED) + PF_READER_INC);
+}
@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include "Predefines.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 阶段公平读写锁. 读阶段与写阶段交替进行, 等待者最多经历一个对方阶段即可获得锁.
+// 写者按票号排队, 读者进入时若有写者则等待当前写阶段结束.
+// 等待者短暂自旋后挂起到按状态地址散列的等待表, 计数低位记录是否存在挂起者
+class SRWPhaseFairLock
+{
+public:
+	SRWPhaseFairLock() = default;
+	SRWPhaseFairLock(const SRWPhaseFairLock &) = delete;
+	SRWPhaseFairLock(SRWPhaseFairLock &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+	bool try_lock_shared();
+	void lock_shared();
+	void unlock_shared();
+
+private:
+	// 读者进入计数, 低位为写者存在标记, 阶段标记和读者挂起标记
+	uint32_t ReaderIn_ = 0;
+	// 读者离开计数, 最低位为写者挂起标记
+	uint32_t ReaderOut_ = 0;
+	// 写者票号, 写者离开票号最低位为挂起标记
+	uint32_t WriterIn_ = 0;
+	uint32_t WriterOut_ = 0;
+};
@@ -0,0 +1,364 @@
+﻿#include "SRWProcessLock.hpp"
+
+#if defined(SRWLOCK_HAS_PROCESS_SHARED)
+#include "Atomic.hpp"
+#include "DebugLog.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+//////////////////////////////////////////////////////////////////////////
+// 锁状态. 最低位为锁定位, 之后分别为独占等待者计数, 共享等待者计数和共享计数
+static const uint32_t PS_LOCKED = 1;
+static const uint32_t PS_EXCLUSIVE_WAITER = 1 << 1;
+static const uint32_t PS_SHARED_WAITER = 1 << 8;
+static const uint32_t PS_SHARED = 1 << 15;
+static const uint32_t PS_WAITER_MASK = PS_SHARED - PS_EXCLUSIVE_WAITER;
+
+// 等待槽状态
+enum SRWSlotStates
+{
+	SLOT_IDLE,
+	SLOT_WAITING,
+	// 解锁者已将锁移交给该等待者
+	SLOT_GRANTED,
+};
+
+// 等待槽占满时的轮询间隔
+static const uint64_t POLL_MIN_MICROSEC = 50;
+static const uint64_t POLL_MAX_MICROSEC = 1000;
+
+static uint32_t LoadValue(const uint32_t &value)
+{
+	return static_cast<volatile const uint32_t&>(value);
+}
+
+// 共享 futex, 不使用 FUTEX_PRIVATE_FLAG, 内核以物理页定位等待队列
+static bool FutexWait(uint32_t *pFutex, uint32_t expected, uint64_t microsecs)
+{
+	timespec ts;
+	timespec *pTimeOut = nullptr;
+	if (microsecs != -1)
+	{
+		ts.tv_sec = microsecs / 1000000;
+		ts.tv_nsec = (microsecs % 1000000) * 1000;
+		pTimeOut = &ts;
+	}
+
+	return syscall(SYS_futex, pFutex, FUTEX_WAIT, expected, pTimeOut, nullptr, 0) == -1 &&
+		errno == ETIMEDOUT;
+}
+
+static void FutexWake(uint32_t *pFutex, int count)
+{
+	syscall(SYS_futex, pFutex, FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+static bool IsProcessAlive(uint32_t processID)
+{
+	return kill(static_cast<pid_t>(processID), 0) == 0 || errno != ESRCH;
+}
+
+static bool IsTicketBefore(uint32_t lhs, uint32_t rhs)
+{
+	return static_cast<int32_t>(lhs - rhs) < 0;
+}
+
+static void SleepMicrosec(uint64_t microsecs)
+{
+	timespec ts;
+	ts.tv_sec = microsecs / 1000000;
+	ts.tv_nsec = (microsecs % 1000000) * 1000;
+	nanosleep(&ts, nullptr);
+}
+
+//////////////////////////////////////////////////////////////////////////
+bool SRWProcessLock::try_lock()
+{
+	return Atomic::CompareExchange<uint32_t>(&LockStatus_, 0, PS_LOCKED) == 0;
+}
+
+void SRWProcessLock::lock()
+{
+	if (PLATFORM_LIKELY(try_lock()))
+		return;
+
+	LockSlow(true);
+}
+
+void SRWProcessLock::unlock()
+{
+	if (PLATFORM_LIKELY(Atomic::CompareExchange<uint32_t>(&LockStatus_, PS_LOCKED, 0) == PS_LOCKED))
+		return;
+
+	UnlockSlow(true);
+}
+
+bool SRWProcessLock::try_lock_shared()
+{
+	uint32_t lastStatus = LoadValue(LockStatus_);
+
+	// 存在等待者时不再增加共享者, 避免独占者饥饿
+	while (!(lastStatus & (PS_LOCKED | PS_WAITER_MASK)))
+	{
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, lastStatus + PS_SHARED);
+		if (currStatus == lastStatus)
+			return true;
+
+		lastStatus = currStatus;
+	}
+	return false;
+}
+
+void SRWProcessLock::lock_shared()
+{
+	if (PLATFORM_LIKELY(try_lock_shared()))
+		return;
+
+	LockSlow(false);
+}
+
+void SRWProcessLock::unlock_shared()
+{
+	uint32_t lastStatus = LoadValue(LockStatus_);
+
+	// 最后一个共享者需要向等待者移交
+	while (lastStatus >= PS_SHARED * 2 || !(lastStatus & PS_WAITER_MASK))
+	{
+		AssertDebug(lastStatus >= PS_SHARED);
+
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, lastStatus - PS_SHARED);
+		if (currStatus == lastStatus)
+			return;
+
+		lastStatus = currStatus;
+	}
+
+	UnlockSlow(false);
+}
+
+SRWProcessSlot* SRWProcessLock::ClaimSlot(uint32_t processID)
+{
+	for (auto &slot : Slots_)
+	{
+		if (!LoadValue(slot.ProcessID) &&
+			Atomic::CompareExchange<uint32_t>(&slot.ProcessID, 0, processID) == 0)
+			return &slot;
+	}
+	return nullptr;
+}
+
+void SRWProcessLock::LockSlow(bool isExclusive)
+{
+	uint32_t processID = static_cast<uint32_t>(getpid());
+	uint64_t pollTime = POLL_MIN_MICROSEC;
+
+	SRWProcessSlot *pSlot;
+	for (;;)
+	{
+		pSlot = ClaimSlot(processID);
+		if (pSlot)
+			break;
+
+		if (isExclusive ? try_lock() : try_lock_shared())
+			return;
+
+		SleepMicrosec(pollTime);
+		pollTime = (std::min)(pollTime * 2, POLL_MAX_MICROSEC);
+	}
+
+	// 计入等待者前填好槽, 解锁者只处理等待状态的槽
+	pSlot->IsExclusive = isExclusive;
+	pSlot->Ticket = Atomic::FetchAdd<uint32_t>(&NextTicket_, 1);
+	pSlot->State = SLOT_WAITING;
+
+	const uint32_t waiterUnit = isExclusive ? PS_EXCLUSIVE_WAITER : PS_SHARED_WAITER;
+	uint32_t lastStatus = LoadValue(LockStatus_);
+
+	// 加锁与排队在同一次状态更新中决定, 排队后只能等待解锁者移交
+	for (;;)
+	{
+		uint32_t newStatus;
+		bool isLocked;
+		if (isExclusive)
+		{
+			isLocked = lastStatus == 0;
+			newStatus = isLocked ? PS_LOCKED : lastStatus + waiterUnit;
+		}
+		else
+		{
+			isLocked = !(lastStatus & (PS_LOCKED | PS_WAITER_MASK));
+			newStatus = lastStatus + (isLocked ? PS_SHARED : waiterUnit);
+		}
+
+		uint32_t currStatus = Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, newStatus);
+		if (currStatus == lastStatus)
+		{
+			if (isLocked)
+			{
+				// 计入等待者前解锁者可能已看到等待状态的槽并代为加锁,
+				// 此时保留移交得到的持有, 归还刚获得的持有
+				bool isGranted = Atomic::CompareExchange<uint32_t>(&pSlot->State, SLOT_WAITING, SLOT_IDLE) != SLOT_WAITING;
+				pSlot->State = SLOT_IDLE;
+				Atomic::Exchange<uint32_t>(&pSlot->ProcessID, 0);
+
+				if (isGranted)
+				{
+					// 独占移交会设置锁定位, 之后不可能直接加锁
+					AssertDebug(!isExclusive);
+					unlock_shared();
+				}
+				return;
+			}
+			// 等待状态在计入等待者之前设置, 回收者需要区分计数是否已经生效
+			Atomic::StoreRelease<uint32_t>(&pSlot->IsCounted, 1);
+			break;
+		}
+
+		lastStatus = currStatus;
+	}
+
+	while (LoadValue(pSlot->State) != SLOT_GRANTED)
+		FutexWait(&pSlot->State, SLOT_WAITING, -1);
+
+	// 移交时已代为加锁, 只需撤销等待者计数并释放槽
+	pSlot->IsCounted = 0;
+	Atomic::FetchAdd<uint32_t>(&LockStatus_, 0 - waiterUnit);
+	pSlot->State = SLOT_IDLE;
+	Atomic::Exchange<uint32_t>(&pSlot->ProcessID, 0);
+}
+
+void SRWProcessLock::UnlockSlow(bool isExclusive)
+{
+	// 当前持有者所占的状态
+	const uint32_t holdStatus = isExclusive ? PS_LOCKED : PS_SHARED;
+	SRWProcessSlot *grantSlots[SRW_PROCESS_SLOT_COUNT];
+
+	for (;;)
+	{
+		uint32_t lastStatus = LoadValue(LockStatus_);
+		AssertDebug(isExclusive ? (lastStatus & PS_LOCKED) : (lastStatus >= PS_SHARED));
+
+		if (!(lastStatus & PS_WAITER_MASK) || (!isExclusive && lastStatus >= PS_SHARED * 2))
+		{
+			if (Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, lastStatus - holdStatus) == lastStatus)
+				return;
+			continue;
+		}
+
+		// 查找最早排队的独占等待者, 回收已退出进程的槽
+		SRWProcessSlot *pFirstExclusive = nullptr;
+		bool isReclaimed = false;
+		for (auto &slot : Slots_)
+		{
+			uint32_t processID = LoadValue(slot.ProcessID);
+			if (!processID || LoadValue(slot.State) != SLOT_WAITING)
+				continue;
+
+			if (!IsProcessAlive(processID))
+			{
+				if (Atomic::CompareExchange<uint32_t>(&slot.State, SLOT_WAITING, SLOT_IDLE) == SLOT_WAITING)
+				{
+					// 进程可能在计入等待者之前退出, 此时没有可撤销的计数
+					if (Atomic::LoadAcquire(&slot.IsCounted))
+					{
+						slot.IsCounted = 0;
+						Atomic::FetchAdd<uint32_t>(&LockStatus_, 0 - (slot.IsExclusive ? PS_EXCLUSIVE_WAITER : PS_SHARED_WAITER));
+					}
+					Atomic::CompareExchange<uint32_t>(&slot.ProcessID, processID, 0);
+				}
+				isReclaimed = true;
+				continue;
+			}
+
+			if (slot.IsExclusive && (!pFirstExclusive || IsTicketBefore(slot.Ticket, pFirstExclusive->Ticket)))
+				pFirstExclusive = &slot;
+		}
+
+		// 回收后计数已改变, 重新读取状态
+		if (isReclaimed)
+			continue;
+
+		// 排在第一个独占等待者之前的共享等待者一起获得锁
+		uint32_t grantCount = 0;
+		for (auto &slot : Slots_)
+		{
+			if (!LoadValue(slot.ProcessID) || LoadValue(slot.State) != SLOT_WAITING || slot.IsExclusive)
+				continue;
+
+			if (!pFirstExclusive || IsTicketBefore(slot.Ticket, pFirstExclusive->Ticket))
+				grantSlots[grantCount++] = &slot;
+		}
+
+		uint32_t newStatus = lastStatus - holdStatus;
+		if (grantCount)
+			newStatus += grantCount * PS_SHARED;
+		else if (pFirstExclusive)
+		{
+			newStatus |= PS_LOCKED;
+			grantSlots[grantCount++] = pFirstExclusive;
+		}
+
+		// 等待者入队会改变状态, 失败时重新查找
+		if (Atomic::CompareExchange<uint32_t>(&LockStatus_, lastStatus, newStatus) != lastStatus)
+			continue;
+
+		for (uint32_t i = 0; i < grantCount; ++i)
+		{
+			Atomic::Exchange<uint32_t>(&grantSlots[i]->State, SLOT_GRANTED);
+			FutexWake(&grantSlots[i]->State, 1);
+		}
+		return;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SRWProcessCondVar::notify_one()
+{
+	if (!LoadValue(Waiters_))
+		return;
+
+	Atomic::FetchAdd<uint32_t>(&Sequence_, 1);
+	FutexWake(&Sequence_, 1);
+}
+
+void SRWProcessCondVar::notify_all()
+{
+	if (!LoadValue(Waiters_))
+		return;
+
+	Atomic::FetchAdd<uint32_t>(&Sequence_, 1);
+	FutexWake(&Sequence_, INT_MAX);
+}
+
+bool SRWProcessCondVar::wait_for(LockGuard<SRWProcessLock> &lock, uint64_t timeOut)
+{
+	// 序号需在解锁前读取, 此后的通知都会使序号改变
+	uint32_t seq = LoadValue(Sequence_);
+	Atomic::FetchAdd<uint32_t>(&Waiters_, 1);
+
+	lock.mutex()->unlock();
+	bool isTimeOut = FutexWait(&Sequence_, seq, timeOut);
+	Atomic::FetchAdd<uint32_t>(&Waiters_, -1);
+	lock.mutex()->lock();
+
+	return isTimeOut;
+}
+
+bool SRWProcessCondVar::wait_for(SharedLockGuard<SRWProcessLock> &lock, uint64_t timeOut)
+{
+	uint32_t seq = LoadValue(Sequence_);
+	Atomic::FetchAdd<uint32_t>(&Waiters_, 1);
+
+	lock.mutex()->unlock_shared();
+	bool isTimeOut = FutexWait(&Sequence_, seq, timeOut);
+	Atomic::FetchAdd<uint32_t>(&Waiters_, -1);
+	lock.mutex()->lock_shared();
+
+	return isTimeOut;
+}
+#endif
@@ -0,0 +1,111 @@
+﻿#pragma once
+
+#include "LockUtils.hpp"
+
+#if defined(PLATFORM_IS_LINUX)
+// 支持进程共享的锁和条件变量
+#  define SRWLOCK_HAS_PROCESS_SHARED 1
+#endif
+
+#if defined(SRWLOCK_HAS_PROCESS_SHARED)
+//////////////////////////////////////////////////////////////////////////
+// 进程共享锁的等待槽个数. 槽已占满时等待者以轮询代替排队
+static const uint32_t SRW_PROCESS_SLOT_COUNT = 64;
+
+// 等待槽. 等待者以槽序号代替栈节点指针排队, 槽内不保存任何指针
+struct SRWProcessSlot
+{
+	// 等待者进程 ID, 为 0 时槽空闲
+	uint32_t ProcessID;
+	// 等待状态, 同时作为 futex 等待字
+	uint32_t State;
+	// 排队序号
+	uint32_t Ticket;
+	// 是否独占等待
+	uint32_t IsExclusive;
+	// 是否已计入锁状态的等待者计数, 回收时据此撤销计数
+	uint32_t IsCounted;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 进程共享读写锁. 可直接放置在多个进程映射的共享内存中, 全零即为初始状态.
+// 等待者占用锁内的等待槽并在槽上的共享 futex 睡眠, 解锁者按排队序号直接移交所有权.
+// 解锁者移交前检查等待者进程是否存活, 回收已退出进程遗留的等待槽.
+// 持有锁的进程退出时锁无法恢复
+class SRWProcessLock
+{
+public:
+	SRWProcessLock() = default;
+	SRWProcessLock(const SRWProcessLock &) = delete;
+	SRWProcessLock(SRWProcessLock &&) = delete;
+
+	bool try_lock();
+	void lock();
+	void unlock();
+
+	bool try_lock_shared();
+	void lock_shared();
+	void unlock_shared();
+
+private:
+	void LockSlow(bool isExclusive);
+	void UnlockSlow(bool isExclusive);
+	SRWProcessSlot* ClaimSlot(uint32_t processID);
+
+private:
+	// 锁定位, 独占和共享等待者计数, 共享计数
+	uint32_t LockStatus_ = 0;
+	// 下一个排队序号
+	uint32_t NextTicket_ = 0;
+	SRWProcessSlot Slots_[SRW_PROCESS_SLOT_COUNT] = {};
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 进程共享条件变量. 等待者直接在通知序号的共享 futex 上睡眠, 由内核排队,
+// 等待者进程退出时内核自动将其移出队列
+class SRWProcessCondVar
+{
+public:
+	SRWProcessCondVar() = default;
+	SRWProcessCondVar(const SRWProcessCondVar &) = delete;
+	SRWProcessCondVar(SRWProcessCondVar &&) = delete;
+
+	// 唤醒. 如果没有加锁则可能无法唤醒
+	void notify_one();
+	void notify_all();
+
+	// 等待唤醒. 微秒超时
+	bool wait_for(LockGuard<SRWProcessLock> &lock, uint64_t timeOut);
+	bool wait_for(SharedLockGuard<SRWProcessLock> &lock, uint64_t timeOut);
+
+	void wait(LockGuard<SRWProcessLock> &lock)
+	{
+		wait_for(lock, -1);
+	}
+
+	void wait(SharedLockGuard<SRWProcessLock> &lock)
+	{
+		wait_for(lock, -1);
+	}
+
+	template <class Pred>
+	void wait(LockGuard<SRWProcessLock> &lock, Pred pred)
+	{
+		while (!pred())
+			wait_for(lock, -1);
+	}
+
+	template <class Pred>
+	void wait(SharedLockGuard<SRWProcessLock> &lock, Pred pred)
+	{
+		while (!pred())
+			wait_for(lock, -1);
+	}
+
+private:
+	// 通知序号, 同时作为 futex 等待字
+	uint32_t Sequence_ = 0;
+	// 等待者个数. 等待者进程退出时会残留计数, 只会造成多余的系统调用
+	uint32_t Waiters_ = 0;
+};
+#endif
@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include "SRWLock.hpp"
+#include "LockUtils.hpp"
+#include "Atomic.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 顺序锁. 独占者在临界区内递增版本号, 乐观读取不写共享内存,
+// 读取后校验版本号, 连续失败多次后改为共享加锁读取
+class SRWSeqLock
+{
+public:
+	SRWSeqLock() = default;
+	SRWSeqLock(const SRWSeqLock &) = delete;
+	SRWSeqLock(SRWSeqLock &&) = delete;
+
+	bool try_lock()
+	{
+		if (!Lock_.try_lock())
+			return false;
+
+		BeginWrite();
+		return true;
+	}
+
+	void lock()
+	{
+		Lock_.lock();
+		BeginWrite();
+	}
+
+	void unlock()
+	{
+		EndWrite();
+		Lock_.unlock();
+	}
+
+	bool try_lock_shared()
+	{
+		return Lock_.try_lock_shared();
+	}
+
+	void lock_shared()
+	{
+		Lock_.lock_shared();
+	}
+
+	void unlock_shared()
+	{
+		Lock_.unlock_shared();
+	}
+
+	// 开始乐观读取, 返回版本号. 正在写入时为奇数
+	uint32_t read_begin() const
+	{
+		return Atomic::LoadAcquire(&Version_);
+	}
+
+	// 校验乐观读取期间没有发生写入
+	bool read_validate(uint32_t version) const
+	{
+		Atomic::ThreadFenceAcquire();
+		return !(version & 1) && static_cast<volatile const uint32_t&>(Version_) == version;
+	}
+
+	// 乐观读取. func 可能被调用多次, 且校验前可能读到不一致的数据, 只能读取并复制数据
+	template <class Func>
+	void read(Func func, uint32_t retryCount = 4) const
+	{
+		for (uint32_t i = 0; i < retryCount; ++i)
+		{
+			uint32_t version = read_begin();
+			if (version & 1)
+			{
+				PLATFORM_YIELD;
+				continue;
+			}
+
+			func();
+			if (read_validate(version))
+				return;
+		}
+
+		SharedLockGuard<SRWLock> lk(Lock_);
+		func();
+	}
+
+private:
+	// 持有独占锁时版本号只有当前线程修改
+	void BeginWrite()
+	{
+		static_cast<volatile uint32_t&>(Version_) = Version_ + 1;
+		Atomic::ThreadFenceRelease();
+	}
+
+	void EndWrite()
+	{
+		Atomic::StoreRelease(&Version_, Version_ + 1);
+	}
+
+private:
+	mutable SRWLock Lock_;
+	// 写入版本号, 为奇数时正在写入
+	uint32_t Version_ = 0;
+};
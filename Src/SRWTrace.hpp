@@ -0,0 +1,48 @@
+﻿#pragma once
+
+#include "Predefines.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// USDT 静态探针, 供 bpftrace/perf 追踪等待的慢速路径. 提供者为 srwlock:
+//   enqueue(key, isExclusive, ns)	节点进入等待链表
+//   spin_exit(key, isWoken, ns)	自旋结束, 是否已被唤醒
+//   park(key, ns)					进入睡眠
+//   wake(key, node)				唤醒睡眠中的节点
+//   acquire(key, startNs, ns)		等待后获得锁. 条件变量为被通知
+// key 为锁或条件变量状态的地址. 时间戳只在追踪器附加时读取, 未附加时探针为一条 nop.
+// 存在 sys/sdt.h 时默认开启, 定义 SRWLOCK_DISABLE_USDT 关闭
+#if defined(PLATFORM_IS_LINUX) && !defined(SRWLOCK_DISABLE_USDT) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    define SRWLOCK_HAS_USDT 1
+#  endif
+#endif
+
+#if defined(SRWLOCK_HAS_USDT)
+// 探针信号量, 追踪器附加时非零
+#  define SRWLOCK_PROBE_SEMAPHORE(_name)	unsigned short srwlock_##_name##_semaphore __attribute__((section(".probes")))
+
+extern "C"
+{
+	extern SRWLOCK_PROBE_SEMAPHORE(enqueue);
+	extern SRWLOCK_PROBE_SEMAPHORE(spin_exit);
+	extern SRWLOCK_PROBE_SEMAPHORE(park);
+	extern SRWLOCK_PROBE_SEMAPHORE(wake);
+	extern SRWLOCK_PROBE_SEMAPHORE(acquire);
+}
+
+#  define _SDT_HAS_SEMAPHORES 1
+#  include <sys/sdt.h>
+
+#  define SRWLOCK_PROBE_ENABLED(_name)				PLATFORM_UNLIKELY(srwlock_##_name##_semaphore != 0)
+#  define SRWLOCK_PROBE_NOW(_name)					(SRWLOCK_PROBE_ENABLED(_name) ? GetTickNanosec() : 0)
+#  define SRWLOCK_PROBE2(_name, _a1, _a2)			DTRACE_PROBE2(srwlock, _name, _a1, _a2)
+#  define SRWLOCK_PROBE3(_name, _a1, _a2, _a3)		DTRACE_PROBE3(srwlock, _name, _a1, _a2, _a3)
+// 记录等待开始时间, 获得锁时与当前时间一起传出. 等待期间才附加的追踪器收到的开始时间为 0
+#  define SRWLOCK_PROBE_START(_var)					uint64_t _var = SRWLOCK_PROBE_NOW(acquire)
+#  define SRWLOCK_PROBE_ACQUIRE(_key, _var)			SRWLOCK_PROBE3(acquire, _key, _var, SRWLOCK_PROBE_NOW(acquire))
+#else
+#  define SRWLOCK_PROBE2(_name, _a1, _a2)			((void)0)
+#  define SRWLOCK_PROBE3(_name, _a1, _a2, _a3)		((void)0)
+#  define SRWLOCK_PROBE_START(_var)					((void)0)
+#  define SRWLOCK_PROBE_ACQUIRE(_key, _var)			((void)0)
+#endif
@@ -0,0 +1,323 @@
+﻿#include "SRWWatchdog.hpp"
+
+#if defined(SRWLOCK_ENABLE_WATCHDOG)
+#include "SRWLockStats.hpp"
+#include "SRWLockRegistry.hpp"
+#include "Atomic.hpp"
+#include "Utility.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+struct HeldEntry
+{
+	const void *Key;
+	uint64_t Since;
+	uint32_t IsShared;
+};
+
+struct HeldSet;
+
+// 线程的持有集合已析构, 之后不再记录
+static thread_local bool t_IsSetExited = false;
+
+struct HeldRegistry
+{
+	std::mutex Mutex;
+	std::vector<HeldSet*> Sets;
+
+	static HeldRegistry& Get()
+	{
+		// 不析构, 线程局部集合可能晚于静态对象析构
+		static HeldRegistry *s_Registry = new HeldRegistry();
+		return *s_Registry;
+	}
+};
+
+// 线程持有的锁. 只有所属线程写入, 看门狗读取时可能与移动条目冲突, 读到的条目以键校验
+struct HeldSet
+{
+	uint32_t ThreadID;
+	uint32_t Count = 0;
+	HeldEntry Entries[SRWLOCK_WATCHDOG_MAX_HELD] = {};
+
+	HeldSet()
+		: ThreadID(GetCurrentThreadID())
+	{
+		HeldRegistry &registry = HeldRegistry::Get();
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+		registry.Sets.push_back(this);
+	}
+
+	~HeldSet()
+	{
+		HeldRegistry &registry = HeldRegistry::Get();
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+		registry.Sets.erase(std::find(registry.Sets.begin(), registry.Sets.end(), this));
+		t_IsSetExited = true;
+	}
+
+	// 同一个锁的多次共享持有各占一个条目, 从后向前查找最近的一次
+	int32_t Find(const void *pKey) const
+	{
+		for (uint32_t i = Count; i > 0; --i)
+		{
+			if (Entries[i - 1].Key == pKey)
+				return static_cast<int32_t>(i - 1);
+		}
+		return -1;
+	}
+
+	void Add(const void *pKey, bool isShared)
+	{
+		if (Count == SRWLOCK_WATCHDOG_MAX_HELD)
+			return;
+
+		HeldEntry &entry = Entries[Count];
+		Atomic::StoreRelaxed(&entry.Since, GetTickCycles());
+		Atomic::StoreRelaxed<uint32_t>(&entry.IsShared, isShared);
+		static_cast<const void *volatile&>(entry.Key) = pKey;
+
+		Atomic::ThreadFenceRelease();
+		Atomic::StoreRelaxed(&Count, Count + 1);
+	}
+
+	void Remove(const void *pKey)
+	{
+		int32_t idx = Find(pKey);
+		if (idx < 0)
+			return;
+
+		// 最后一个条目移入空位
+		uint32_t last = Count - 1;
+		HeldEntry &entry = Entries[idx];
+		if (static_cast<uint32_t>(idx) != last)
+		{
+			static_cast<const void *volatile&>(entry.Key) = nullptr;
+			Atomic::ThreadFenceRelease();
+			Atomic::StoreRelaxed(&entry.Since, Entries[last].Since);
+			Atomic::StoreRelaxed(&entry.IsShared, Entries[last].IsShared);
+			Atomic::ThreadFenceRelease();
+			static_cast<const void *volatile&>(entry.Key) = Entries[last].Key;
+		}
+
+		static_cast<const void *volatile&>(Entries[last].Key) = nullptr;
+		Atomic::StoreRelaxed(&Count, last);
+	}
+};
+
+static HeldSet* GetHeldSet()
+{
+	if (PLATFORM_UNLIKELY(t_IsSetExited))
+		return nullptr;
+
+	static thread_local HeldSet s_Set;
+	return &s_Set;
+}
+
+void SRWWatchdog_OnAcquire(const void *pKey, bool isShared)
+{
+	if (HeldSet *pSet = GetHeldSet())
+		pSet->Add(pKey, isShared);
+}
+
+void SRWWatchdog_OnRelease(const void *pKey)
+{
+	if (HeldSet *pSet = GetHeldSet())
+		pSet->Remove(pKey);
+}
+
+void SRWWatchdog_OnConvert(const void *pKey, bool isShared)
+{
+	if (HeldSet *pSet = GetHeldSet())
+	{
+		int32_t idx = pSet->Find(pKey);
+		if (idx >= 0)
+			Atomic::StoreRelaxed<uint32_t>(&pSet->Entries[idx].IsShared, isShared);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 一次持有的标识, 用于避免重复报告
+struct HoldIdentity
+{
+	const void *Key;
+	uint32_t ThreadID;
+	uint64_t Since;
+
+	bool operator==(const HoldIdentity &other) const
+	{
+		return Key == other.Key && ThreadID == other.ThreadID && Since == other.Since;
+	}
+};
+
+struct WatchdogState
+{
+	std::mutex Mutex;
+	std::condition_variable Cond;
+	std::thread Thread;
+	bool IsStopping = false;
+	uint64_t Threshold = 0;
+	uint64_t Interval = 0;
+	SRWWatchdogHandler Handler = nullptr;
+	// 上一次检查时已报告的持有
+	std::vector<HoldIdentity> Reported;
+
+	static WatchdogState& Get()
+	{
+		static WatchdogState *s_State = new WatchdogState();
+		return *s_State;
+	}
+};
+
+static void PrintReport(const SRWWatchdogReport &report)
+{
+	char name[64] = "";
+	SRWRegistry_GetName(report.Key, name, sizeof(name));
+
+	fprintf(stderr, "[SRWWatchdog] lock %p%s%s%s held %s by thread %u for %llums, %u waiting\n",
+		report.Key,
+		name[0] ? " (" : "",
+		name,
+		name[0] ? ")" : "",
+		report.IsShared ? "shared" : "exclusive",
+		report.ThreadID,
+		static_cast<unsigned long long>(report.HoldMicrosec / 1000),
+		report.QueueLength);
+}
+
+size_t SRWWatchdog_Check(uint64_t thresholdMicrosec, SRWWatchdogHandler handler)
+{
+	std::vector<SRWWatchdogReport> reports;
+	std::vector<HoldIdentity> holds;
+
+	uint64_t now = GetTickCycles();
+	double nanosecPerCycle = GetNanosecPerCycle();
+	{
+		HeldRegistry &registry = HeldRegistry::Get();
+		std::lock_guard<std::mutex> lk(registry.Mutex);
+
+		for (HeldSet *pSet : registry.Sets)
+		{
+			uint32_t count = Atomic::LoadRelaxed(&pSet->Count);
+			Atomic::ThreadFenceAcquire();
+
+			for (uint32_t i = 0; i < count && i < SRWLOCK_WATCHDOG_MAX_HELD; ++i)
+			{
+				HeldEntry &entry = pSet->Entries[i];
+				const void *pKey = static_cast<const void *volatile&>(entry.Key);
+				Atomic::ThreadFenceAcquire();
+				uint64_t since = Atomic::LoadRelaxed(&entry.Since);
+				bool isShared = Atomic::LoadRelaxed(&entry.IsShared) != 0;
+				Atomic::ThreadFenceAcquire();
+				if (!pKey || static_cast<const void *volatile&>(entry.Key) != pKey || since > now)
+					continue;
+
+				uint64_t holdMicrosec = static_cast<uint64_t>(static_cast<double>(now - since) * nanosecPerCycle / 1000);
+				if (holdMicrosec < thresholdMicrosec)
+					continue;
+
+				// 只报告有等待者的锁. 持有者随时可能释放并销毁锁, 不能读取锁状态,
+				// 等待者个数按地址记录在统计中
+				uint32_t queueLength = SRWStats_GetQueueLength(pKey);
+				if (!queueLength)
+					continue;
+
+				// 移动条目期间同一次持有可能被读到两次
+				HoldIdentity hold{ pKey, pSet->ThreadID, since };
+				if (std::find(holds.begin(), holds.end(), hold) != holds.end())
+					continue;
+
+				holds.push_back(hold);
+				reports.push_back(SRWWatchdogReport{ pKey, pSet->ThreadID, isShared, holdMicrosec, queueLength });
+			}
+		}
+	}
+
+	size_t reportCount = 0;
+	WatchdogState &state = WatchdogState::Get();
+	{
+		std::lock_guard<std::mutex> lk(state.Mutex);
+
+		for (size_t i = 0; i < holds.size(); ++i)
+		{
+			if (std::find(state.Reported.begin(), state.Reported.end(), holds[i]) != state.Reported.end())
+				continue;
+
+			reports[reportCount++] = reports[i];
+		}
+		// 已结束的持有不再保留
+		state.Reported.swap(holds);
+	}
+
+	for (size_t i = 0; i < reportCount; ++i)
+		(handler ? handler : PrintReport)(reports[i]);
+
+	return reportCount;
+}
+
+static void WatchdogLoop()
+{
+	WatchdogState &state = WatchdogState::Get();
+	std::unique_lock<std::mutex> lk(state.Mutex);
+
+	while (!state.IsStopping)
+	{
+		state.Cond.wait_for(lk, std::chrono::microseconds(state.Interval));
+		if (state.IsStopping)
+			break;
+
+		uint64_t threshold = state.Threshold;
+		SRWWatchdogHandler handler = state.Handler;
+
+		lk.unlock();
+		SRWWatchdog_Check(threshold, handler);
+		lk.lock();
+	}
+}
+
+void SRWWatchdog_Start(uint64_t thresholdMicrosec, uint64_t intervalMicrosec, SRWWatchdogHandler handler)
+{
+	static std::once_flag s_Once;
+	WatchdogState &state = WatchdogState::Get();
+	{
+		std::lock_guard<std::mutex> lk(state.Mutex);
+		state.Threshold = thresholdMicrosec;
+		state.Interval = intervalMicrosec;
+		state.Handler = handler;
+
+		if (!state.Thread.joinable())
+			state.Thread = std::thread(WatchdogLoop);
+	}
+	state.Cond.notify_all();
+
+	// 退出前停止, 避免析构仍在运行的线程对象
+	std::call_once(s_Once, []()
+	{
+		atexit(SRWWatchdog_Stop);
+	});
+}
+
+void SRWWatchdog_Stop()
+{
+	WatchdogState &state = WatchdogState::Get();
+	std::thread thread;
+	{
+		std::lock_guard<std::mutex> lk(state.Mutex);
+		if (!state.Thread.joinable())
+			return;
+
+		state.IsStopping = true;
+		thread.swap(state.Thread);
+	}
+	state.Cond.notify_all();
+	thread.join();
+
+	std::lock_guard<std::mutex> lk(state.Mutex);
+	state.IsStopping = false;
+}
+#endif
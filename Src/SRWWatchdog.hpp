@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "Predefines.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// 定义 SRWLOCK_ENABLE_WATCHDOG 开启长时间持有检测. SRWLock 与 SRWAdaptiveLock 的类接口
+// 在每个线程记录持有的锁与获得时间, 后台线程定期报告持有超过阈值且有等待者的锁.
+// 直接调用 SRWLock_Xxx 接口的加解锁不记录. 检测依赖统计的等待队列长度, 同时开启统计
+#if defined(SRWLOCK_ENABLE_WATCHDOG)
+
+// 每个线程同时记录的持有个数, 超出部分不记录
+static const uint32_t SRWLOCK_WATCHDOG_MAX_HELD = 16;
+
+struct SRWWatchdogReport
+{
+	const void *Key;
+	// 持有者的线程 ID
+	uint32_t ThreadID;
+	bool IsShared;
+	uint64_t HoldMicrosec;
+	// 等待者个数
+	uint32_t QueueLength;
+};
+
+typedef void (*SRWWatchdogHandler)(const SRWWatchdogReport &report);
+
+// 启动后台检查线程, 重复调用时更新参数. 处理函数为空时输出到 stderr
+void SRWWatchdog_Start(uint64_t thresholdMicrosec, uint64_t intervalMicrosec = 100000, SRWWatchdogHandler handler = nullptr);
+void SRWWatchdog_Stop();
+// 立即检查一次, 返回报告的个数. 同一次持有只报告一次
+size_t SRWWatchdog_Check(uint64_t thresholdMicrosec, SRWWatchdogHandler handler = nullptr);
+
+// 以下供锁的类接口使用. 升降级时持有时长连续计算
+void SRWWatchdog_OnAcquire(const void *pKey, bool isShared);
+void SRWWatchdog_OnRelease(const void *pKey);
+void SRWWatchdog_OnConvert(const void *pKey, bool isShared);
+
+#  define SRWLOCK_WATCH_ACQUIRE(_key, _isShared)	SRWWatchdog_OnAcquire(_key, _isShared)
+#  define SRWLOCK_WATCH_RELEASE(_key)				SRWWatchdog_OnRelease(_key)
+#  define SRWLOCK_WATCH_CONVERT(_key, _isShared)	SRWWatchdog_OnConvert(_key, _isShared)
+#else
+#  define SRWLOCK_WATCH_ACQUIRE(_key, _isShared)	((void)0)
+#  define SRWLOCK_WATCH_RELEASE(_key)				((void)0)
+#  define SRWLOCK_WATCH_CONVERT(_key, _isShared)	((void)0)
+#endif
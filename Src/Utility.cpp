@@ -5,6 +5,11 @@
 #  include <windows.h>
 #else
 #  include <time.h>
+#  include <unistd.h>
+#  include <pthread.h>
+#  if defined(PLATFORM_IS_UNIX)
+#    include <sys/syscall.h>
+#  endif
 #endif
 
 #if defined(PLATFORM_IS_APPLE)
@@ -73,3 +78,69 @@ uint64_t GetTickMillisec()
 {
 	return GetTickMicrosec() / 1000;
 }
+
+static uint32_t GetThreadIDImpl()
+{
+#if defined(PLATFORM_IS_WINDOWS)
+	return static_cast<uint32_t>(GetCurrentThreadId());
+#elif defined(PLATFORM_IS_UNIX)
+	return static_cast<uint32_t>(syscall(SYS_gettid));
+#elif defined(PLATFORM_IS_APPLE)
+	uint64_t tid = 0;
+	pthread_threadid_np(nullptr, &tid);
+	return static_cast<uint32_t>(tid);
+#endif
+}
+
+// 常量初始化的线程局部变量访问时无需检查初始化守卫
+static thread_local uint32_t t_ThreadID = 0;
+
+#if !defined(PLATFORM_IS_WINDOWS)
+// 子进程中只剩执行 fork 的线程, 其缓存的是父进程线程的 ID
+static void ResetThreadIDAfterFork()
+{
+	t_ThreadID = 0;
+}
+#endif
+
+// 只在线程首次使用时进入内核
+uint32_t GetCurrentThreadID()
+{
+	uint32_t tid = t_ThreadID;
+	if (PLATFORM_UNLIKELY(tid == 0))
+	{
+#if !defined(PLATFORM_IS_WINDOWS)
+		static const int s_AtFork = pthread_atfork(nullptr, nullptr, ResetThreadIDAfterFork);
+		(void)s_AtFork;
+#endif
+		tid = GetThreadIDImpl();
+		t_ThreadID = tid;
+	}
+	return tid;
+}
+
+double GetNanosecPerCycle()
+{
+#if defined(PLATFORM_ARCH_X86)
+	// 以单调时钟为准测量约 10 毫秒
+	static double s_Ratio = []()
+	{
+		uint64_t startTick = GetTickNanosec();
+		uint64_t startCycles = GetTickCycles();
+		uint64_t nowTick;
+		do
+		{
+			nowTick = GetTickNanosec();
+		} while (nowTick - startTick < 10000000);
+
+		return static_cast<double>(nowTick - startTick) / static_cast<double>(GetTickCycles() - startCycles);
+	}();
+	return s_Ratio;
+#elif defined(PLATFORM_IS_ARM64) && defined(PLATFORM_GNUC_LIKE)
+	uint64_t freq;
+	__asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+	return 1.0e9 / static_cast<double>(freq);
+#else
+	return 1.0;
+#endif
+}
@@ -6,3 +6,34 @@
 uint64_t GetTickNanosec();
 uint64_t GetTickMicrosec();
 uint64_t GetTickMillisec();
+
+// 当前时间之后指定微秒的截止时间, 溢出时饱和为 -1
+inline uint64_t GetDeadlineMicrosec(uint64_t microsecs)
+{
+	uint64_t now = GetTickMicrosec();
+	return microsecs > static_cast<uint64_t>(-1) - now ? static_cast<uint64_t>(-1) : now + microsecs;
+}
+
+// 操作系统的线程 ID, 缓存在线程局部存储中
+uint32_t GetCurrentThreadID();
+
+// 廉价的时间戳, 单位不固定. x86 为时间戳计数器, ARM64 为虚拟计数器, 其他平台为纳秒
+inline uint64_t GetTickCycles()
+{
+#if defined(PLATFORM_ARCH_X86)
+#  if defined(PLATFORM_MSVC_LIKE)
+	return __rdtsc();
+#  else
+	return __builtin_ia32_rdtsc();
+#  endif
+#elif defined(PLATFORM_IS_ARM64) && defined(PLATFORM_GNUC_LIKE)
+	uint64_t value;
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+	return value;
+#else
+	return GetTickNanosec();
+#endif
+}
+
+// GetTickCycles 每单位的纳秒数, 首次调用时校准
+double GetNanosecPerCycle();
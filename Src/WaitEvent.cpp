@@ -52,9 +52,75 @@ static struct KeyedEvent
 #elif defined(PLATFORM_IS_LINUX)
 #  include <unistd.h>
 #  include <errno.h>
+#  include <time.h>
 #  include <sys/time.h>
 #  include <sys/syscall.h>
 #  include <linux/futex.h>
+#  include <limits.h>
+#  include "Atomic.hpp"
+
+// 无等待者也无唤醒
+static constexpr int EVENT_IDLE = 0;
+// 等待者已经或即将进入 futex 睡眠
+static constexpr int EVENT_WAITING = 1;
+// 唤醒已发出但尚未被等待者消费
+static constexpr int EVENT_SIGNALED = 2;
+// 多事件等待者睡眠在全局序号上, 唤醒者需要更新序号
+static constexpr int EVENT_WAITING_ANY = 3;
+
+#  if !defined(SYS_futex_waitv)
+#    define SYS_futex_waitv 449
+#  endif
+#  if !defined(FUTEX_32)
+#    define FUTEX_32 2
+#  endif
+
+// 与内核的 struct futex_waitv 一致, 避免依赖新版本的头文件
+struct FutexWaitV
+{
+	uint64_t Value;
+	uint64_t Address;
+	uint32_t Flags;
+	uint32_t Reserved;
+};
+
+// futex_waitv 一次最多等待的个数
+static const size_t FUTEX_WAITV_LIMIT = 128;
+
+// 内核是否支持 futex_waitv. 不支持时多事件等待退化为全局序号等待
+static bool g_HasFutexWaitV = true;
+// 全局序号. 唤醒处于 EVENT_WAITING_ANY 状态的事件时递增
+static int g_WaitAnySeq = 0;
+
+static const timespec* MakeDeadline(uint64_t microsecs, timespec &deadline)
+{
+	if (microsecs == -1)
+		return nullptr;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += microsecs / 1000000;
+	deadline.tv_nsec += (microsecs % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+	return &deadline;
+}
+
+static bool FutexWait(int *pFutex, int expected, const timespec *pDeadline)
+{
+	// 使用绝对时间, 虚假唤醒后重新等待时无需重算剩余时间
+	return syscall(SYS_futex, pFutex, FUTEX_WAIT_BITSET_PRIVATE, expected,
+		pDeadline, nullptr, FUTEX_BITSET_MATCH_ANY) == -1 &&
+		errno == ETIMEDOUT;
+}
+#else
+#  include <chrono>
+
+// 多事件等待者共用的条件变量
+static std::mutex g_WaitAnyMutex;
+static std::condition_variable g_WaitAnyCondVar;
 #endif
 
 //////////////////////////////////////////////////////////////////////////
@@ -74,18 +140,27 @@ bool WaitEvent::WaitMicrosec(uint64_t microsecs)
 		return NtWaitForKeyedEvent(g_KeyedEvent.Handle_, this, false, &timeOut) == STATUS_TIMEOUT;
 	}
 #elif defined(PLATFORM_IS_LINUX)
-	if (microsecs == -1)
-	{
-		syscall(SYS_futex, &Futex_, FUTEX_WAIT_PRIVATE, Futex_, nullptr, 0, 0);
-		return false;
-	}
-	else
+	timespec deadline;
+	const timespec *pDeadline = MakeDeadline(microsecs, deadline);
+
+	for (;;)
 	{
-		timespec ts;
-		ts.tv_sec = microsecs / 1000000;
-		ts.tv_nsec = (microsecs % 1000000) * 1000;
-		syscall(SYS_futex, &Futex_, FUTEX_WAIT_PRIVATE, Futex_, &ts, 0, 0);
-		return errno == ETIMEDOUT;
+		// 唤醒先于等待到达时直接消费, 不进入内核
+		if (Atomic::CompareExchange(&Futex_, EVENT_IDLE, EVENT_WAITING) == EVENT_SIGNALED)
+		{
+			Atomic::Exchange(&Futex_, EVENT_IDLE);
+			return false;
+		}
+
+		if (FutexWait(&Futex_, EVENT_WAITING, pDeadline))
+		{
+			// 超时后撤回等待状态, 撤回失败说明唤醒已经到达, 以唤醒为准
+			if (Atomic::CompareExchange(&Futex_, EVENT_WAITING, EVENT_IDLE) == EVENT_WAITING)
+				return true;
+			Atomic::Exchange(&Futex_, EVENT_IDLE);
+			return false;
+		}
+		// 被唤醒, 被信号中断或状态已改变, 重新检查状态
 	}
 #else
 	std::unique_lock<std::mutex> lk(Mutex_);
@@ -97,9 +172,10 @@ bool WaitEvent::WaitMicrosec(uint64_t microsecs)
 	}
 	else
 	{
-		auto status = CondVar_.wait_for(lk, std::chrono::microseconds(microsecs));
+		// 超时与唤醒同时发生时以唤醒为准, 避免丢失唤醒
+		bool isWakeUp = CondVar_.wait_for(lk, std::chrono::microseconds(microsecs), [this] { return IsWakeUp_; });
 		IsWakeUp_ = false;
-		return status == std::cv_status::timeout;
+		return !isWakeUp;
 	}
 #endif
 }
@@ -109,17 +185,168 @@ void WaitEvent::WakeUp()
 #if defined(PLATFORM_IS_WINDOWS)
 	NtReleaseKeyedEvent(g_KeyedEvent.Handle_, this, false, nullptr);
 #elif defined(PLATFORM_IS_LINUX)
-#  pragma nounroll
-	while (syscall(SYS_futex, &Futex_, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0) != 1)
+	// 唤醒总是被记录, 仅当等待者可能已睡眠时才需要系统调用.
+	// 等待者可能在系统调用前就已消费唤醒并返回, 此时的 FUTEX_WAKE 至多造成一次虚假唤醒
+	int lastState = Atomic::Exchange(&Futex_, EVENT_SIGNALED);
+	if (lastState == EVENT_WAITING)
+		syscall(SYS_futex, &Futex_, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+	else if (lastState == EVENT_WAITING_ANY)
 	{
-		// 唤醒失败时退让
-#  pragma nounroll
-		for (int i = 0; i < 64; ++i)
-			PLATFORM_YIELD;
+		// 无法得知等待者睡眠在哪个序号上, 唤醒所有多事件等待者
+		Atomic::FetchAdd(&g_WaitAnySeq, 1);
+		syscall(SYS_futex, &g_WaitAnySeq, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
 	}
 #else
-	std::lock_guard<std::mutex> lk(Mutex_);
-	IsWakeUp_ = true;
-	CondVar_.notify_one();
+	bool isWaitAny;
+	{
+		std::lock_guard<std::mutex> lk(Mutex_);
+		IsWakeUp_ = true;
+		isWaitAny = IsWaitAny_;
+		CondVar_.notify_one();
+	}
+
+	if (isWaitAny)
+	{
+		std::lock_guard<std::mutex> lk(g_WaitAnyMutex);
+		g_WaitAnyCondVar.notify_all();
+	}
 #endif
 }
+
+#if !defined(PLATFORM_IS_WINDOWS)
+size_t WaitEvent::WaitAny(WaitEvent *const *ppEvents, size_t count, uint64_t microsecs)
+{
+#if defined(PLATFORM_IS_LINUX)
+	timespec deadline;
+	const timespec *pDeadline = MakeDeadline(microsecs, deadline);
+
+	bool isWaitV = count <= FUTEX_WAITV_LIMIT && g_HasFutexWaitV;
+	int waitState = isWaitV ? EVENT_WAITING : EVENT_WAITING_ANY;
+
+	// 撤回所有等待状态. 撤回失败说明唤醒已经到达, 超时时以唤醒为准,
+	// 其余唤醒保留在事件上, 由之后对该事件的等待消费
+	auto finish = [ppEvents, count](size_t index)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (i == index)
+				continue;
+
+			int *pFutex = &ppEvents[i]->Futex_;
+			int lastState = *pFutex;
+			while (lastState == EVENT_WAITING || lastState == EVENT_WAITING_ANY)
+			{
+				int currState = Atomic::CompareExchange(pFutex, lastState, EVENT_IDLE);
+				if (currState == lastState)
+				{
+					lastState = EVENT_IDLE;
+					break;
+				}
+				lastState = currState;
+			}
+
+			if (lastState == EVENT_SIGNALED && index == -1)
+				index = i;
+		}
+
+		if (index != -1)
+			Atomic::Exchange(&ppEvents[index]->Futex_, EVENT_IDLE);
+		return index;
+	};
+
+	for (;;)
+	{
+		// 序号需先于等待状态读取, 此后的唤醒都会使序号改变
+		int seq = static_cast<volatile const int&>(g_WaitAnySeq);
+
+		// 登记等待状态, 同时检查已经到达的唤醒
+		for (size_t i = 0; i < count; ++i)
+		{
+			int *pFutex = &ppEvents[i]->Futex_;
+			int lastState = Atomic::CompareExchange(pFutex, EVENT_IDLE, waitState);
+			// 退化后需要把之前的登记改为全局序号等待
+			if (lastState != EVENT_IDLE && lastState != EVENT_SIGNALED && lastState != waitState)
+				lastState = Atomic::CompareExchange(pFutex, lastState, waitState);
+
+			if (lastState == EVENT_SIGNALED)
+				return finish(i);
+		}
+
+		bool isTimeOut;
+		if (isWaitV)
+		{
+			FutexWaitV waiters[FUTEX_WAITV_LIMIT];
+			for (size_t i = 0; i < count; ++i)
+			{
+				waiters[i].Value = EVENT_WAITING;
+				waiters[i].Address = reinterpret_cast<uintptr_t>(&ppEvents[i]->Futex_);
+				waiters[i].Flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+				waiters[i].Reserved = 0;
+			}
+
+			if (syscall(SYS_futex_waitv, waiters, count, 0, pDeadline, CLOCK_MONOTONIC) == -1)
+			{
+				if (errno == ENOSYS)
+				{
+					g_HasFutexWaitV = false;
+					isWaitV = false;
+					waitState = EVENT_WAITING_ANY;
+					continue;
+				}
+				isTimeOut = errno == ETIMEDOUT;
+			}
+			else
+				isTimeOut = false;
+		}
+		else
+			isTimeOut = FutexWait(&g_WaitAnySeq, seq, pDeadline);
+
+		if (isTimeOut)
+			return finish(-1);
+	}
+#else
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(microsecs);
+	size_t index = -1;
+
+	std::unique_lock<std::mutex> lk(g_WaitAnyMutex);
+	for (;;)
+	{
+		// 持有全局锁期间登记并检查, 唤醒者只能在进入等待后通知
+		for (size_t i = 0; i < count && index == -1; ++i)
+		{
+			WaitEvent *pEvent = ppEvents[i];
+			std::lock_guard<std::mutex> evLk(pEvent->Mutex_);
+			if (pEvent->IsWakeUp_)
+				index = i;
+			else
+				pEvent->IsWaitAny_ = true;
+		}
+
+		if (index != -1)
+			break;
+
+		if (microsecs == -1)
+			g_WaitAnyCondVar.wait(lk);
+		else if (g_WaitAnyCondVar.wait_until(lk, deadline) == std::cv_status::timeout)
+			break;
+	}
+
+	// 撤回登记. 超时与唤醒同时发生时以唤醒为准, 其余唤醒留给之后的等待
+	for (size_t i = 0; i < count; ++i)
+	{
+		WaitEvent *pEvent = ppEvents[i];
+		std::lock_guard<std::mutex> evLk(pEvent->Mutex_);
+		pEvent->IsWaitAny_ = false;
+		if (index == -1 && pEvent->IsWakeUp_)
+			index = i;
+	}
+
+	if (index != -1)
+	{
+		std::lock_guard<std::mutex> evLk(ppEvents[index]->Mutex_);
+		ppEvents[index]->IsWakeUp_ = false;
+	}
+	return index;
+#endif
+}
+#endif
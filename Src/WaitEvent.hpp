@@ -18,13 +18,23 @@ public:
 	// 唤醒
 	void WakeUp();
 
+#if !defined(PLATFORM_IS_WINDOWS)
+	// 同时等待多个事件, 返回被唤醒的事件序号, 超时返回 -1.
+	// 只消费该事件上的唤醒, 其余事件上已到达的唤醒留给之后的等待.
+	// Windows 的键控事件无法同时等待多个键, 不提供该功能
+	static size_t WaitAny(WaitEvent *const *ppEvents, size_t count, uint64_t microsecs = -1);
+#endif
+
 private:
 #if defined(PLATFORM_IS_WINDOWS)
 #elif defined(PLATFORM_IS_LINUX)
+	// 空闲/等待/已唤醒状态
 	int Futex_ = 0;
 #else
 	std::mutex Mutex_;
 	std::condition_variable CondVar_;
 	bool IsWakeUp_ = false;
+	// 正在被多事件等待
+	bool IsWaitAny_ = false;
 #endif
 };
@@ -1,13 +1,37 @@
 ﻿#include "SRWLock.hpp"
 #include "SRWCondVar.hpp"
+#include "SRWBiasedLock.hpp"
+#include "SRWPhaseFairLock.hpp"
+#include "SRWPILock.hpp"
+#include "SRWProcessLock.hpp"
+#include "SRWLock32.hpp"
+#include "SRWLockArray.hpp"
+#include "SRWSeqLock.hpp"
+#include "SRWAsyncLock.hpp"
+#include "SRWCohortLock.hpp"
+#include "SRWLockRegistry.hpp"
+#include "SRWHoldTime.hpp"
+#include "SRWWatchdog.hpp"
 #include "Utility.hpp"
 #include "DebugLog.hpp"
+#include "Atomic.hpp"
 #include <thread>
 #include <mutex>
 #include <vector>
 #include <deque>
 #include <shared_mutex>
 #include <functional>
+#include <algorithm>
+#include <memory>
+
+#if defined(PLATFORM_IS_LINUX)
+#  include <pthread.h>
+#  include <sched.h>
+#  include <signal.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/wait.h>
+#endif
 
 //////////////////////////////////////////////////////////////////////////
 PLATFORM_NOINLINE static void SimpleTest()
@@ -289,6 +313,9 @@ PLATFORM_NOINLINE static void TestLockPerf()
 #endif
 
 	TestLockRace<SRWLock>("SRWLock", loops);
+	TestLockRace<SRWAdaptiveLock>("SRWAdaptiveLock", loops);
+	TestLockRace<SRWPILock>("SRWPILock", loops);
+	TestLockRace<SRWLock32>("SRWLock32", loops);
 #if !defined(PLATFORM_IS_APPLE)
 	TestLockRace<std::mutex>("std::mutex", loops);
 #endif
@@ -297,6 +324,9 @@ PLATFORM_NOINLINE static void TestLockPerf()
 #endif
 
 	TestLockSingle<SRWLock>("SRWLock", loops);
+	TestLockSingle<SRWAdaptiveLock>("SRWAdaptiveLock", loops);
+	TestLockSingle<SRWPILock>("SRWPILock", loops);
+	TestLockSingle<SRWLock32>("SRWLock32", loops);
 #if !defined(PLATFORM_IS_APPLE)
 	TestLockSingle<std::mutex>("std::mutex", loops);
 #endif
@@ -305,265 +335,2621 @@ PLATFORM_NOINLINE static void TestLockPerf()
 #endif
 }
 
-//////////////////////////////////////////////////////////////////////////
+// 读多写少场景, 每 writeInterval 次读操作执行一次写操作
 template <class TLock>
-static uint64_t TestLockWake(uint32_t waitTime = 250)
+static void TestReadMostly(const char *name, uint32_t threadCount, uint32_t loops, uint32_t writeInterval)
 {
+	SRWLock syncLock;
+
 	TLock locker;
-	uint64_t unlockTime = 0;
-	volatile bool isLocked = false;
+	uint32_t value1 = 0, value2 = 0;
 
-	std::thread thd([&locker, &unlockTime, &isLocked]()
+	auto func = [&](uint32_t idx)
 	{
-		locker.lock();
-		isLocked = true;
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		syncLock.lock_shared();
+		syncLock.unlock_shared();
 
-		unlockTime = GetTickMicrosec();
-		locker.unlock();
-	});
+		for (uint32_t i = 0; i < loops; ++i)
+		{
+			if ((i + idx) % writeInterval == 0)
+			{
+				locker.lock();
+				++value1;
+				++value2;
+				locker.unlock();
+			}
+			else
+			{
+				locker.lock_shared();
+				Assert(value1 == value2);
+				locker.unlock_shared();
+			}
+		}
+	};
 
-	while (!isLocked)
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-	std::this_thread::sleep_for(std::chrono::milliseconds(waitTime));
+	syncLock.lock();
 
-	locker.lock();
-	uint64_t wakeTime = GetTickMicrosec() - unlockTime;
-	locker.unlock();
+	std::vector<std::thread> thdList;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		thdList.emplace_back(func, i);
 
-	thd.join();
+	auto t = GetTickMicrosec();
+	syncLock.unlock();
 
-	return wakeTime;
-}
+	for (auto &thd : thdList)
+		thd.join();
 
-template <class TLock>
-PLATFORM_NOINLINE static void TestLockWakeSeq(const char *name)
-{
-	uint64_t result = TestLockWake<TLock>(250);
-	printf("[Wake] %s 1: %lluus\n", name, result);
-	result = TestLockWake<TLock>(480);
-	printf("[Wake] %s 2: %lluus\n", name, result);
-	result = TestLockWake<TLock>(495);
-	printf("[Wake] %s 3: %lluus\n", name, result);
+	t = GetTickMicrosec() - t;
+	printf("[ReadMostly] %s: %u threads, %u writes, %gms\n",
+	       name, threadCount, value1, t / 1000.0);
+	Assert(value1 == value2);
 }
 
-PLATFORM_NOINLINE static void TestLockWakePerf()
+PLATFORM_NOINLINE static void TestReadMostlyPerf()
 {
-	TestLockWakeSeq<SRWLock>("SRWLock");
-	TestLockWakeSeq<std::mutex>("std::mutex");
+	const uint32_t loops =
+#if defined(PLATFORM_IS_DEBUG) || defined(PLATFORM_IS_IPHONE)
+			100000;
+#else
+		2000000;
+#endif
+	uint32_t thds = std::thread::hardware_concurrency();
 
+	TestReadMostly<SRWLock>("SRWLock", thds, loops, 10000);
+	TestReadMostly<SRWBiasedLock>("SRWBiasedLock", thds, loops, 10000);
 #if !defined(PLATFORM_IS_IPHONE)
-	TestLockWakeSeq<std::shared_mutex>("std::shared_mutex");
+	TestReadMostly<std::shared_mutex>("std::shared_mutex", thds, loops, 10000);
 #endif
-}
-
-//////////////////////////////////////////////////////////////////////////
-PLATFORM_NOINLINE static void SimpleTestCondVar()
-{
-	SRWCondVar condVar;
-	SRWLock lock;
-
-	{
-		LockGuard<SRWLock> lk(lock);
-		condVar.notify_one();
-		condVar.notify_all();
-	}
-	{
-		LockGuard<SRWLock> lk(lock);
-		auto stt = GetTickMicrosec();
-		bool isTimeOut = condVar.wait_for(lk, 500000);
-		auto dlt = GetTickMicrosec() - stt;
-		Assert(dlt > 400000);
-		Assert(isTimeOut);
-	}
 
-	{
-		SharedLockGuard<SRWLock> lk(lock);
-		condVar.notify_one();
-		condVar.notify_all();
-	}
-	{
-		SharedLockGuard<SRWLock> lk(lock);
-		auto stt = GetTickMicrosec();
-		bool isTimeOut = condVar.wait_for(lk, 500000);
-		auto dlt = GetTickMicrosec() - stt;
-		Assert(dlt > 400000);
-		Assert(isTimeOut);
-	}
+	TestReadMostly<SRWLock>("SRWLock", thds, loops / 10, 10);
+	TestReadMostly<SRWBiasedLock>("SRWBiasedLock", thds, loops / 10, 10);
+	TestReadMostly<SRWLock32>("SRWLock32", thds, loops / 10, 10);
 }
 
-PLATFORM_NOINLINE static void TestCondVar()
+// 大量小对象各自内嵌一把锁, 对比内存占用和随机访问吞吐
+template <class TLock>
+static void TestDenseLock(const char *name, uint32_t objCount, uint32_t threadCount, uint32_t loops)
 {
-	bool isExit = false;
+	struct Entry
+	{
+		TLock Lock;
+		uint32_t Value = 0;
+	};
 
-	SRWCondVar condVar;
-	SRWLock lock;
-	uint64_t wakeTime = 0;
+	std::unique_ptr<Entry[]> entries(new Entry[objCount]);
 
-	std::thread thd([&]()
+	auto func = [&entries, objCount, loops](uint32_t seed)
 	{
+		uint32_t rnd = seed * 2654435761u + 1;
+		for (uint32_t i = 0; i < loops; ++i)
 		{
-			LockGuard<SRWLock> lk(lock);
+			rnd ^= rnd << 13;
+			rnd ^= rnd >> 17;
+			rnd ^= rnd << 5;
+			Entry &ent = entries[rnd % objCount];
 
-			condVar.wait(lk, [&]()
+			// 每 8 次访问写入一次
+			if (i % 8 == 0)
 			{
-				return isExit;
-			});
-
-			uint64_t wakeElapsed = GetTickMicrosec() - wakeTime;
-			printf("wait Elapsed: %lluus\n", wakeElapsed);
+				ent.Lock.lock();
+				++ent.Value;
+				ent.Lock.unlock();
+			}
+			else
+			{
+				ent.Lock.lock_shared();
+				volatile uint32_t v = ent.Value;
+				(void)v;
+				ent.Lock.unlock_shared();
+			}
 		}
-	});
-
-	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	};
 
-	{
-		LockGuard<SRWLock> lk(lock);
-		isExit = true;
-		wakeTime = GetTickMicrosec();
-		condVar.notify_one();
-	}
+	std::vector<std::thread> thdList;
+	auto t = GetTickMicrosec();
 
-	thd.join();
-}
+	for (uint32_t i = 0; i < threadCount; ++i)
+		thdList.emplace_back(func, i);
+	for (auto &thd : thdList)
+		thd.join();
 
-PLATFORM_NOINLINE static void TestCondVar2()
-{
-	SRWCondVar condVar;
-	SRWLock lock;
-	uint64_t wakeTime = 0;
+	t = GetTickMicrosec() - t;
 
-	std::thread thd([&]()
-	{
-		{
-			LockGuard<SRWLock> lk(lock);
-			bool isTimeOut = condVar.wait_for(lk, 4000000);
-			Assert(!isTimeOut);
-		}
-		uint64_t wakeElapsed = GetTickMicrosec() - wakeTime;
-		printf("wait_for Elapsed: %lluus\n", wakeElapsed);
-	});
+	uint64_t sum = 0;
+	for (uint32_t i = 0; i < objCount; ++i)
+		sum += entries[i].Value;
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(100));
-	{
-		LockGuard<SRWLock> lk(lock);
-		wakeTime = GetTickMicrosec();
+	printf("[Dense] %s: lock %u bytes, entry %u bytes, total %gMB, %gms\n",
+	       name, (uint32_t)sizeof(TLock), (uint32_t)sizeof(Entry),
+	       sizeof(Entry) * (double)objCount / (1024 * 1024), t / 1000.0);
+	Assert(sum == (uint64_t)threadCount * ((loops + 7) / 8));
+}
 
-		condVar.notify_one();
-	}
+PLATFORM_NOINLINE static void TestDenseLockPerf()
+{
+	const uint32_t objCount =
+#if defined(PLATFORM_IS_DEBUG) || defined(PLATFORM_IS_IPHONE)
+			1000000;
+#else
+		8000000;
+#endif
+	uint32_t thds = std::thread::hardware_concurrency();
 
-	thd.join();
+	TestDenseLock<SRWLock>("SRWLock", objCount, thds, objCount);
+	TestDenseLock<SRWLock32>("SRWLock32", objCount, thds, objCount);
 }
 
-struct AvgCounter
+// 每个线程只访问相邻的一个分段, 对比紧密排列与缓存行对齐时的伪共享开销
+template <SRWStripeLayout Layout>
+static void TestLockArrayLayout(const char *name, uint32_t threadCount, uint32_t loops)
 {
-	double Total_ = 0;
-	double Min_ = 0;
-	double Max_ = 0;
-	size_t Count_ = 0;
+	SRWLockArray<SRWLock, Layout> arr(threadCount);
 
-	void AddData(double d)
+	auto func = [&arr, loops](uint32_t idx)
 	{
-		Total_ += d;
-
-		if (Count_)
-		{
-			Min_ = (std::min)(Min_, d);
-			Max_ = (std::max)(Max_, d);
-		}
-		else
+		uint32_t sum = 0;
+		for (uint32_t i = 0; i < loops; ++i)
 		{
-			Min_ = Max_ = d;
+			arr.stripe(idx).lock();
+			++sum;
+			arr.stripe(idx).unlock();
 		}
+		Assert(sum == loops);
+	};
 
-		++Count_;
-	}
-
-	void Print() const
-	{
-		printf("Min:%gus, Max:%gus, Avg:%gus, Cnt:%zu",
-		       Min_, Max_, Total_ / Count_, Count_);
-	}
-};
+	std::vector<std::thread> thdList;
+	auto t = GetTickMicrosec();
 
-template <class TCondVar, class TLock, class TGuard, class TSleep>
-PLATFORM_NOINLINE static void TestCondVarSwitch(const char *name, TSleep funcSleep)
-{
-	const uint32_t threadCount = 4;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		thdList.emplace_back(func, i);
+	for (auto &thd : thdList)
+		thd.join();
 
-	struct Context
-	{
-		TCondVar CondVar_;
-		TLock Lock_;
-		std::deque<uint64_t> DataList_;
+	t = GetTickMicrosec() - t;
+	printf("[Stripe] %s: %u threads, stride %u bytes, %gms\n",
+	       name, threadCount,
+	       (uint32_t)(reinterpret_cast<uintptr_t>(&arr.stripe(1)) - reinterpret_cast<uintptr_t>(&arr.stripe(0))),
+	       t / 1000.0);
+}
 
-		uint64_t WaitData()
-		{
-			TGuard lk(Lock_);
-			CondVar_.wait(lk, [this]() { return !DataList_.empty(); });
-			uint64_t ret = DataList_.front();
-			DataList_.pop_front();
-			return ret;
-		}
+PLATFORM_NOINLINE static void TestLockArrayPerf()
+{
+	const uint32_t loops =
+#if defined(PLATFORM_IS_DEBUG) || defined(PLATFORM_IS_IPHONE)
+			1000000;
+#else
+		10000000;
+#endif
+	uint32_t thds = (std::max)(std::thread::hardware_concurrency(), 2u);
 
-		void NotifyData(uint64_t d, bool isAll)
-		{
-			TGuard lk(Lock_);
-			DataList_.push_back(d);
+	TestLockArrayLayout<SRWStripeLayout::Packed>("Packed", thds, loops);
+	TestLockArrayLayout<SRWStripeLayout::CacheLine>("CacheLine", thds, loops);
+	TestLockArrayLayout<SRWStripeLayout::NumaNode>("NumaNode", thds, loops);
+}
 
-			if (isAll)
-				CondVar_.notify_all();
-			else
-				CondVar_.notify_one();
-		}
+// 小记录读多写少, 对比共享加锁读取与乐观读取
+template <bool IsOptimistic>
+static void TestSeqRead(const char *name, uint32_t threadCount, uint32_t loops)
+{
+	SRWSeqLock locker;
+	uint64_t value1 = 0, value2 = 0;
+	volatile bool isExit = false;
 
-		void NotifyDataList(const std::vector<uint64_t> &dlst, bool isAll)
+	auto funcReader = [&]()
+	{
+		for (uint32_t i = 0; i < loops; ++i)
 		{
-			TGuard lk(Lock_);
-			DataList_.insert(DataList_.end(), dlst.begin(), dlst.end());
-
-			if (isAll)
-				CondVar_.notify_all();
+			uint64_t v1, v2;
+			if (IsOptimistic)
+			{
+				locker.read([&]()
+				{
+					v1 = static_cast<volatile uint64_t&>(value1);
+					v2 = static_cast<volatile uint64_t&>(value2);
+				});
+			}
 			else
-				CondVar_.notify_one();
+			{
+				SharedLockGuard<SRWSeqLock> lk(locker);
+				v1 = value1;
+				v2 = value2;
+			}
+			Assert(v1 == v2);
 		}
 	};
 
-	bool isExit = false;
-
-	Context ctxProducer, ctxCustomer;
-	auto funcCustomer = [&]()
+	auto funcWriter = [&]()
 	{
 		while (!isExit)
 		{
-			uint64_t data = ctxCustomer.WaitData();
-			if (data)
-				ctxProducer.NotifyData(data, false);
-			else
-				Assert(isExit);
+			{
+				LockGuard<SRWSeqLock> lk(locker);
+				static_cast<volatile uint64_t&>(value1) = value1 + 1;
+				static_cast<volatile uint64_t&>(value2) = value2 + 1;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
 		}
 	};
 
-	AvgCounter ac;
-	auto funcProducer = [&]()
-	{
-		while (!isExit)
-		{
-			funcSleep();
+	std::thread writer(funcWriter);
+	std::vector<std::thread> thdList;
+	auto t = GetTickMicrosec();
 
-			uint64_t ts = GetTickMicrosec();
+	for (uint32_t i = 0; i < threadCount; ++i)
+		thdList.emplace_back(funcReader);
+	for (auto &thd : thdList)
+		thd.join();
+
+	t = GetTickMicrosec() - t;
+	isExit = true;
+	writer.join();
+
+	printf("[SeqRead] %s: %u threads, %llu writes, %gms\n",
+	       name, threadCount, (unsigned long long)value1, t / 1000.0);
+}
+
+PLATFORM_NOINLINE static void TestSeqLockPerf()
+{
+	const uint32_t loops =
+#if defined(PLATFORM_IS_DEBUG) || defined(PLATFORM_IS_IPHONE)
+			1000000;
+#else
+		10000000;
+#endif
+	uint32_t thds = (std::max)(std::thread::hardware_concurrency(), 2u);
+
+	TestSeqRead<false>("lock_shared", thds, loops);
+	TestSeqRead<true>("optimistic", thds, loops);
+}
+
+static void LockOnNode(SRWLock &locker, uint32_t)
+{
+	locker.lock();
+}
+
+static void LockOnNode(SRWCohortLock &locker, uint32_t node)
+{
+	locker.lock(node);
+}
+
+// 线程依次绑定到各个处理器从而分散到所有节点, 临界区修改若干缓存行,
+// 统计所有权在节点之间迁移的次数
+template <class TLock>
+static void TestCohort(const char *name, uint32_t threadCount, uint32_t loops)
+{
+	TLock locker;
+	uint64_t data[32] = {};
+	uint32_t lastNode = 0;
+	uint32_t migrations = 0;
+
+	auto func = [&](uint32_t idx)
+	{
+#if defined(PLATFORM_IS_LINUX)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(idx % std::thread::hardware_concurrency(), &cpuSet);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+#endif
+		uint32_t node = SRWLock_GetCurrentNode();
+
+		for (uint32_t i = 0; i < loops; ++i)
+		{
+			LockOnNode(locker, node);
+			if (lastNode != node)
+			{
+				lastNode = node;
+				++migrations;
+			}
+			for (auto &d : data)
+				++d;
+			locker.unlock();
+		}
+	};
+
+	std::vector<std::thread> thdList;
+	auto t = GetTickMicrosec();
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+		thdList.emplace_back(func, i);
+	for (auto &thd : thdList)
+		thd.join();
+
+	t = GetTickMicrosec() - t;
+	printf("[Cohort] %s: %u threads, %u nodes, %u migrations, %gms\n",
+	       name, threadCount, SRWLock_GetNodeCount(), migrations, t / 1000.0);
+	Assert(data[0] == (uint64_t)threadCount * loops);
+}
+
+PLATFORM_NOINLINE static void TestCohortLockPerf()
+{
+	const uint32_t loops =
+#if defined(PLATFORM_IS_DEBUG) || defined(PLATFORM_IS_IPHONE)
+			100000;
+#else
+		1000000;
+#endif
+	uint32_t thds = (std::max)(std::thread::hardware_concurrency(), 2u);
+
+	TestCohort<SRWLock>("SRWLock", thds, loops);
+	TestCohort<SRWCohortLock>("SRWCohortLock", thds, loops);
+}
+
+// 单线程无竞争时的加解锁开销, 嵌套时只有最外层访问锁状态
+template <class TLock>
+static void TestRecLockCost(const char *name, uint32_t depth, uint32_t loops)
+{
+	TLock locker;
+
+	auto t = GetTickNanosec();
+	for (uint32_t i = 0; i < loops; ++i)
+	{
+		for (uint32_t d = 0; d < depth; ++d)
+			locker.lock();
+		for (uint32_t d = 0; d < depth; ++d)
+			locker.unlock();
+	}
+	t = GetTickNanosec() - t;
+
+	printf("[Recursive] %s: depth %u, %gns/lock\n", name, depth, (double)t / ((uint64_t)loops * depth));
+}
+
+template <class TLock>
+static void TestRecSharedCost(const char *name, uint32_t depth, uint32_t loops)
+{
+	TLock locker;
+
+	auto t = GetTickNanosec();
+	for (uint32_t i = 0; i < loops; ++i)
+	{
+		for (uint32_t d = 0; d < depth; ++d)
+			locker.lock_shared();
+		for (uint32_t d = 0; d < depth; ++d)
+			locker.unlock_shared();
+	}
+	t = GetTickNanosec() - t;
+
+	printf("[Recursive] %s: shared depth %u, %gns/lock\n", name, depth, (double)t / ((uint64_t)loops * depth));
+}
+
+PLATFORM_NOINLINE static void TestRecLockPerf()
+{
+	const uint32_t loops =
+#if defined(PLATFORM_IS_DEBUG) || defined(PLATFORM_IS_IPHONE)
+			1000000;
+#else
+		10000000;
+#endif
+
+	TestRecLockCost<SRWLock>("SRWLock", 1, loops);
+	TestRecLockCost<SRWRecLock>("SRWRecLock", 1, loops);
+	TestRecLockCost<SRWRecLock>("SRWRecLock", 4, loops / 4);
+	TestRecLockCost<std::recursive_mutex>("std::recursive_mutex", 1, loops);
+	TestRecLockCost<std::recursive_mutex>("std::recursive_mutex", 4, loops / 4);
+
+	TestRecLockCost<SRWRecSharedLock>("SRWRecSharedLock", 1, loops);
+	TestRecSharedCost<SRWLock>("SRWLock", 1, loops);
+	TestRecSharedCost<SRWRecSharedLock>("SRWRecSharedLock", 1, loops);
+	TestRecSharedCost<SRWRecSharedLock>("SRWRecSharedLock", 4, loops / 4);
+}
+
+// 写者突发与读者洪流交替时的加锁延迟分布
+template <class TLock>
+static void TestTailLatency(const char *name, uint32_t readerCount, uint32_t writerCount)
+{
+	const uint64_t duration = 500000;
+
+	TLock locker;
+	uint32_t value = 0;
+	volatile bool isExit = false;
+
+	std::vector<std::vector<uint64_t>> readLatency(readerCount), writeLatency(writerCount);
+
+	auto funcReader = [&](std::vector<uint64_t> *pLatency)
+	{
+		while (!isExit)
+		{
+			uint64_t stt = GetTickNanosec();
+			locker.lock_shared();
+			pLatency->push_back(GetTickNanosec() - stt);
+			uint32_t v = value;
+			for (uint32_t i = 0; i < 50; ++i)
+				Assert(value == v);
+			locker.unlock_shared();
+		}
+	};
+
+	auto funcWriter = [&](std::vector<uint64_t> *pLatency)
+	{
+		while (!isExit)
+		{
+			// 连续多次写入后暂停
+			for (uint32_t i = 0; i < 8; ++i)
+			{
+				uint64_t stt = GetTickNanosec();
+				locker.lock();
+				pLatency->push_back(GetTickNanosec() - stt);
+				++value;
+				locker.unlock();
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	};
+
+	std::vector<std::thread> thdList;
+	for (uint32_t i = 0; i < readerCount; ++i)
+		thdList.emplace_back(funcReader, &readLatency[i]);
+	for (uint32_t i = 0; i < writerCount; ++i)
+		thdList.emplace_back(funcWriter, &writeLatency[i]);
+
+	std::this_thread::sleep_for(std::chrono::microseconds(duration));
+	isExit = true;
+
+	for (auto &thd : thdList)
+		thd.join();
+
+	auto funcPrint = [name](const char *kind, std::vector<std::vector<uint64_t>> &latencyList)
+	{
+		std::vector<uint64_t> all;
+		for (auto &lst : latencyList)
+			all.insert(all.end(), lst.begin(), lst.end());
+		if (all.empty())
+			return;
+
+		std::sort(all.begin(), all.end());
+		auto funcPct = [&all](double pct)
+		{
+			return all[static_cast<size_t>((all.size() - 1) * pct)] / 1000.0;
+		};
+
+		printf("[TailLatency] %s %s: Cnt:%zu, P50:%gus, P99:%gus, P99.9:%gus, Max:%gus\n",
+		       name, kind, all.size(), funcPct(0.5), funcPct(0.99), funcPct(0.999), all.back() / 1000.0);
+	};
+
+	funcPrint("read", readLatency);
+	funcPrint("write", writeLatency);
+}
+
+PLATFORM_NOINLINE static void TestTailLatencyPerf()
+{
+	uint32_t thds = (std::max)(std::thread::hardware_concurrency(), 4u);
+	uint32_t writers = thds / 4;
+	uint32_t readers = thds - writers;
+
+	TestTailLatency<SRWLock>("SRWLock", readers, writers);
+	TestTailLatency<SRWPhaseFairLock>("SRWPhaseFairLock", readers, writers);
+#if !defined(PLATFORM_IS_IPHONE)
+	TestTailLatency<std::shared_mutex>("std::shared_mutex", readers, writers);
+#endif
+
+	// 线程数超过处理器数, 持有者可能被抢占, 等待者需要挂起而非持续自旋
+	TestTailLatency<SRWLock>("SRWLock.oversub", readers * 4, writers * 4);
+	TestTailLatency<SRWPhaseFairLock>("SRWPhaseFairLock.oversub", readers * 4, writers * 4);
+#if !defined(PLATFORM_IS_IPHONE)
+	TestTailLatency<std::shared_mutex>("std::shared_mutex.oversub", readers * 4, writers * 4);
+#endif
+}
+
+// 高争用下单次加锁的最长等待时间
+template <class TLock>
+static void TestLockMaxWait(const char *name, uint32_t threadCount)
+{
+	TLock locker;
+	uint32_t sum = 0;
+	volatile bool isExit = false;
+	std::vector<uint64_t> maxWait(threadCount);
+
+	auto func = [&](uint64_t *pMaxWait)
+	{
+		while (!isExit)
+		{
+			uint64_t stt = GetTickMicrosec();
+			locker.lock();
+			uint64_t waitTime = GetTickMicrosec() - stt;
+			if (waitTime > *pMaxWait)
+				*pMaxWait = waitTime;
+
+			for (uint32_t i = 0; i < 100; ++i)
+				++sum;
+			locker.unlock();
+		}
+	};
+
+	std::vector<std::thread> thdList;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		thdList.emplace_back(func, &maxWait[i]);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	isExit = true;
+
+	for (auto &thd : thdList)
+		thd.join();
+
+	printf("[MaxWait] %s: Cnt:%u, Max:%lluus\n",
+	       name, sum / 100, *std::max_element(maxWait.begin(), maxWait.end()));
+}
+
+PLATFORM_NOINLINE static void TestHandoffLock()
+{
+	{
+		SRWHandoffLock lk;
+		Assert(lk.try_lock());
+		Assert(!lk.try_lock());
+		lk.unlock();
+		lk.lock();
+		lk.unlock();
+		Assert(!lk.is_starving());
+	}
+
+	{
+		// 阈值为 0 时每次竞争都直接移交
+		SRWHandoffLock lk(0);
+		uint32_t sum = 0;
+		const uint32_t loops = 100000;
+
+		auto func = [&]()
+		{
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				LockGuard<SRWHandoffLock> guard(lk);
+				++sum;
+			}
+		};
+
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < 4; ++i)
+			thdList.emplace_back(func);
+		for (auto &thd : thdList)
+			thd.join();
+
+		Assert(sum == loops * 4);
+		Assert(lk.try_lock());
+		lk.unlock();
+	}
+
+	TestLockRace<SRWHandoffLock>("SRWHandoffLock", 1000000);
+
+	uint32_t thds = (std::max)(std::thread::hardware_concurrency(), 4u);
+	TestLockMaxWait<SRWLock>("SRWLock", thds);
+	TestLockMaxWait<SRWHandoffLock>("SRWHandoffLock", thds);
+	TestLockMaxWait<std::mutex>("std::mutex", thds);
+
+	puts("TestHandoffLock OK");
+}
+
+PLATFORM_NOINLINE static void TestPhaseFairLock()
+{
+	SRWPhaseFairLock lk;
+
+	Assert(lk.try_lock());
+	Assert(!lk.try_lock());
+	Assert(!lk.try_lock_shared());
+	lk.unlock();
+
+	Assert(lk.try_lock_shared());
+	Assert(lk.try_lock_shared());
+	Assert(!lk.try_lock());
+	lk.unlock_shared();
+	lk.unlock_shared();
+
+	lk.lock();
+	lk.unlock();
+	lk.lock_shared();
+	lk.unlock_shared();
+
+	TestReadMostly<SRWPhaseFairLock>("SRWPhaseFairLock", 4, 100000, 5);
+	TestLockRace<SRWPhaseFairLock>("SRWPhaseFairLock", 100000);
+
+	puts("TestPhaseFairLock OK");
+}
+
+PLATFORM_NOINLINE static void TestPILock()
+{
+	SRWPILock lk;
+
+	Assert(lk.try_lock());
+	Assert(!lk.try_lock());
+	lk.unlock();
+
+	lk.lock();
+	Assert(!lk.try_lock());
+	lk.unlock();
+
+	TestLockRace<SRWPILock>("SRWPILock", 100000);
+	TestLockMaxWait<SRWPILock>("SRWPILock", 4);
+
+#if defined(PLATFORM_IS_LINUX)
+	// 子进程中缓存的线程 ID 不能沿用父进程的, 否则锁字记录的持有者是父进程的线程
+	lk.lock();
+	lk.unlock();
+	pid_t pid = fork();
+	Assert(pid >= 0);
+	if (pid == 0)
+	{
+		Assert(GetCurrentThreadID() == static_cast<uint32_t>(getpid()));
+		lk.lock();
+		lk.unlock();
+		_exit(0);
+	}
+	int status = 0;
+	Assert(waitpid(pid, &status, 0) == pid);
+	Assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#endif
+
+	puts("TestPILock OK");
+}
+
+#if defined(PLATFORM_IS_LINUX)
+// 优先级反转下高优先级线程的加锁延迟. 低优先级线程持有锁时被中优先级的忙碌线程抢占,
+// 不支持优先级继承的锁会让高优先级线程一直等到中优先级线程让出处理器.
+// 所有线程绑定到同一处理器, 需要实时调度权限, 否则跳过
+template <class TLock>
+static void TestPriorityInversion(const char *name)
+{
+	TLock locker;
+	volatile bool isExit = false;
+	volatile bool isRealTime = true;
+	std::vector<uint64_t> latency;
+	int cpu = sched_getcpu();
+
+	auto funcSched = [&isRealTime, cpu](int priority)
+	{
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(cpu, &cpuSet);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+
+		sched_param param{};
+		param.sched_priority = priority;
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+			isRealTime = false;
+	};
+
+	auto funcBusy = [](uint64_t microsecs)
+	{
+		uint64_t stt = GetTickMicrosec();
+		while (GetTickMicrosec() - stt < microsecs)
+			PLATFORM_YIELD;
+	};
+
+	std::thread thdLow([&]()
+	{
+		funcSched(10);
+		while (!isExit)
+		{
+			locker.lock();
+			funcBusy(200);
+			locker.unlock();
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	});
+
+	std::thread thdMedium([&]()
+	{
+		funcSched(20);
+		while (!isExit)
+		{
+			funcBusy(2000);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+
+	std::thread thdHigh([&]()
+	{
+		funcSched(30);
+		while (!isExit)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+			uint64_t stt = GetTickNanosec();
+			locker.lock();
+			latency.push_back(GetTickNanosec() - stt);
+			locker.unlock();
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	isExit = true;
+
+	thdLow.join();
+	thdMedium.join();
+	thdHigh.join();
+
+	if (!isRealTime)
+	{
+		printf("[PriorityInversion] %s: skipped, no real-time priority\n", name);
+		return;
+	}
+
+	std::sort(latency.begin(), latency.end());
+	auto funcPct = [&latency](double pct)
+	{
+		return latency[static_cast<size_t>((latency.size() - 1) * pct)] / 1000.0;
+	};
+
+	printf("[PriorityInversion] %s: Cnt:%zu, P50:%gus, P99:%gus, Max:%gus\n",
+	       name, latency.size(), funcPct(0.5), funcPct(0.99), latency.back() / 1000.0);
+}
+#endif
+
+PLATFORM_NOINLINE static void TestPriorityInversionPerf()
+{
+#if defined(PLATFORM_IS_LINUX)
+	TestPriorityInversion<SRWLock>("SRWLock");
+	TestPriorityInversion<std::mutex>("std::mutex");
+	TestPriorityInversion<SRWPILock>("SRWPILock");
+#endif
+}
+
+// 不同持有时长下自旋估计值的变化
+PLATFORM_NOINLINE static void TestAdaptiveSpin()
+{
+	auto funcHold = [](uint64_t holdNanosec)
+	{
+		SRWAdaptiveLock locker;
+		const uint32_t loops = 2000;
+
+		auto func = [&locker, holdNanosec]()
+		{
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				LockGuard<SRWAdaptiveLock> lk(locker);
+				uint64_t stt = GetTickNanosec();
+				while (GetTickNanosec() - stt < holdNanosec)
+					PLATFORM_YIELD;
+			}
+		};
+
+		std::thread thd1(func);
+		std::thread thd2(func);
+		thd1.join();
+		thd2.join();
+
+		printf("[AdaptiveSpin] hold %lluns: estimate %d\n",
+		       holdNanosec, static_cast<int32_t>(locker.spin_estimate()));
+	};
+
+	funcHold(200);
+	funcHold(2000);
+	funcHold(200000);
+}
+
+PLATFORM_NOINLINE static void TestBiasedLock()
+{
+	{
+		SRWBiasedLock lk;
+		Assert(lk.is_biased());
+
+		Assert(lk.try_lock_shared());
+		Assert(lk.try_lock_shared());
+		lk.unlock_shared();
+		lk.unlock_shared();
+
+		Assert(lk.try_lock());
+		Assert(!lk.is_biased());
+		Assert(!lk.try_lock_shared());
+		lk.unlock();
+	}
+
+	// 独占者撤销偏向后等待已登记的共享者离开
+	{
+		SRWBiasedLock lk;
+		lk.lock_shared();
+		Assert(lk.is_biased());
+
+		// 不等待的撤销失败, 登记仍然有效
+		Assert(!lk.try_lock());
+		Assert(lk.is_biased());
+
+		uint32_t isLocked = 0;
+		std::thread thd([&lk, &isLocked]()
+		{
+			lk.lock();
+			Atomic::Exchange<uint32_t>(&isLocked, 1);
+			lk.unlock();
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		Assert(!Atomic::LoadRelaxed(&isLocked));
+		lk.unlock_shared();
+		thd.join();
+		Assert(isLocked);
+
+		// 撤销耗时较长, 冷却期内共享者不会重新开启偏向
+		lk.lock_shared();
+		Assert(!lk.is_biased());
+		lk.unlock_shared();
+
+		// 冷却结束后由共享者重新开启
+		uint64_t stt = GetTickNanosec();
+		while (!lk.is_biased())
+		{
+			Assert(GetTickNanosec() - stt < 10000000000ULL);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			lk.lock_shared();
+			lk.unlock_shared();
+		}
+
+		lk.lock_shared();
+		lk.unlock_shared();
+		Assert(lk.try_lock());
+		lk.unlock();
+	}
+
+	// 多个锁同时被多个线程共享持有, 读者表槽位频繁冲突.
+	// 同时解锁的同槽位共享者不能都当作登记持有返回, 否则共享计数泄漏, 独占者永远阻塞
+	{
+		const uint32_t lockCount = 256;
+		const uint32_t thdCount = 8;
+		const uint32_t loops = 200;
+		std::unique_ptr<SRWBiasedLock[]> locks(new SRWBiasedLock[lockCount]);
+
+		std::vector<std::thread> thds;
+		for (uint32_t t = 0; t < thdCount; ++t)
+		{
+			thds.emplace_back([&locks, t]()
+			{
+				for (uint32_t n = 0; n < loops; ++n)
+				{
+					for (uint32_t i = 0; i < lockCount; ++i)
+						locks[i].lock_shared();
+					for (uint32_t i = 0; i < lockCount; ++i)
+						locks[(i + t) % lockCount].unlock_shared();
+
+					// 周期性撤销偏向
+					if (n % 16 == t)
+					{
+						locks[n % lockCount].lock();
+						locks[n % lockCount].unlock();
+					}
+				}
+			});
+		}
+		for (auto &thd : thds)
+			thd.join();
+
+		for (uint32_t i = 0; i < lockCount; ++i)
+		{
+			Assert(locks[i].try_lock());
+			locks[i].unlock();
+		}
+	}
+
+	TestLockRace<SRWBiasedLock>("SRWBiasedLock", 100000);
+	TestReadMostly<SRWBiasedLock>("SRWBiasedLock", 4, 100000, 10);
+
+	puts("TestBiasedLock OK");
+}
+
+PLATFORM_NOINLINE static void TestSRWLock32()
+{
+	SRWLock32 lk;
+	static_assert(sizeof(SRWLock32) == 4, "SRWLock32 size");
+
+	Assert(lk.try_lock());
+	Assert(!lk.try_lock());
+	Assert(!lk.try_lock_shared());
+	lk.unlock();
+
+	Assert(lk.try_lock_shared());
+	Assert(lk.try_lock_shared());
+	Assert(!lk.try_lock());
+	lk.unlock_shared();
+	lk.unlock_shared();
+
+	lk.lock();
+	lk.unlock();
+	lk.lock_shared();
+	lk.unlock_shared();
+
+	TestLockRace<SRWLock32>("SRWLock32", 100000);
+	TestLockMaxWait<SRWLock32>("SRWLock32", 4);
+	TestReadMostly<SRWLock32>("SRWLock32", 4, 100000, 10);
+
+	puts("TestSRWLock32 OK");
+}
+
+PLATFORM_NOINLINE static void TestSRWLockArray()
+{
+	{
+		SRWLockArray<SRWLock, SRWStripeLayout::Packed> packed(4);
+		SRWLockArray<SRWLock, SRWStripeLayout::CacheLine> padded(4);
+		SRWLockArray<SRWLock, SRWStripeLayout::NumaNode> paged(4);
+		Assert(reinterpret_cast<uintptr_t>(&packed.stripe(1)) - reinterpret_cast<uintptr_t>(&packed.stripe(0)) == sizeof(SRWLock));
+		Assert(reinterpret_cast<uintptr_t>(&padded.stripe(1)) - reinterpret_cast<uintptr_t>(&padded.stripe(0)) == 64);
+		Assert(reinterpret_cast<uintptr_t>(&paged.stripe(1)) - reinterpret_cast<uintptr_t>(&paged.stripe(0)) == 4096);
+	}
+
+	SRWLockArray<> arr(10);
+	Assert(arr.size() == 16);
+
+	Assert(arr.try_lock(1));
+	Assert(!arr.try_lock(1));
+	Assert(!arr.try_lock_shared(1));
+	arr.unlock(1);
+
+	size_t hashes[] = { 5, 9, 5, 100 };
+	size_t indices[4];
+	size_t num = arr.lock_many(hashes, 4, indices);
+	Assert(num >= 1 && num <= 3);
+	Assert(std::is_sorted(indices, indices + num));
+	for (size_t h : hashes)
+		Assert(!arr.try_lock_shared(h));
+	arr.unlock_many(indices, num);
+
+	num = arr.lock_many_shared(hashes, 4, indices);
+	for (size_t h : hashes)
+		Assert(!arr.try_lock(h));
+	arr.unlock_many_shared(indices, num);
+
+	// 多个线程在随机的两个账户间转账, 整表共享锁定时总额不变
+	const uint32_t accountCount = 64;
+	const uint32_t threadCount = 4;
+	const uint32_t loops = 50000;
+	std::vector<int32_t> accounts(accountCount, 100);
+
+	auto funcTransfer = [&](uint32_t seed)
+	{
+		uint32_t rnd = seed * 2654435761u + 1;
+		for (uint32_t i = 0; i < loops; ++i)
+		{
+			rnd ^= rnd << 13;
+			rnd ^= rnd >> 17;
+			rnd ^= rnd << 5;
+			size_t keys[] = { rnd % accountCount, (rnd >> 8) % accountCount };
+			size_t idx[2];
+
+			size_t n = arr.lock_many(keys, 2, idx);
+			--accounts[keys[0]];
+			++accounts[keys[1]];
+			arr.unlock_many(idx, n);
+		}
+	};
+
+	auto funcSum = [&]()
+	{
+		for (uint32_t i = 0; i < 200; ++i)
+		{
+			SharedLockAllGuard<SRWLockArray<>> lk(arr);
+			int32_t sum = 0;
+			for (int32_t v : accounts)
+				sum += v;
+			Assert(sum == 100 * accountCount);
+		}
+	};
+
+	std::vector<std::thread> thdList;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		thdList.emplace_back(funcTransfer, i);
+	thdList.emplace_back(funcSum);
+	for (auto &thd : thdList)
+		thd.join();
+
+	{
+		LockAllGuard<SRWLockArray<>> lk(arr);
+		Assert(!arr.try_lock_shared(7));
+	}
+	Assert(arr.try_lock(7));
+	arr.unlock(7);
+
+	puts("TestSRWLockArray OK");
+}
+
+PLATFORM_NOINLINE static void TestSeqLock()
+{
+	SRWSeqLock lk;
+
+	uint32_t version = lk.read_begin();
+	Assert(lk.read_validate(version));
+
+	Assert(lk.try_lock());
+	Assert(!lk.try_lock_shared());
+	Assert(lk.read_begin() & 1);
+	lk.unlock();
+	Assert(!lk.read_validate(version));
+	Assert(lk.read_validate(lk.read_begin()));
+
+	lk.lock_shared();
+	Assert(!lk.try_lock());
+	Assert(lk.read_validate(lk.read_begin()));
+	lk.unlock_shared();
+
+	// 写者持有锁时乐观读取失败, 退化为共享加锁并等待写者
+	uint32_t value = 0;
+	lk.lock();
+	std::thread reader([&]()
+	{
+		uint32_t v = 0;
+		lk.read([&]()
+		{
+			v = static_cast<volatile uint32_t&>(value);
+		});
+		Assert(v == 1);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	value = 1;
+	lk.unlock();
+	reader.join();
+
+	TestSeqRead<true>("optimistic", 4, 200000);
+
+	puts("TestSeqLock OK");
+}
+
+PLATFORM_NOINLINE static void TestMultiLock()
+{
+	SRWLock lkA, lkB, lkC;
+
+	{
+		LockMultiple(lkA, AsShared(lkB), lkC);
+		Assert(!lkA.try_lock_shared());
+		Assert(lkB.try_lock_shared());
+		lkB.unlock_shared();
+		Assert(!lkB.try_lock());
+		Assert(!lkC.try_lock_shared());
+		UnlockMultiple(lkA, AsShared(lkB), lkC);
+
+		Assert(lkA.try_lock());
+		Assert(lkB.try_lock());
+		Assert(lkC.try_lock());
+		UnlockMultiple(lkA, lkB, lkC);
+	}
+
+	{
+		// 阻塞在被占用的锁上, 释放后获得全部锁
+		lkB.lock();
+		volatile bool isLocked = false;
+		std::thread thd([&]()
+		{
+			MultiLockGuard guard(lkA, lkB, AsShared(lkC));
+			isLocked = true;
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		Assert(!isLocked);
+		Assert(lkA.try_lock());
+		lkA.unlock();
+		lkB.unlock();
+		thd.join();
+		Assert(isLocked);
+
+		MultiLockGuard guard(AsShared(lkA), AsShared(lkB));
+		Assert(!lkA.try_lock());
+		guard.unlock();
+		Assert(lkA.try_lock());
+		lkA.unlock();
+	}
+
+	{
+		// 以不同顺序和模式转账, 读者共享锁定全部账户核对总额
+		const uint32_t accountCount = 4;
+		const uint32_t threadCount = 6;
+		const uint32_t loops = 20000;
+		SRWLock locks[accountCount];
+		int64_t balances[accountCount] = { 1000, 1000, 1000, 1000 };
+
+		auto func = [&](uint32_t seed)
+		{
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				uint32_t from = (seed >> 16) % accountCount;
+				uint32_t to = (from + 1 + (seed >> 8) % (accountCount - 1)) % accountCount;
+
+				if ((seed >> 4) % 4)
+				{
+					MultiLockGuard guard(locks[from], locks[to]);
+					balances[from] -= 7;
+					balances[to] += 7;
+				}
+				else
+				{
+					MultiLockGuard guard(AsShared(locks[to]), AsShared(locks[from]),
+					                     AsShared(locks[(to + 1) % accountCount]), AsShared(locks[(to + 2) % accountCount]));
+					int64_t sum = 0;
+					for (uint32_t n = 0; n < accountCount; ++n)
+						sum += balances[n];
+					Assert(sum == 1000 * accountCount);
+				}
+			}
+		};
+
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			thdList.emplace_back(func, i + 1);
+		for (auto &thd : thdList)
+			thd.join();
+
+		int64_t sum = 0;
+		for (uint32_t n = 0; n < accountCount; ++n)
+			sum += balances[n];
+		Assert(sum == 1000 * accountCount);
+	}
+
+	puts("TestMultiLock OK");
+}
+
+#if defined(SRWLOCK_ENABLE_STATS)
+PLATFORM_NOINLINE static void TestLockStats()
+{
+	{
+		SRWLock lk;
+		for (int i = 0; i < 10; ++i)
+		{
+			lk.lock();
+			lk.unlock();
+			lk.lock_shared();
+			lk.unlock_shared();
+		}
+
+		SRWLockStats st = lk.stats();
+		Assert(st.FastAcquisitions == 20);
+		Assert(st.ContendedAcquisitions == 0);
+		Assert(st.Parks == 0 && st.WakeUps == 0);
+
+		// 等待者睡眠后被唤醒
+		lk.lock();
+		std::thread thd([&lk]()
+		{
+			lk.lock();
+			lk.unlock();
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		lk.unlock();
+		thd.join();
+
+		// 已退出线程的计数仍然保留
+		st = lk.stats();
+		Assert(st.FastAcquisitions == 21);
+		Assert(st.ContendedAcquisitions == 1);
+		Assert(st.Parks + st.SpinWins == 1);
+		Assert(st.WakeUps == st.Parks);
+		Assert(st.WaitNanosec >= 20 * 1000 * 1000);
+
+		lk.reset_stats();
+		st = lk.stats();
+		Assert(st.Acquisitions() == 0 && st.WaitNanosec == 0);
+
+		lk.lock();
+		lk.unlock();
+		Assert(lk.stats().FastAcquisitions == 1);
+	}
+
+	{
+		// 多线程累加的总数与加锁次数一致
+		const uint32_t threadCount = 4;
+		const uint32_t loops = 50000;
+		SRWLock lk;
+		std::vector<std::thread> thds;
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			thds.emplace_back([&lk, loops]()
+			{
+				for (uint32_t j = 0; j < loops; ++j)
+				{
+					LockGuard<SRWLock> guard(lk);
+				}
+			});
+		}
+		for (auto &thd : thds)
+			thd.join();
+
+		SRWLockStats st = lk.stats();
+		printf("Stats: fast %llu, contended %llu, spin %llu, park %llu, wake %llu, wait %llums\n",
+			(unsigned long long)st.FastAcquisitions,
+			(unsigned long long)st.ContendedAcquisitions,
+			(unsigned long long)st.SpinWins,
+			(unsigned long long)st.Parks,
+			(unsigned long long)st.WakeUps,
+			(unsigned long long)(st.WaitNanosec / 1000000));
+		Assert(st.Acquisitions() == threadCount * loops);
+		Assert(st.SpinWins + st.Parks <= st.ContendedAcquisitions);
+	}
+
+	{
+		// 条件变量记录等待次数与通知唤醒
+		SRWLock lk;
+		SRWCondVar cv;
+		bool isReady = false;
+		std::thread thd([&]()
+		{
+			LockGuard<SRWLock> guard(lk);
+			cv.wait(guard, [&isReady]() { return isReady; });
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		{
+			LockGuard<SRWLock> guard(lk);
+			isReady = true;
+		}
+		cv.notify_all();
+		thd.join();
+
+		SRWLockStats st = cv.stats();
+		Assert(st.ContendedAcquisitions == 1);
+		Assert(st.Parks + st.SpinWins == 1);
+		Assert(st.WakeUps <= st.Parks);
+	}
+
+	{
+		// 锁销毁时移除统计, 同一地址上构造的锁从零开始计数
+		alignas(SRWLock) char storage[sizeof(SRWLock)];
+		SRWLock *pLock = new (storage) SRWLock();
+		pLock->lock();
+		pLock->unlock();
+		Assert(pLock->stats().FastAcquisitions == 1);
+		pLock->~SRWLock();
+
+		pLock = new (storage) SRWLock();
+		Assert(pLock->stats().Acquisitions() == 0);
+		pLock->~SRWLock();
+	}
+
+	{
+		// 使用的锁超过线程分片容量时换出到全局表, 计数不丢失
+		const uint32_t lockCount = 2048;
+		std::unique_ptr<SRWLock[]> locks(new SRWLock[lockCount]);
+		for (uint32_t n = 0; n < 2; ++n)
+		{
+			for (uint32_t i = 0; i < lockCount; ++i)
+			{
+				locks[i].lock();
+				locks[i].unlock();
+			}
+		}
+		for (uint32_t i = 0; i < lockCount; ++i)
+			Assert(locks[i].stats().FastAcquisitions == 2);
+	}
+
+	puts("TestLockStats OK");
+}
+
+PLATFORM_NOINLINE static void TestLockRegistry()
+{
+	SRWLock hotLock, coldLock;
+	SRWCondVar cv;
+	SRWLockRegistration hotReg(hotLock, "hot", "test");
+	SRWLockRegistration coldReg(coldLock, "cold \"quoted\"", "test");
+	SRWLockRegistration cvReg(cv, "cv", "test.cond");
+
+	{
+		// 未登记的锁不出现在报告中
+		SRWLock other;
+		SRWLockRegistration otherReg(other, "other");
+		Assert(SRWRegistry_Snapshot(nullptr, 0, REPORT_BY_WAIT_TIME) == 4);
+	}
+	Assert(SRWRegistry_Snapshot(nullptr, 0, REPORT_BY_WAIT_TIME) == 3);
+
+	for (int i = 0; i < 100; ++i)
+	{
+		LockGuard<SRWLock> guard(coldLock);
+	}
+
+	// 持有者睡眠期间其他线程排队等待
+	const uint32_t threadCount = 3;
+	hotLock.lock();
+	std::vector<std::thread> thds;
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		thds.emplace_back([&hotLock]()
+		{
+			LockGuard<SRWLock> guard(hotLock);
+		});
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	hotLock.unlock();
+	for (auto &thd : thds)
+		thd.join();
+
+	SRWLockReport reports[4];
+	size_t count = SRWRegistry_Snapshot(reports, 4, REPORT_BY_WAIT_TIME);
+	Assert(count == 3);
+	Assert(strcmp(reports[0].Name, "hot") == 0);
+	Assert(reports[0].Stats.ContendedAcquisitions == threadCount);
+	Assert(reports[0].Stats.MaxQueueLength == threadCount);
+
+	SRWRegistry_Snapshot(reports, 4, REPORT_BY_MAX_QUEUE);
+	Assert(strcmp(reports[0].Name, "hot") == 0);
+
+	SRWRegistry_Snapshot(reports, 4, REPORT_BY_CONTENDED_RATIO);
+	Assert(strcmp(reports[0].Name, "hot") == 0);
+	Assert(reports[0].ContendedRatio() > 0.5);
+	Assert(reports[2].ContendedRatio() == 0);
+
+	SRWRegistry_PrintTable(stdout, REPORT_BY_WAIT_TIME);
+	SRWRegistry_PrintJson(stdout, REPORT_BY_MAX_QUEUE, 2);
+
+	puts("TestLockRegistry OK");
+}
+#endif
+
+PLATFORM_NOINLINE static void TestHoldTime()
+{
+	{
+		// 子桶上界不小于原值, 误差不超过 1/16
+		for (uint64_t value = 1; value < (uint64_t(1) << 62); value = value * 3 + 1)
+		{
+			uint64_t upper = SRWHistogram::BucketUpperBound(SRWHistogram::BucketIndex(value));
+			Assert(upper >= value);
+			Assert(upper - value <= value / SRWHistogram::SUB_BUCKET_COUNT);
+		}
+		Assert(SRWHistogram::BucketIndex(uint64_t(-1)) == SRWHistogram::BUCKET_COUNT - 1);
+		Assert(SRWHistogram::BucketUpperBound(SRWHistogram::BUCKET_COUNT - 1) == uint64_t(-1));
+
+		SRWHistogram hist;
+		Assert(hist.percentile(50) == 0);
+		for (uint64_t value = 1; value <= 1000; ++value)
+			hist.record(value);
+
+		Assert(hist.count() == 1000);
+		uint64_t p50 = hist.percentile(50);
+		uint64_t p99 = hist.percentile(99);
+		Assert(p50 >= 500 && p50 <= 500 + 500 / 16);
+		Assert(p99 >= 990 && p99 <= 990 + 990 / 16);
+		Assert(hist.max() >= 1000 && hist.max() <= 1000 + 1000 / 16);
+		Assert(hist.percentile(0) == 1);
+
+		hist.reset();
+		Assert(hist.count() == 0 && hist.max() == 0);
+	}
+
+	{
+		// 独占者长时间持有, 共享者短暂持有
+		const uint32_t readerCount = 3;
+		const uint32_t readerLoops = 10000;
+		SRWLock lk;
+		SRWHoldTime holdTime;
+		std::vector<std::thread> thds;
+
+		thds.emplace_back([&]()
+		{
+			for (int i = 0; i < 10; ++i)
+			{
+				ProfiledLockGuard<SRWLock> guard(lk, holdTime);
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			}
+		});
+		for (uint32_t i = 0; i < readerCount; ++i)
+		{
+			thds.emplace_back([&]()
+			{
+				for (uint32_t j = 0; j < readerLoops; ++j)
+				{
+					ProfiledSharedLockGuard<SRWLock> guard(lk, holdTime);
+				}
+			});
+		}
+		for (auto &thd : thds)
+			thd.join();
+
+		Assert(holdTime.count(false) == 10);
+		Assert(holdTime.count(true) == readerCount * readerLoops);
+		Assert(holdTime.percentile_nanosec(50, false) >= 1500000);
+		Assert(holdTime.percentile_nanosec(50, true) < holdTime.percentile_nanosec(50, false));
+
+		printf("[HoldTime] exclusive p50 %lluns, p99 %lluns; shared p50 %lluns, p99 %lluns, max %lluns\n",
+			(unsigned long long)holdTime.percentile_nanosec(50, false),
+			(unsigned long long)holdTime.percentile_nanosec(99, false),
+			(unsigned long long)holdTime.percentile_nanosec(50, true),
+			(unsigned long long)holdTime.percentile_nanosec(99, true),
+			(unsigned long long)holdTime.max_nanosec(true));
+
+		// 提前解锁后不再重复记录
+		{
+			ProfiledLockGuard<SRWLock> guard(lk, holdTime);
+			guard.unlock();
+			Assert(lk.try_lock());
+			lk.unlock();
+		}
+		Assert(holdTime.count(false) == 11);
+	}
+
+	{
+		// 守卫的额外开销
+		const uint32_t loops = 1000000;
+		SRWLock lk;
+		SRWHoldTime holdTime;
+
+		uint64_t t = GetTickNanosec();
+		for (uint32_t i = 0; i < loops; ++i)
+		{
+			LockGuard<SRWLock> guard(lk);
+		}
+		uint64_t plain = GetTickNanosec() - t;
+
+		t = GetTickNanosec();
+		for (uint32_t i = 0; i < loops; ++i)
+		{
+			ProfiledLockGuard<SRWLock> guard(lk, holdTime);
+		}
+		uint64_t profiled = GetTickNanosec() - t;
+
+		printf("[HoldTime] LockGuard %gns, ProfiledLockGuard %gns\n", (double)plain / loops, (double)profiled / loops);
+	}
+
+	puts("TestHoldTime OK");
+}
+
+#if defined(SRWLOCK_ENABLE_WATCHDOG)
+static std::vector<SRWWatchdogReport> s_WatchdogReports;
+static std::mutex s_WatchdogMutex;
+
+static void OnWatchdogReport(const SRWWatchdogReport &report)
+{
+	std::lock_guard<std::mutex> lk(s_WatchdogMutex);
+	s_WatchdogReports.push_back(report);
+}
+
+// 持有 holdMs 毫秒期间由另一个线程排队等待
+template <class THold>
+static void HoldWithWaiter(SRWLock &lk, uint32_t holdMs, THold hold)
+{
+	std::thread thd([&lk]()
+	{
+		LockGuard<SRWLock> guard(lk);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(holdMs));
+	hold();
+	thd.join();
+}
+
+PLATFORM_NOINLINE static void TestWatchdog()
+{
+	SRWLock lk;
+	SRWLockRegistration reg(lk, "watched");
+
+	{
+		// 没有等待者时不报告
+		LockGuard<SRWLock> guard(lk);
+		std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		Assert(SRWWatchdog_Check(10000, OnWatchdogReport) == 0);
+	}
+
+	lk.lock();
+	HoldWithWaiter(lk, 60, [&lk]()
+	{
+		Assert(SRWWatchdog_Check(500000, OnWatchdogReport) == 0);
+		Assert(SRWWatchdog_Check(20000, OnWatchdogReport) == 1);
+		// 同一次持有只报告一次
+		Assert(SRWWatchdog_Check(20000, OnWatchdogReport) == 0);
+		lk.unlock();
+	});
+
+	Assert(s_WatchdogReports.size() == 1);
+	const SRWWatchdogReport &report = s_WatchdogReports[0];
+	Assert(report.Key == lk.native_handle());
+	Assert(!report.IsShared);
+	Assert(report.ThreadID != 0);
+	Assert(report.HoldMicrosec >= 50000);
+	Assert(report.QueueLength == 1);
+	s_WatchdogReports.clear();
+
+	// 共享持有与升降级
+	lk.lock_upgrade();
+	lk.unlock_upgrade_and_lock();
+	lk.unlock_and_lock_shared();
+	HoldWithWaiter(lk, 40, [&lk]()
+	{
+		SRWWatchdog_Check(20000);
+		Assert(SRWWatchdog_Check(20000, OnWatchdogReport) == 0);
+		lk.unlock_shared();
+	});
+
+	lk.lock_shared();
+	HoldWithWaiter(lk, 40, [&lk]()
+	{
+		Assert(SRWWatchdog_Check(20000, OnWatchdogReport) == 1);
+		lk.unlock_shared();
+	});
+	Assert(s_WatchdogReports.size() == 1 && s_WatchdogReports[0].IsShared);
+	s_WatchdogReports.clear();
+
+	{
+		// 条件变量等待期间不视为持有
+		SRWCondVar cv;
+		LockGuard<SRWLock> guard(lk);
+		cv.wait_for(guard, 40000);
+		HoldWithWaiter(lk, 20, [&]()
+		{
+			Assert(SRWWatchdog_Check(30000, OnWatchdogReport) == 0);
+			guard.unlock();
+		});
+	}
+
+	// 后台线程定期检查
+	SRWWatchdog_Start(20000, 5000, OnWatchdogReport);
+	lk.lock();
+	HoldWithWaiter(lk, 80, [&lk]()
+	{
+		lk.unlock();
+	});
+	SRWWatchdog_Stop();
+	Assert(s_WatchdogReports.size() == 1);
+	Assert(s_WatchdogReports[0].Key == lk.native_handle());
+	s_WatchdogReports.clear();
+
+	puts("TestWatchdog OK");
+}
+#endif
+
+PLATFORM_NOINLINE static void TestCohortLock()
+{
+	printf("NumaNodes: %u, CurrentNode: %u\n", SRWLock_GetNodeCount(), SRWLock_GetCurrentNode());
+
+	{
+		SRWCohortLock lk;
+		Assert(lk.try_lock(0));
+		Assert(!lk.try_lock(0));
+		// 其他节点的本地锁空闲, 但全局锁已被持有
+		Assert(!lk.try_lock(1));
+		lk.unlock();
+
+		lk.lock(1);
+		Assert(!lk.try_lock(0));
+		lk.unlock();
+
+		lk.lock();
+		lk.unlock();
+		Assert(lk.try_lock());
+		lk.unlock();
+	}
+
+	// 以指定节点模拟多节点竞争
+	for (uint32_t batchLimit : { 1u, 16u })
+	{
+		const uint32_t threadCount = 8;
+		const uint32_t loops = 100000;
+		SRWCohortLock lk(batchLimit);
+		uint32_t counter = 0;
+		uint32_t lastNode = 0;
+		uint32_t migrations = 0;
+
+		auto func = [&](uint32_t node)
+		{
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				lk.lock(node);
+				uint32_t v = counter;
+				if (lastNode != node)
+				{
+					lastNode = node;
+					++migrations;
+				}
+				counter = v + 1;
+				lk.unlock();
+			}
+		};
+
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			thdList.emplace_back(func, i % 4);
+		for (auto &thd : thdList)
+			thd.join();
+
+		Assert(counter == threadCount * loops);
+		Assert(lk.try_lock(3));
+		lk.unlock();
+		printf("Cohort batch %u: %u migrations\n", batchLimit, migrations);
+	}
+
+	puts("TestCohortLock OK");
+}
+
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+PLATFORM_NOINLINE static void TestCancellableWait()
+{
+	SRWLock lk;
+
+	{
+		std::stop_source src;
+		Assert(lk.lock(src.get_token()));
+		Assert(!lk.try_lock_shared());
+		lk.unlock();
+
+		// 已请求取消时仍可直接获得空闲的锁
+		src.request_stop();
+		Assert(lk.lock_shared(src.get_token()));
+		Assert(!lk.lock(src.get_token()));
+		lk.unlock_shared();
+	}
+
+	{
+		// 阻塞中的等待者被及时取消, 锁状态不受影响
+		lk.lock();
+		std::stop_source srcExcl, srcShared;
+		uint64_t cancelTime = 0;
+		uint64_t exclElapsed = 0, sharedElapsed = 0;
+
+		std::thread thdExcl([&]()
+		{
+			Assert(!lk.lock(srcExcl.get_token()));
+			exclElapsed = GetTickMicrosec() - cancelTime;
+		});
+		std::thread thdShared([&]()
+		{
+			Assert(!lk.lock_shared(srcShared.get_token()));
+			sharedElapsed = GetTickMicrosec() - cancelTime;
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		cancelTime = GetTickMicrosec();
+		srcExcl.request_stop();
+		srcShared.request_stop();
+		thdExcl.join();
+		thdShared.join();
+
+		Assert(!lk.try_lock_shared());
+		lk.unlock();
+		Assert(lk.try_lock());
+		lk.unlock();
+
+		printf("Cancel Elapsed: %lluus, %lluus\n", exclElapsed, sharedElapsed);
+	}
+
+	{
+		// 被唤醒的等待者随后被取消时, 唤醒需要传递给排在其后的等待者
+		for (uint32_t n = 0; n < 20; ++n)
+		{
+			lk.lock();
+			std::stop_source src;
+			uint32_t isAcquired = 0;
+
+			std::thread thdCancel([&]()
+			{
+				if (lk.lock(src.get_token()))
+					lk.unlock();
+			});
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			std::thread thdWait([&]()
+			{
+				lk.lock();
+				Atomic::StoreRelease<uint32_t>(&isAcquired, 1);
+				lk.unlock();
+			});
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+			lk.unlock();
+			src.request_stop();
+			thdCancel.join();
+
+			// 唤醒丢失时后继等待者将永远阻塞
+			uint64_t deadline = GetTickMicrosec() + 1000000;
+			while (!Atomic::LoadAcquire(&isAcquired) && GetTickMicrosec() < deadline)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			Assert(Atomic::LoadAcquire(&isAcquired));
+			thdWait.join();
+			Assert(lk.try_lock());
+			lk.unlock();
+		}
+	}
+
+	{
+		// 条件变量等待被取消后仍持有锁
+		SRWCondVar condVar;
+		std::stop_source src;
+		bool isReady = false;
+		bool isCancelled = false;
+
+		std::thread thd([&]()
+		{
+			LockGuard<SRWLock> guard(lk);
+			Assert(!condVar.wait(guard, src.get_token(), [&]()
+			{
+				return isReady;
+			}));
+			Assert(!lk.try_lock_shared());
+			isCancelled = true;
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		src.request_stop();
+		thd.join();
+		Assert(isCancelled);
+
+		// 被通知时不报告取消
+		std::stop_source srcNotify;
+		std::thread thdNotify([&]()
+		{
+			SharedLockGuard<SRWLock> guard(lk);
+			Assert(condVar.wait(guard, srcNotify.get_token(), [&]()
+			{
+				return isReady;
+			}));
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		{
+			LockGuard<SRWLock> guard(lk);
+			isReady = true;
+			condVar.notify_all();
+		}
+		thdNotify.join();
+	}
+
+	{
+		// 取消与解锁, 通知交错竞争
+		const uint32_t threadCount = 4;
+		const uint32_t loops = 20000;
+		SRWCondVar condVar;
+		std::mutex slotMutex;
+		std::stop_source *slots[threadCount] = {};
+		uint32_t exclusiveCount = 0;
+		uint32_t cancelCount = 0;
+		volatile bool isExit = false;
+
+		std::thread canceller([&]()
+		{
+			for (uint32_t i = 0; !isExit; ++i)
+			{
+				{
+					std::lock_guard<std::mutex> guard(slotMutex);
+					if (std::stop_source *pSrc = slots[i % threadCount])
+						pSrc->request_stop();
+				}
+				std::this_thread::yield();
+			}
+		});
+
+		auto func = [&](uint32_t idx)
+		{
+			uint32_t seed = idx + 1;
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				uint32_t op = (seed >> 16) % 5;
+
+				std::stop_source src;
+				{
+					std::lock_guard<std::mutex> guard(slotMutex);
+					slots[idx] = &src;
+				}
+
+				if (op == 0)
+				{
+					if (lk.lock(src.get_token()))
+					{
+						Assert(++exclusiveCount == 1);
+						std::this_thread::yield();
+						--exclusiveCount;
+						lk.unlock();
+					}
+					else
+						Atomic::IncrementFetch(&cancelCount);
+				}
+				else if (op == 1)
+				{
+					if (lk.lock_shared(src.get_token()))
+					{
+						Assert(exclusiveCount == 0);
+						lk.unlock_shared();
+					}
+					else
+						Atomic::IncrementFetch(&cancelCount);
+				}
+				else if (op == 2)
+				{
+					LockGuard<SRWLock> guard(lk);
+					Assert(exclusiveCount == 0);
+					if (condVar.wait(guard, src.get_token()))
+						Atomic::IncrementFetch(&cancelCount);
+					Assert(++exclusiveCount == 1);
+					--exclusiveCount;
+				}
+				else if (op == 3)
+				{
+					lk.lock();
+					Assert(++exclusiveCount == 1);
+					--exclusiveCount;
+					condVar.notify_one();
+					lk.unlock();
+				}
+				else
+				{
+					lk.lock_shared();
+					Assert(exclusiveCount == 0);
+					lk.unlock_shared();
+					condVar.notify_all();
+				}
+
+				std::lock_guard<std::mutex> guard(slotMutex);
+				slots[idx] = nullptr;
+			}
+		};
+
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			thdList.emplace_back(func, i);
+		for (auto &thd : thdList)
+			thd.join();
+
+		isExit = true;
+		canceller.join();
+
+		Assert(lk.try_lock());
+		lk.unlock();
+
+		printf("Cancel Race: %u cancels\n", cancelCount);
+	}
+
+	puts("TestCancellableWait OK");
+}
+#endif
+
+#if defined(SRWLOCK_HAS_COROUTINE)
+// 立即开始执行, 结束后自动销毁的协程
+struct TestAsyncTask
+{
+	struct promise_type
+	{
+		TestAsyncTask get_return_object()
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend()
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void()
+		{
+		}
+
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+};
+
+// 多线程执行器
+class TestAsyncExecutor : public SRWAsyncExecutor
+{
+public:
+	explicit TestAsyncExecutor(uint32_t threadCount)
+	{
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			ThreadList_.emplace_back([this]()
+			{
+				for (;;)
+				{
+					std::coroutine_handle<> handle;
+					{
+						std::unique_lock<std::mutex> lk(Mutex_);
+						CondVar_.wait(lk, [this]()
+						{
+							return IsExit_ || !Queue_.empty();
+						});
+						if (Queue_.empty())
+							return;
+						handle = Queue_.front();
+						Queue_.pop_front();
+					}
+					handle.resume();
+				}
+			});
+		}
+	}
+
+	~TestAsyncExecutor()
+	{
+		{
+			std::lock_guard<std::mutex> lk(Mutex_);
+			IsExit_ = true;
+		}
+		CondVar_.notify_all();
+		for (auto &thd : ThreadList_)
+			thd.join();
+	}
+
+	void Post(std::coroutine_handle<> handle) override
+	{
+		{
+			std::lock_guard<std::mutex> lk(Mutex_);
+			Queue_.push_back(handle);
+		}
+		CondVar_.notify_one();
+	}
+
+private:
+	std::mutex Mutex_;
+	std::condition_variable CondVar_;
+	std::deque<std::coroutine_handle<>> Queue_;
+	std::vector<std::thread> ThreadList_;
+	bool IsExit_ = false;
+};
+
+// 协程的参数会复制到协程帧内, 挂起后仍然有效
+struct TestAsyncContext
+{
+	SRWAsyncLock Lock;
+	SRWAsyncCondVar CondVar;
+	SRWAsyncExecutor *pExecutor = nullptr;
+	std::vector<uint32_t> Order;
+	std::deque<uint32_t> Queue;
+	uint32_t Value1 = 0;
+	uint32_t Value2 = 0;
+	uint32_t Consumed = 0;
+	uint32_t DoneCount = 0;
+};
+
+static TestAsyncTask AsyncLockOrder(TestAsyncContext *pCtx, uint32_t idx)
+{
+	co_await pCtx->Lock.lock_async(pCtx->pExecutor);
+	pCtx->Order.push_back(idx);
+	pCtx->Lock.unlock();
+}
+
+static TestAsyncTask AsyncLockRace(TestAsyncContext *pCtx, uint32_t idx, uint32_t loops)
+{
+	SRWAsyncLock &lk = pCtx->Lock;
+	for (uint32_t n = 0; n < loops; ++n)
+	{
+		if ((n + idx) % 4 == 0)
+		{
+			co_await lk.lock_async(pCtx->pExecutor);
+			++pCtx->Value1;
+			++pCtx->Value2;
+			lk.unlock();
+		}
+		else
+		{
+			co_await lk.lock_shared_async(pCtx->pExecutor);
+			Assert(pCtx->Value1 == pCtx->Value2);
+			lk.unlock_shared();
+		}
+	}
+	Atomic::IncrementFetch(&pCtx->DoneCount);
+}
+
+static TestAsyncTask AsyncConsumer(TestAsyncContext *pCtx)
+{
+	SRWAsyncLock &lk = pCtx->Lock;
+	co_await lk.lock_async(pCtx->pExecutor);
+	for (;;)
+	{
+		while (pCtx->Queue.empty())
+			co_await pCtx->CondVar.wait_async(lk, pCtx->pExecutor);
+
+		uint32_t item = pCtx->Queue.front();
+		pCtx->Queue.pop_front();
+		if (item == 0)
+			break;
+		++pCtx->Consumed;
+	}
+	lk.unlock();
+	Atomic::IncrementFetch(&pCtx->DoneCount);
+}
+
+static TestAsyncTask AsyncProducer(TestAsyncContext *pCtx, uint32_t item)
+{
+	co_await pCtx->Lock.lock_async(pCtx->pExecutor);
+	pCtx->Queue.push_back(item);
+	pCtx->CondVar.notify_one();
+	pCtx->Lock.unlock();
+}
+
+static void WaitAsyncDone(TestAsyncContext &ctx, uint32_t count)
+{
+	while (static_cast<volatile uint32_t&>(ctx.DoneCount) != count)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+PLATFORM_NOINLINE static void TestAsyncLock()
+{
+	{
+		TestAsyncContext ctx;
+		SRWAsyncLock &lk = ctx.Lock;
+
+		// 无竞争时同步完成
+		bool isDone = false;
+		[](SRWAsyncLock &lk, bool &isDone) -> TestAsyncTask
+		{
+			co_await lk.lock_async();
+			Assert(!lk.try_lock_shared());
+			lk.unlock();
+			co_await lk.lock_shared_async();
+			co_await lk.lock_shared_async();
+			Assert(!lk.try_lock());
+			lk.unlock_shared();
+			lk.unlock_shared();
+			isDone = true;
+		}(lk, isDone);
+		Assert(isDone);
+
+		// 持锁期间排队的协程在解锁时按顺序恢复
+		Assert(lk.try_lock());
+		for (uint32_t i = 0; i < 3; ++i)
+			AsyncLockOrder(&ctx, i);
+		Assert(ctx.Order.empty());
+		lk.unlock();
+		Assert(ctx.Order.size() == 3 && ctx.Order[0] == 0 && ctx.Order[1] == 1 && ctx.Order[2] == 2);
+	}
+
+	{
+		const uint32_t taskCount = 200;
+		const uint32_t loops = 500;
+
+		TestAsyncContext ctx;
+		TestAsyncExecutor exec(4);
+		ctx.pExecutor = &exec;
+
+		for (uint32_t i = 0; i < taskCount; ++i)
+			AsyncLockRace(&ctx, i, loops);
+
+		WaitAsyncDone(ctx, taskCount);
+		Assert(ctx.Value1 == taskCount * loops / 4);
+	}
+
+	// 生产者与等待条件的消费者协程
+	{
+		const uint32_t consumerCount = 8;
+		const uint32_t itemCount = 10000;
+
+		TestAsyncContext ctx;
+		TestAsyncExecutor exec(4);
+		ctx.pExecutor = &exec;
+
+		for (uint32_t i = 0; i < consumerCount; ++i)
+			AsyncConsumer(&ctx);
+		for (uint32_t i = 0; i < itemCount + consumerCount; ++i)
+			AsyncProducer(&ctx, i < itemCount ? i + 1 : 0);
+
+		WaitAsyncDone(ctx, consumerCount);
+		Assert(ctx.Consumed == itemCount);
+	}
+
+	puts("TestAsyncLock OK");
+}
+#endif
+
+#if defined(SRWLOCK_HAS_PROCESS_SHARED)
+PLATFORM_NOINLINE static void TestProcessLock()
+{
+	struct SharedData
+	{
+		SRWProcessLock Lock;
+		SRWProcessCondVar CondVar;
+		uint32_t Counter;
+		uint32_t IsReady;
+	};
+
+	void *pMem = mmap(nullptr, sizeof(SharedData), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	Assert(pMem != MAP_FAILED);
+	SharedData *pData = new (pMem) SharedData();
+	SRWProcessLock &lk = pData->Lock;
+
+	Assert(lk.try_lock());
+	Assert(!lk.try_lock());
+	Assert(!lk.try_lock_shared());
+	lk.unlock();
+	Assert(lk.try_lock_shared());
+	Assert(lk.try_lock_shared());
+	Assert(!lk.try_lock());
+	lk.unlock_shared();
+	lk.unlock_shared();
+
+	auto waitChildren = [](std::vector<pid_t> &children)
+	{
+		for (pid_t pid : children)
+		{
+			int status = 0;
+			Assert(waitpid(pid, &status, 0) == pid);
+			Assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		}
+		children.clear();
+	};
+
+	const uint32_t procCount = 4;
+	const uint32_t loopCount = 20000;
+	std::vector<pid_t> children;
+
+	// 多进程互斥累加, 共享读取时计数不变
+	for (uint32_t i = 0; i < procCount; ++i)
+	{
+		pid_t pid = fork();
+		Assert(pid >= 0);
+		if (pid == 0)
+		{
+			for (uint32_t n = 0; n < loopCount; ++n)
+			{
+				if (n % 4 == 0)
+				{
+					SharedLockGuard<SRWProcessLock> guard(lk);
+					uint32_t counter = pData->Counter;
+					std::this_thread::yield();
+					Assert(counter == pData->Counter);
+				}
+				else
+				{
+					LockGuard<SRWProcessLock> guard(lk);
+					++pData->Counter;
+				}
+			}
+			_exit(0);
+		}
+		children.push_back(pid);
+	}
+	waitChildren(children);
+	Assert(pData->Counter == procCount * (loopCount - loopCount / 4));
+
+	// 跨进程条件变量
+	pData->Counter = 0;
+	for (uint32_t i = 0; i < procCount; ++i)
+	{
+		pid_t pid = fork();
+		Assert(pid >= 0);
+		if (pid == 0)
+		{
+			{
+				LockGuard<SRWProcessLock> guard(lk);
+				pData->CondVar.wait(guard, [pData]()
+				{
+					return pData->IsReady != 0;
+				});
+				++pData->Counter;
+			}
+			_exit(0);
+		}
+		children.push_back(pid);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	{
+		LockGuard<SRWProcessLock> guard(lk);
+		pData->IsReady = 1;
+		pData->CondVar.notify_all();
+	}
+	waitChildren(children);
+	Assert(pData->Counter == procCount);
+
+	// 排队中的等待者进程被杀死后, 解锁者回收其等待槽并移交给后续等待者
+	pData->Counter = 0;
+	lk.lock();
+
+	pid_t deadPid = fork();
+	Assert(deadPid >= 0);
+	if (deadPid == 0)
+	{
+		lk.lock_shared();
+		_exit(0);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	pid_t livePid = fork();
+	Assert(livePid >= 0);
+	if (livePid == 0)
+	{
+		lk.lock();
+		++pData->Counter;
+		lk.unlock();
+		_exit(0);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	kill(deadPid, SIGKILL);
+	Assert(waitpid(deadPid, nullptr, 0) == deadPid);
+	lk.unlock();
+
+	children.push_back(livePid);
+	waitChildren(children);
+	Assert(pData->Counter == 1);
+	Assert(lk.try_lock());
+	lk.unlock();
+
+	// 共享等待者计入等待者计数前可能已被解锁者移交, 不能再自行加锁导致共享计数泄漏
+	{
+		const uint32_t thdCount = 8;
+		std::vector<std::thread> thds;
+		for (uint32_t t = 0; t < thdCount; ++t)
+		{
+			thds.emplace_back([&lk, pData, t]()
+			{
+				for (uint32_t n = 0; n < loopCount; ++n)
+				{
+					if ((n + t) % 16 == 0)
+					{
+						LockGuard<SRWProcessLock> guard(lk);
+						++pData->Counter;
+					}
+					else
+					{
+						SharedLockGuard<SRWProcessLock> guard(lk);
+					}
+				}
+			});
+		}
+		for (auto &thd : thds)
+			thd.join();
+
+		Assert(lk.try_lock());
+		lk.unlock();
+		Assert(lk.try_lock_shared());
+		lk.unlock_shared();
+	}
+
+	pData->~SharedData();
+	munmap(pMem, sizeof(SharedData));
+
+	puts("TestProcessLock OK");
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+template <class TLock>
+static uint64_t TestLockWake(uint32_t waitTime = 250)
+{
+	TLock locker;
+	uint64_t unlockTime = 0;
+	volatile bool isLocked = false;
+
+	std::thread thd([&locker, &unlockTime, &isLocked]()
+	{
+		locker.lock();
+		isLocked = true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+		unlockTime = GetTickMicrosec();
+		locker.unlock();
+	});
+
+	while (!isLocked)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(waitTime));
+
+	locker.lock();
+	uint64_t wakeTime = GetTickMicrosec() - unlockTime;
+	locker.unlock();
+
+	thd.join();
+
+	return wakeTime;
+}
+
+template <class TLock>
+PLATFORM_NOINLINE static void TestLockWakeSeq(const char *name)
+{
+	uint64_t result = TestLockWake<TLock>(250);
+	printf("[Wake] %s 1: %lluus\n", name, result);
+	result = TestLockWake<TLock>(480);
+	printf("[Wake] %s 2: %lluus\n", name, result);
+	result = TestLockWake<TLock>(495);
+	printf("[Wake] %s 3: %lluus\n", name, result);
+}
+
+PLATFORM_NOINLINE static void TestLockWakePerf()
+{
+	TestLockWakeSeq<SRWLock>("SRWLock");
+	TestLockWakeSeq<SRWAdaptiveLock>("SRWAdaptiveLock");
+	TestLockWakeSeq<std::mutex>("std::mutex");
+
+#if !defined(PLATFORM_IS_IPHONE)
+	TestLockWakeSeq<std::shared_mutex>("std::shared_mutex");
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+PLATFORM_NOINLINE static void SimpleTestCondVar()
+{
+	SRWCondVar condVar;
+	SRWLock lock;
+
+	{
+		LockGuard<SRWLock> lk(lock);
+		condVar.notify_one();
+		condVar.notify_all();
+	}
+	{
+		LockGuard<SRWLock> lk(lock);
+		auto stt = GetTickMicrosec();
+		bool isTimeOut = condVar.wait_for(lk, 500000);
+		auto dlt = GetTickMicrosec() - stt;
+		Assert(dlt > 400000);
+		Assert(isTimeOut);
+	}
+
+	{
+		SharedLockGuard<SRWLock> lk(lock);
+		condVar.notify_one();
+		condVar.notify_all();
+	}
+	{
+		SharedLockGuard<SRWLock> lk(lock);
+		auto stt = GetTickMicrosec();
+		bool isTimeOut = condVar.wait_for(lk, 500000);
+		auto dlt = GetTickMicrosec() - stt;
+		Assert(dlt > 400000);
+		Assert(isTimeOut);
+	}
+}
+
+PLATFORM_NOINLINE static void TestCondVar()
+{
+	bool isExit = false;
+
+	SRWCondVar condVar;
+	SRWLock lock;
+	uint64_t wakeTime = 0;
+
+	std::thread thd([&]()
+	{
+		{
+			LockGuard<SRWLock> lk(lock);
+
+			condVar.wait(lk, [&]()
+			{
+				return isExit;
+			});
+
+			uint64_t wakeElapsed = GetTickMicrosec() - wakeTime;
+			printf("wait Elapsed: %lluus\n", wakeElapsed);
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	{
+		LockGuard<SRWLock> lk(lock);
+		isExit = true;
+		wakeTime = GetTickMicrosec();
+		condVar.notify_one();
+	}
+
+	thd.join();
+}
+
+PLATFORM_NOINLINE static void TestCondVar2()
+{
+	SRWCondVar condVar;
+	SRWLock lock;
+	uint64_t wakeTime = 0;
+
+	std::thread thd([&]()
+	{
+		{
+			LockGuard<SRWLock> lk(lock);
+			bool isTimeOut = condVar.wait_for(lk, 4000000);
+			Assert(!isTimeOut);
+		}
+		uint64_t wakeElapsed = GetTickMicrosec() - wakeTime;
+		printf("wait_for Elapsed: %lluus\n", wakeElapsed);
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	{
+		LockGuard<SRWLock> lk(lock);
+		wakeTime = GetTickMicrosec();
+
+		condVar.notify_one();
+	}
+
+	thd.join();
+}
+
+struct AvgCounter
+{
+	double Total_ = 0;
+	double Min_ = 0;
+	double Max_ = 0;
+	size_t Count_ = 0;
+
+	void AddData(double d)
+	{
+		Total_ += d;
+
+		if (Count_)
+		{
+			Min_ = (std::min)(Min_, d);
+			Max_ = (std::max)(Max_, d);
+		}
+		else
+		{
+			Min_ = Max_ = d;
+		}
+
+		++Count_;
+	}
+
+	void Print() const
+	{
+		printf("Min:%gus, Max:%gus, Avg:%gus, Cnt:%zu",
+		       Min_, Max_, Total_ / Count_, Count_);
+	}
+};
+
+template <class TCondVar, class TLock, class TGuard, class TSleep>
+PLATFORM_NOINLINE static void TestCondVarSwitch(const char *name, TSleep funcSleep)
+{
+	const uint32_t threadCount = 4;
+
+	struct Context
+	{
+		TCondVar CondVar_;
+		TLock Lock_;
+		std::deque<uint64_t> DataList_;
+
+		uint64_t WaitData()
+		{
+			TGuard lk(Lock_);
+			CondVar_.wait(lk, [this]() { return !DataList_.empty(); });
+			uint64_t ret = DataList_.front();
+			DataList_.pop_front();
+			return ret;
+		}
+
+		void NotifyData(uint64_t d, bool isAll)
+		{
+			TGuard lk(Lock_);
+			DataList_.push_back(d);
+
+			if (isAll)
+				CondVar_.notify_all();
+			else
+				CondVar_.notify_one();
+		}
+
+		void NotifyDataList(const std::vector<uint64_t> &dlst, bool isAll)
+		{
+			TGuard lk(Lock_);
+			DataList_.insert(DataList_.end(), dlst.begin(), dlst.end());
+
+			if (isAll)
+				CondVar_.notify_all();
+			else
+				CondVar_.notify_one();
+		}
+	};
+
+	bool isExit = false;
+
+	Context ctxProducer, ctxCustomer;
+	auto funcCustomer = [&]()
+	{
+		while (!isExit)
+		{
+			uint64_t data = ctxCustomer.WaitData();
+			if (data)
+				ctxProducer.NotifyData(data, false);
+			else
+				Assert(isExit);
+		}
+	};
+
+	AvgCounter ac;
+	auto funcProducer = [&]()
+	{
+		while (!isExit)
+		{
+			funcSleep();
+
+			uint64_t ts = GetTickMicrosec();
 			ctxCustomer.NotifyData(ts, false);
 
-			uint64_t reply = ctxProducer.WaitData();
-			if (reply)
-			{
-				AssertDo(reply == ts, printf("reply: %llu, ts: %llu\n", reply, ts));
-				ac.AddData(static_cast<double>(GetTickMicrosec() - ts));
-			}
+			uint64_t reply = ctxProducer.WaitData();
+			if (reply)
+			{
+				AssertDo(reply == ts, printf("reply: %llu, ts: %llu\n", reply, ts));
+				ac.AddData(static_cast<double>(GetTickMicrosec() - ts));
+			}
+			else
+			{
+				Assert(isExit);
+			}
+		}
+	};
+
+	std::vector<std::thread> thdList(threadCount);
+	for (auto &thd : thdList)
+		thd = std::thread(funcCustomer);
+
+	std::thread thdProducer(funcProducer);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+	isExit = true;
+	ctxProducer.NotifyData(0, true);
+
+	std::vector<uint64_t> tsList(threadCount);
+	ctxCustomer.NotifyDataList(tsList, true);
+
+	for (auto &thd : thdList)
+		thd.join();
+	thdProducer.join();
+
+	printf("[CondVarSwitch] %s: ", name);
+	ac.Print();
+	puts("");
+}
+
+template <class TCondVar, class TLock, class TGuard, class TSleep>
+PLATFORM_NOINLINE static void TestThunderingHerd(const char *name, TSleep funcSleep)
+{
+	const uint32_t threadCount = 4;
+
+	struct Context
+	{
+		TCondVar CondVar_;
+		TLock Lock_;
+		std::deque<uint64_t> DataList_;
+
+		uint64_t WaitData()
+		{
+			TGuard lk(Lock_);
+			CondVar_.wait(lk, [this]() { return !DataList_.empty(); });
+			uint64_t ret = DataList_.front();
+			DataList_.pop_front();
+			return ret;
+		}
+
+		void NotifyData(uint64_t d, bool isAll)
+		{
+			TGuard lk(Lock_);
+			DataList_.push_back(d);
+
+			if (isAll)
+				CondVar_.notify_all();
+			else
+				CondVar_.notify_one();
+		}
+
+		void NotifyDataList(const std::vector<uint64_t> &dlst, bool isAll)
+		{
+			TGuard lk(Lock_);
+			DataList_.insert(DataList_.end(), dlst.begin(), dlst.end());
+
+			if (isAll)
+				CondVar_.notify_all();
+			else
+				CondVar_.notify_one();
+		}
+	};
+
+	bool isExit = false;
+
+	Context ctxProducer, ctxCustomer;
+	auto funcCustomer = [&]()
+	{
+		while (!isExit)
+		{
+			uint64_t data = ctxCustomer.WaitData();
+			if (data)
+				ctxProducer.NotifyData(data, false);
 			else
-			{
 				Assert(isExit);
+		}
+	};
+
+	AvgCounter ac;
+	auto funcProducer = [&]()
+	{
+		while (!isExit)
+		{
+			funcSleep();
+
+			uint64_t ts = GetTickMicrosec();
+
+			std::vector<uint64_t> tsList(threadCount);
+			for (auto &i : tsList)
+				i = ts;
+			ctxCustomer.NotifyDataList(tsList, true);
+
+			for (size_t i = 0; i < threadCount; ++i)
+			{
+				uint64_t reply = ctxProducer.WaitData();
+				if (reply)
+				{
+					AssertDo(reply == ts, printf("reply: %llu, ts: %llu\n", reply, ts));
+				}
+				else
+				{
+					Assert(isExit);
+					return;
+				}
 			}
+
+			ac.AddData(static_cast<double>(GetTickMicrosec() - ts));
 		}
 	};
 
@@ -571,194 +2957,754 @@ PLATFORM_NOINLINE static void TestCondVarSwitch(const char *name, TSleep funcSle
 	for (auto &thd : thdList)
 		thd = std::thread(funcCustomer);
 
-	std::thread thdProducer(funcProducer);
+	std::thread thdProducer(funcProducer);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+	isExit = true;
+	ctxProducer.NotifyData(0, true);
+
+	std::vector<uint64_t> tsList(threadCount);
+	ctxCustomer.NotifyDataList(tsList, true);
+
+	for (auto &thd : thdList)
+		thd.join();
+	thdProducer.join();
+
+	printf("[ThunderingHerd] %s: ", name);
+	ac.Print();
+	puts("");
+}
+
+//////////////////////////////////////////////////////////////////////////
+PLATFORM_NOINLINE static void TestSRWRecLock()
+{
+	SRWRecLock rl;
+
+	rl.lock();
+	rl.lock();
+	Assert(rl.try_lock());
+	Assert(rl.try_lock());
+
+	rl.unlock();
+	rl.unlock();
+	rl.unlock();
+	rl.unlock();
+
+	{
+		Assert(rl.try_lock());
+
+		bool result = false;
+		std::thread thd([&rl, &result]()
+		{
+			rl.lock();
+			rl.unlock();
+			result = true;
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		Assert(!result);
+		rl.unlock();
+
+		thd.join();
+		Assert(result);
+	}
+	{
+		Assert(rl.try_lock());
+
+		std::thread thd([&rl]()
+		{
+			Assert(!rl.try_lock());
+		});
+
+		thd.join();
+
+		rl.unlock();
+	}
+
+	puts("TestSRWRecLock OK");
+}
+
+PLATFORM_NOINLINE static void TestSRWRecSharedLock()
+{
+	SRWRecSharedLock rl;
+
+	rl.lock();
+	Assert(rl.try_lock());
+	// 持有独占时以共享方式重入
+	rl.lock_shared();
+	Assert(rl.try_lock_shared());
+	rl.unlock_shared();
+	rl.unlock_shared();
+	rl.unlock();
+	rl.unlock();
+
+	{
+		// 写者排队时嵌套共享加锁不会死锁
+		rl.lock_shared();
+
+		volatile bool isLocked = false;
+		std::thread thd([&rl, &isLocked]()
+		{
+			rl.lock();
+			isLocked = true;
+			rl.unlock();
+		});
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		rl.lock_shared();
+		Assert(rl.try_lock_shared());
+		Assert(!isLocked);
+		rl.unlock_shared();
+		rl.unlock_shared();
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		Assert(!isLocked);
+		rl.unlock_shared();
+
+		thd.join();
+		Assert(isLocked);
+	}
+
+	{
+		// 同时共享持有多个锁
+		SRWRecSharedLock rl2;
+		rl.lock_shared();
+		rl2.lock_shared();
+		rl.lock_shared();
+		rl.unlock_shared();
+		rl.unlock_shared();
+		Assert(rl.try_lock());
+		rl.unlock();
+		rl2.unlock_shared();
+		Assert(rl2.try_lock());
+		rl2.unlock();
+	}
+
+	{
+		// 读者嵌套进入, 写者嵌套写入并在写入中读取
+		const uint32_t threadCount = 4;
+		const uint32_t loops = 50000;
+		uint32_t value1 = 0, value2 = 0;
+
+		auto func = [&](uint32_t idx)
+		{
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				if ((i + idx) % 8 == 0)
+				{
+					rl.lock();
+					++value1;
+					rl.lock_shared();
+					Assert(value1 == value2 + 1);
+					rl.unlock_shared();
+					rl.lock();
+					++value2;
+					rl.unlock();
+					rl.unlock();
+				}
+				else
+				{
+					rl.lock_shared();
+					uint32_t v = value1;
+					rl.lock_shared();
+					Assert(value2 == v);
+					rl.unlock_shared();
+					rl.unlock_shared();
+				}
+			}
+		};
+
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			thdList.emplace_back(func, i);
+		for (auto &thd : thdList)
+			thd.join();
+
+		Assert(value1 == value2 && value1 == threadCount * loops / 8);
+	}
+
+	puts("TestSRWRecSharedLock OK");
+}
+
+//////////////////////////////////////////////////////////////////////////
+PLATFORM_NOINLINE static void TestSRWLockTimed()
+{
+	SRWLock lk;
+
+	{
+		Assert(lk.try_lock_for(0));
+		Assert(!lk.try_lock_for(1000));
+		Assert(!lk.try_lock_shared_for(1000));
+		lk.unlock();
+
+		Assert(lk.try_lock_shared_for(0));
+		Assert(lk.try_lock_shared_for(1000));
+		Assert(!lk.try_lock_until(GetTickMicrosec() + 1000));
+		lk.unlock_shared();
+		lk.unlock_shared();
+	}
+
+	{
+		volatile bool isLocked = false;
+		std::thread thd([&lk, &isLocked]()
+		{
+			lk.lock();
+			isLocked = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(300));
+			lk.unlock();
+		});
+
+		while (!isLocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		auto stt = GetTickMicrosec();
+		Assert(!lk.try_lock_for(50000));
+		Assert(!lk.try_lock_shared_for(50000));
+		auto dlt = GetTickMicrosec() - stt;
+		Assert(dlt >= 90000);
+
+		// 超大的时长不能因截止时间溢出而立即超时
+		Assert(lk.try_lock_for(static_cast<uint64_t>(-2)));
+		lk.unlock();
+
+		thd.join();
+	}
+
+	{
+		volatile bool isLocked = false;
+		std::thread thd([&lk, &isLocked]()
+		{
+			lk.lock();
+			isLocked = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			lk.unlock();
+		});
+
+		while (!isLocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		Assert(lk.try_lock_shared_for(static_cast<uint64_t>(-2)));
+		lk.unlock_shared();
+
+		thd.join();
+	}
+
+	{
+		volatile bool isLocked = false;
+		std::thread thd([&lk, &isLocked]()
+		{
+			lk.lock_shared();
+			isLocked = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(300));
+			lk.unlock_shared();
+		});
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+		while (!isLocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
 
-	isExit = true;
-	ctxProducer.NotifyData(0, true);
+		Assert(lk.try_lock_shared_for(50000));
+		lk.unlock_shared();
+		Assert(!lk.try_lock_for(50000));
 
-	std::vector<uint64_t> tsList(threadCount);
-	ctxCustomer.NotifyDataList(tsList, true);
+		Assert(lk.try_lock_shared_until(GetTickMicrosec() + 2000000));
+		lk.unlock_shared();
+		Assert(lk.try_lock_until(GetTickMicrosec() + 2000000));
+		lk.unlock();
 
-	for (auto &thd : thdList)
 		thd.join();
-	thdProducer.join();
+	}
 
-	printf("[CondVarSwitch] %s: ", name);
-	ac.Print();
-	puts("");
+	{
+		// 限时与普通等待者混合竞争
+		const uint32_t threadCount = 4;
+		const uint32_t loops = 20000;
+		uint32_t exclusiveCount = 0;
+		uint32_t timeOutCount = 0;
+
+		auto func = [&](uint32_t seed)
+		{
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				uint32_t op = (seed >> 16) % 4;
+				uint64_t timeOut = (seed >> 8) % 200;
+
+				if (op == 0)
+				{
+					lk.lock();
+					Assert(++exclusiveCount == 1);
+					--exclusiveCount;
+					lk.unlock();
+				}
+				else if (op == 1)
+				{
+					if (lk.try_lock_for(timeOut))
+					{
+						Assert(++exclusiveCount == 1);
+						std::this_thread::yield();
+						--exclusiveCount;
+						lk.unlock();
+					}
+					else
+						Atomic::IncrementFetch(&timeOutCount);
+				}
+				else
+				{
+					if (op == 2)
+						lk.lock_shared();
+					else if (!lk.try_lock_shared_for(timeOut))
+					{
+						Atomic::IncrementFetch(&timeOutCount);
+						continue;
+					}
+
+					Assert(exclusiveCount == 0);
+					lk.unlock_shared();
+				}
+			}
+		};
+
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			thdList.emplace_back(func, i + 1);
+		for (auto &thd : thdList)
+			thd.join();
+
+		Assert(lk.try_lock());
+		lk.unlock();
+
+		printf("Timed Race: %u timeouts\n", timeOutCount);
+	}
+
+	puts("TestSRWLockTimed OK");
 }
 
-template <class TCondVar, class TLock, class TGuard, class TSleep>
-PLATFORM_NOINLINE static void TestThunderingHerd(const char *name, TSleep funcSleep)
+PLATFORM_NOINLINE static void TestSRWLockUpgrade()
 {
-	const uint32_t threadCount = 4;
+	SRWLock lk;
 
-	struct Context
 	{
-		TCondVar CondVar_;
-		TLock Lock_;
-		std::deque<uint64_t> DataList_;
+		lk.lock_upgrade();
+		Assert(lk.try_lock_shared());
+		Assert(!lk.try_lock_upgrade());
+		Assert(!lk.try_lock());
+		lk.unlock_shared();
 
-		uint64_t WaitData()
-		{
-			TGuard lk(Lock_);
-			CondVar_.wait(lk, [this]() { return !DataList_.empty(); });
-			uint64_t ret = DataList_.front();
-			DataList_.pop_front();
-			return ret;
-		}
+		lk.unlock_upgrade_and_lock();
+		Assert(!lk.try_lock_shared());
+		lk.unlock_and_lock_shared();
+		Assert(lk.try_lock_shared());
+		Assert(lk.try_lock_upgrade());
+		lk.unlock_shared();
+		lk.unlock_shared();
 
-		void NotifyData(uint64_t d, bool isAll)
-		{
-			TGuard lk(Lock_);
-			DataList_.push_back(d);
+		lk.unlock_upgrade_and_lock_shared();
+		Assert(lk.try_lock_upgrade());
+		lk.unlock_upgrade();
+		lk.unlock_shared();
 
-			if (isAll)
-				CondVar_.notify_all();
-			else
-				CondVar_.notify_one();
-		}
+		Assert(lk.try_lock());
+		lk.unlock();
+	}
 
-		void NotifyDataList(const std::vector<uint64_t> &dlst, bool isAll)
+	{
+		// 升级期间排队的独占者不能插入
+		uint32_t value = 0;
+		volatile uint32_t stage = 0;
+
+		std::thread reader([&]()
 		{
-			TGuard lk(Lock_);
-			DataList_.insert(DataList_.end(), dlst.begin(), dlst.end());
+			lk.lock_shared();
+			stage = 1;
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			lk.unlock_shared();
+		});
+		while (stage != 1)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
 
-			if (isAll)
-				CondVar_.notify_all();
-			else
-				CondVar_.notify_one();
-		}
-	};
+		UpgradeLockGuard<SRWLock> guard(lk);
+		uint32_t readValue = value;
 
-	bool isExit = false;
+		std::thread writer([&]()
+		{
+			lk.lock();
+			value = 100;
+			lk.unlock();
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		guard.upgrade();
+		Assert(value == readValue);
+		value = readValue + 1;
+		guard.downgrade();
+		Assert(value == 1);
+		guard.unlock();
+
+		reader.join();
+		writer.join();
+		Assert(value == 100);
+	}
 
-	Context ctxProducer, ctxCustomer;
-	auto funcCustomer = [&]()
 	{
-		while (!isExit)
+		// 升级者, 共享者与独占者混合竞争
+		const uint32_t threadCount = 4;
+		const uint32_t loops = 20000;
+		uint32_t exclusiveCount = 0;
+		uint32_t upgradeCount = 0;
+		uint32_t value = 0;
+		uint32_t expected = 0;
+
+		auto func = [&](uint32_t seed)
 		{
-			uint64_t data = ctxCustomer.WaitData();
-			if (data)
-				ctxProducer.NotifyData(data, false);
-			else
-				Assert(isExit);
-		}
-	};
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				uint32_t op = (seed >> 16) % 4;
 
-	AvgCounter ac;
-	auto funcProducer = [&]()
+				if (op == 0)
+				{
+					lk.lock();
+					Assert(++exclusiveCount == 1);
+					++value;
+					--exclusiveCount;
+					lk.unlock();
+					Atomic::IncrementFetch(&expected);
+				}
+				else if (op == 1)
+				{
+					lk.lock_shared();
+					Assert(exclusiveCount == 0);
+					lk.unlock_shared();
+				}
+				else
+				{
+					UpgradeLockGuard<SRWLock> guard(lk);
+					Assert(++upgradeCount == 1);
+					Assert(exclusiveCount == 0);
+
+					uint32_t readValue = value;
+					if (op == 2)
+					{
+						--upgradeCount;
+						guard.upgrade();
+						Assert(++exclusiveCount == 1);
+						Assert(value == readValue);
+						value = readValue + 1;
+						--exclusiveCount;
+						Atomic::IncrementFetch(&expected);
+						guard.downgrade();
+					}
+					else
+					{
+						--upgradeCount;
+					}
+					Assert(exclusiveCount == 0);
+				}
+			}
+		};
+
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			thdList.emplace_back(func, i + 1);
+		for (auto &thd : thdList)
+			thd.join();
+
+		Assert(value == expected);
+		Assert(lk.try_lock());
+		lk.unlock();
+	}
+
+	puts("TestSRWLockUpgrade OK");
+}
+
+//////////////////////////////////////////////////////////////////////////
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+PLATFORM_NOINLINE static void TestWaitAny()
+{
 	{
-		while (!isExit)
+		SRWLock locks[3];
+		SRWLock *ppLocks[] = { &locks[0], &locks[1], &locks[2] };
+
+		Assert(SRWLock::lock_any(ppLocks, 3, 0) == 0);
+		Assert(SRWLock::lock_any(ppLocks, 3, 0) == 1);
+		Assert(SRWLock::lock_any(ppLocks, 3, 0) == 2);
+		Assert(SRWLock::lock_any(ppLocks, 3, 1000) == -1);
+		Assert(SRWLock::lock_shared_any(ppLocks, 3, 1000) == -1);
+
+		// 任一锁释放时获得该锁
+		size_t result = -1;
+		std::thread thd([&]()
 		{
-			funcSleep();
-
-			uint64_t ts = GetTickMicrosec();
+			result = SRWLock::lock_any(ppLocks, 3);
+			ppLocks[result]->unlock();
+		});
 
-			std::vector<uint64_t> tsList(threadCount);
-			for (auto &i : tsList)
-				i = ts;
-			ctxCustomer.NotifyDataList(tsList, true);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		locks[1].unlock();
+		thd.join();
+		Assert(result == 1);
+
+		locks[0].unlock();
+		Assert(SRWLock::lock_shared_any(ppLocks, 3, 1000) == 0);
+		Assert(SRWLock::lock_shared_any(ppLocks, 3, 1000) == 0);
+		locks[0].unlock_shared();
+		locks[0].unlock_shared();
+		locks[2].unlock();
+	}
 
-			for (size_t i = 0; i < threadCount; ++i)
+	{
+		// 多锁等待与普通等待者混合竞争
+		const uint32_t threadCount = 4;
+		const uint32_t loops = 20000;
+		SRWLock locks[4];
+		SRWLock *ppLocks[] = { &locks[0], &locks[1], &locks[2], &locks[3] };
+		uint32_t exclusiveCounts[4] = {};
+		uint32_t totals[4] = {};
+		uint32_t timeOutCount = 0;
+
+		auto func = [&](uint32_t seed)
+		{
+			for (uint32_t i = 0; i < loops; ++i)
 			{
-				uint64_t reply = ctxProducer.WaitData();
-				if (reply)
+				seed = seed * 1103515245 + 12345;
+				uint32_t op = (seed >> 16) % 4;
+				uint32_t idx = (seed >> 8) % 4;
+
+				if (op == 0)
 				{
-					AssertDo(reply == ts, printf("reply: %llu, ts: %llu\n", reply, ts));
+					locks[idx].lock();
+					Assert(++exclusiveCounts[idx] == 1);
+					++totals[idx];
+					--exclusiveCounts[idx];
+					locks[idx].unlock();
+				}
+				else if (op == 1)
+				{
+					locks[idx].lock_shared();
+					Assert(exclusiveCounts[idx] == 0);
+					locks[idx].unlock_shared();
+				}
+				else if (op == 2)
+				{
+					size_t index = SRWLock::lock_shared_any(ppLocks, 4, (seed >> 4) % 200);
+					if (index == -1)
+					{
+						Atomic::IncrementFetch(&timeOutCount);
+						continue;
+					}
+					Assert(exclusiveCounts[index] == 0);
+					locks[index].unlock_shared();
 				}
 				else
 				{
-					Assert(isExit);
-					return;
+					size_t index = SRWLock::lock_any(ppLocks, 4, (seed & 1) ? -1 : (seed >> 4) % 200);
+					if (index == -1)
+					{
+						Atomic::IncrementFetch(&timeOutCount);
+						continue;
+					}
+					Assert(++exclusiveCounts[index] == 1);
+					++totals[index];
+					std::this_thread::yield();
+					--exclusiveCounts[index];
+					locks[index].unlock();
 				}
 			}
+		};
 
-			ac.AddData(static_cast<double>(GetTickMicrosec() - ts));
-		}
-	};
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			thdList.emplace_back(func, i + 1);
+		for (auto &thd : thdList)
+			thd.join();
 
-	std::vector<std::thread> thdList(threadCount);
-	for (auto &thd : thdList)
-		thd = std::thread(funcCustomer);
+		for (auto &lk : locks)
+		{
+			Assert(lk.try_lock());
+			lk.unlock();
+		}
 
-	std::thread thdProducer(funcProducer);
+		printf("LockAny Race: %u timeouts\n", timeOutCount);
+	}
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+	{
+		SRWLock lock;
+		SRWCondVar condVars[3];
+		SRWCondVar *ppConds[] = { &condVars[0], &condVars[1], &condVars[2] };
 
-	isExit = true;
-	ctxProducer.NotifyData(0, true);
+		{
+			LockGuard<SRWLock> lk(lock);
+			Assert(SRWCondVar::wait_any_for(ppConds, 3, lk, 1000) == -1);
+		}
 
-	std::vector<uint64_t> tsList(threadCount);
-	ctxCustomer.NotifyDataList(tsList, true);
+		// 任一条件变量被通知时唤醒
+		size_t result = -1;
+		volatile bool isWaiting = false;
+		std::thread thd([&]()
+		{
+			LockGuard<SRWLock> lk(lock);
+			isWaiting = true;
+			result = SRWCondVar::wait_any_for(ppConds, 3, lk, 4000000);
+		});
 
-	for (auto &thd : thdList)
+		while (!isWaiting)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		{
+			LockGuard<SRWLock> lk(lock);
+			condVars[2].notify_one();
+		}
 		thd.join();
-	thdProducer.join();
-
-	printf("[ThunderingHerd] %s: ", name);
-	ac.Print();
-	puts("");
-}
+		Assert(result == 2);
+	}
 
-//////////////////////////////////////////////////////////////////////////
-PLATFORM_NOINLINE static void TestSRWRecLock()
-{
-	SRWRecLock rl;
+	{
+		// 持有锁时通知多个条件变量, 多个节点同时被通知时不能等待已转交出去的节点
+		SRWLock lock;
+		SRWCondVar condVars[2];
+		SRWCondVar *ppConds[] = { &condVars[0], &condVars[1] };
 
-	rl.lock();
-	rl.lock();
-	Assert(rl.try_lock());
-	Assert(rl.try_lock());
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			size_t result = -1;
+			volatile bool isWaiting = false;
+			std::thread thd([&]()
+			{
+				LockGuard<SRWLock> lk(lock);
+				isWaiting = true;
+				result = SRWCondVar::wait_any(ppConds, 2, lk);
+			});
 
-	rl.unlock();
-	rl.unlock();
-	rl.unlock();
-	rl.unlock();
+			while (!isWaiting)
+				std::this_thread::yield();
+			{
+				LockGuard<SRWLock> lk(lock);
+				condVars[0].notify_one();
+				condVars[1].notify_one();
+			}
+			thd.join();
+			Assert(result == 0 || result == 1);
+		}
+	}
 
 	{
-		Assert(rl.try_lock());
+		// 多个分发线程等待多个队列, 单个通知不能丢失
+		const uint32_t queueCount = 4;
+		const uint32_t dispatcherCount = 3;
+		const uint32_t loops = 20000;
+		SRWLock lock;
+		SRWCondVar condVars[queueCount];
+		SRWCondVar *ppConds[queueCount];
+		uint32_t pendings[queueCount] = {};
+		uint32_t consumed = 0;
+		bool isDone = false;
+
+		for (uint32_t i = 0; i < queueCount; ++i)
+			ppConds[i] = &condVars[i];
+
+		auto dispatcher = [&]()
+		{
+			LockGuard<SRWLock> lk(lock);
+			for (;;)
+			{
+				bool isFound = false;
+				for (uint32_t i = 0; i < queueCount; ++i)
+				{
+					if (pendings[i])
+					{
+						--pendings[i];
+						++consumed;
+						isFound = true;
+						break;
+					}
+				}
 
-		bool result = false;
-		std::thread thd([&rl, &result]()
+				if (isFound)
+					continue;
+				if (isDone)
+					break;
+
+				SRWCondVar::wait_any(ppConds, queueCount, lk);
+			}
+		};
+
+		auto producer = [&](uint32_t idx)
 		{
-			rl.lock();
-			rl.unlock();
-			result = true;
-		});
+			for (uint32_t i = 0; i < loops; ++i)
+			{
+				{
+					LockGuard<SRWLock> lk(lock);
+					++pendings[idx];
+				}
+				condVars[idx].notify_one();
+			}
+		};
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
-		Assert(!result);
-		rl.unlock();
+		std::vector<std::thread> thdList;
+		for (uint32_t i = 0; i < dispatcherCount; ++i)
+			thdList.emplace_back(dispatcher);
+		for (uint32_t i = 0; i < queueCount; ++i)
+			thdList.emplace_back(producer, i);
 
-		thd.join();
-		Assert(result);
-	}
-	{
-		Assert(rl.try_lock());
+		for (uint32_t i = dispatcherCount; i < thdList.size(); ++i)
+			thdList[i].join();
 
-		std::thread thd([&rl]()
 		{
-			Assert(!rl.try_lock());
-		});
+			LockGuard<SRWLock> lk(lock);
+			isDone = true;
+		}
+		for (auto &cv : condVars)
+			cv.notify_all();
 
-		thd.join();
+		for (uint32_t i = 0; i < dispatcherCount; ++i)
+			thdList[i].join();
 
-		rl.unlock();
+		Assert(consumed == loops * queueCount);
 	}
 
-	puts("TestSRWRecLock OK");
+	puts("TestWaitAny OK");
 }
+#endif
 
-//////////////////////////////////////////////////////////////////////////
 int main()
 {
 	uint32_t thds = std::thread::hardware_concurrency();
 	printf("ProcessorThreads: %u\n", thds);
+	printf("CyclesPerYield: %u\n", SRWLock_GetCyclesPerYield());
 
 	TestSRWRecLock();
+	TestSRWRecSharedLock();
+	TestSRWLockTimed();
+	TestSRWLockUpgrade();
+#if defined(SRWLOCK_HAS_WAIT_ANY)
+	TestWaitAny();
+#endif
+	TestPhaseFairLock();
+	TestPILock();
+	TestBiasedLock();
+	TestSRWLock32();
+	TestSRWLockArray();
+	TestSeqLock();
+#if defined(SRWLOCK_HAS_STOP_TOKEN)
+	TestCancellableWait();
+#endif
+	TestCohortLock();
+	TestMultiLock();
+#if defined(SRWLOCK_ENABLE_STATS)
+	TestLockStats();
+	TestLockRegistry();
+#endif
+	TestHoldTime();
+#if defined(SRWLOCK_ENABLE_WATCHDOG)
+	TestWatchdog();
+#endif
+#if defined(SRWLOCK_HAS_COROUTINE)
+	TestAsyncLock();
+#endif
+#if defined(SRWLOCK_HAS_PROCESS_SHARED)
+	TestProcessLock();
+#endif
+	TestHandoffLock();
 
 	TestCondVarSwitch<std::condition_variable, std::mutex, std::unique_lock<std::mutex>>("std::cond_var", []()
 	{
@@ -766,6 +3712,9 @@ int main()
 	TestCondVarSwitch<SRWCondVar, SRWLock, LockGuard<SRWLock>>("SRWCondVar", []()
 	{
 	});
+	TestCondVarSwitch<SRWCondVar, SRWAdaptiveLock, LockGuard<SRWAdaptiveLock>>("SRWCondVar.adaptive", []()
+	{
+	});
 	TestCondVarSwitch<std::condition_variable, std::mutex, std::unique_lock<std::mutex>>("std::cond_var.sleep(0)", []()
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(0));
@@ -802,6 +3751,15 @@ int main()
 	TestCondVar();
 	SimpleTestCondVar();
 	TestLockPerf();
+	TestReadMostlyPerf();
+	TestDenseLockPerf();
+	TestLockArrayPerf();
+	TestSeqLockPerf();
+	TestCohortLockPerf();
+	TestRecLockPerf();
+	TestTailLatencyPerf();
+	TestPriorityInversionPerf();
+	TestAdaptiveSpin();
 	TestLockWakePerf();
 	SimpleTest();
 	return 0;